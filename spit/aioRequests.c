@@ -9,16 +9,806 @@
 #include <assert.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
 
 #include "utils.h"
 #include "logSpeed.h"
 #include "aioRequests.h"
 #include "positions.h"
+#include "uringRequests.h"
+#include "discardWorker.h"
+#include "bufferCache.h"
+#include "positionStream.h"
+#include "sectorHeader.h"
 
 extern volatile int keepRunning;
 
 #define DISPLAYEVERY 1
 
+// submit/reap through whichever engine the job asked for
+static inline int engineSubmit(const int engine, io_context_t ioc, uringType *ring, long nr, struct iocb **cbs)
+{
+  if (engine == ENGINE_LIBAIO) {
+    return io_submit(ioc, nr, cbs);
+  }
+  return uringSubmit(ring, nr, cbs);
+}
+
+// the completion ring the kernel maps at the io_context_t address
+struct aio_ring {
+  unsigned id;
+  unsigned nr;
+  unsigned head;
+  unsigned tail;
+  unsigned magic;
+  unsigned compat_features;
+  unsigned incompat_features;
+  unsigned header_length;
+  struct io_event io_events[];
+};
+
+#define AIO_RING_MAGIC 0xa10a10a1
+#define POLLSPINSECONDS 0.0001 // spin for 100us before sleeping in the kernel
+
+int aioRingUsable(io_context_t ioc)
+{
+  const struct aio_ring *r = (struct aio_ring*)ioc;
+  return r && (r->magic == AIO_RING_MAGIC) && (r->incompat_features == 0);
+}
+
+// take up to nr completions from the ring without a syscall. We are the only reaper of this context
+static int aioRingReap(io_context_t ioc, long nr, struct io_event *events)
+{
+  struct aio_ring *r = (struct aio_ring*)ioc;
+  unsigned head = r->head;
+  const unsigned tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  int got = 0;
+
+  while (head != tail && got < nr) {
+    events[got++] = r->io_events[head];
+    head++;
+    if (head == r->nr) head = 0;
+  }
+  __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+  return got;
+}
+
+// io_getevents() semantics. With pollRing the completion ring is spun on for a bounded time
+// and only when it stays empty do we sleep in the kernel
+static int engineGetEvents(const int engine, io_context_t ioc, uringType *ring, long min_nr, long nr, struct io_event *events, struct timespec *timeout, const int pollRing, size_t *engineCalls)
+{
+  if (pollRing && nr > 0 && min_nr <= nr) {
+    int got = 0;
+    const double spinUntil = timeStamp() + POLLSPINSECONDS;
+    do {
+      if (engine == ENGINE_LIBAIO) {
+        got += aioRingReap(ioc, nr - got, events + got);
+      } else {
+        got += uringGetEvents(ring, 0, nr - got, events + got, NULL);
+      }
+      if (got >= min_nr) return got;
+    } while (timeStamp() < spinUntil);
+
+    // the ring stayed empty, block for the rest
+    int ret = engineGetEvents(engine, ioc, ring, min_nr - got, nr - got, events + got, timeout, 0, engineCalls);
+    return (ret < 0) ? (got ? got : ret) : got + ret;
+  }
+
+  if (engine == ENGINE_LIBAIO) {
+    (*engineCalls)++;
+    return io_getevents(ioc, min_nr, nr, events, timeout);
+  }
+  return uringGetEvents(ring, min_nr, nr, events, timeout);
+}
+
+// set up a write from the shared buffer cache. The slot keeps a reference to its seed's
+// buffer and its own copy of the first block, which is stamped with the position and UUID
+static void prepWrite(struct iocb *cb, const int fd, const int qdIndex, char **data, const char **slotBuffer, unsigned short *dataseed,
+		      struct iovec *iovs, const size_t alignment, const size_t maxSize, positionType *pp, const positionContainer *pc)
+{
+  const size_t len = pp->len;
+  if (pc->pattern) {
+    // generated from (seed, pos) and only stamped with g, a stamp makes the blocks it's in unique
+    dataPatternFill(pc->pattern, data[qdIndex], len, pp->seed, pp->pos);
+    if (pc->sectorSize) {
+      sectorHeaderStamp(data[qdIndex], len, pc->sectorSize, pp->pos, pc->UUID, sectorHeaderGeneration(), pp->seed);
+    }
+    io_prep_pwrite(cb, fd, data[qdIndex], len, pp->pos);
+    cb->data = pp;
+    return;
+  }
+  const size_t headerLen = MIN(alignment, maxSize);
+  if (!slotBuffer[qdIndex] || (pp->seed != dataseed[qdIndex])) {
+    if (slotBuffer[qdIndex]) {
+      bufferCacheRelease(dataseed[qdIndex], maxSize);
+    }
+    slotBuffer[qdIndex] = bufferCacheGet(pp->seed, maxSize);
+    dataseed[qdIndex] = pp->seed;
+    // with sector headers the whole write is the slot's, the headers are all that change
+    memcpy(data[qdIndex], slotBuffer[qdIndex], pc->sectorSize ? maxSize : headerLen);
+  }
+  if (pc->sectorSize) {
+    sectorHeaderStamp(data[qdIndex], len, pc->sectorSize, pp->pos, pc->UUID, sectorHeaderGeneration(), pp->seed);
+    io_prep_pwrite(cb, fd, data[qdIndex], len, pp->pos);
+    cb->data = pp;
+    return;
+  }
+  const int splitWrite = (len > headerLen) && ((len % headerLen) == 0);
+  if (!splitWrite && (len > headerLen)) {
+    memcpy(data[qdIndex] + headerLen, slotBuffer[qdIndex] + headerLen, len - headerLen);
+  }
+
+  size_t *posdest = (size_t*)data[qdIndex];
+  *posdest = pp->pos;
+
+  size_t *uuiddest = (size_t*)data[qdIndex] + 1;
+  *uuiddest = pc->UUID;
+
+  if (splitWrite) {
+    // only the stamped first block is per slot, the rest is read straight from the cache
+    struct iovec *iov = &iovs[qdIndex * 2];
+    iov[0].iov_base = data[qdIndex];
+    iov[0].iov_len = headerLen;
+    iov[1].iov_base = (void*)(slotBuffer[qdIndex] + headerLen);
+    iov[1].iov_len = len - headerLen;
+    io_prep_pwritev(cb, fd, iov, 2, pp->pos);
+  } else {
+    io_prep_pwrite(cb, fd, data[qdIndex], len, pp->pos);
+  }
+  cb->data = pp;
+}
+
+
+// everything about an I/O completion except giving its slot back and counting it. Always run
+// by the submitting thread, the split reaper only hands the events over
+typedef struct {
+  positionContainer *p;
+  char **readdata;
+  int fd;
+  FILE *fp;
+  char *jobdevice;
+  positionType *flushes;
+  size_t QD;
+  size_t *ioerrors;
+  size_t printed, slow;
+  const size_t *submitted;
+  double flush_totaltime, flush_mintime, flush_maxtime;
+  size_t flush_count;
+} completionType;
+
+static void completeOne(completionType *c, const struct io_event *ev, const double lastreceive)
+{
+  positionType *pp = (positionType*) ev->obj->data;
+  positionType *positions = c->p->positions;
+  assert(pp->inFlight);
+
+  int rescode = ev->res;
+  int rescode2 = ev->res2;
+
+  if ((rescode < 0) || (rescode2 != 0)) { // if return of bytes written or read / IO error
+    *c->ioerrors = (*c->ioerrors) + 1;
+    if (c->printed++ < 10) {
+      fprintf(stderr,"*error* AIO failure codes[fd=%d]: res=%d and res2=%d, [%zd] len %d\n", c->fd, rescode, rescode2, pp->pos, pp->len);
+    }
+    if (*c->ioerrors > 1000000) {
+      fprintf(stderr,"*info* over %zd IO errors. Exiting...\n", *c->ioerrors);
+      exit(-1);
+    }
+  } else { // good IO
+    const positionType *written = positionVerifies(positions, pp);
+    if (written && (pp->action == 'R')) {
+      // if we know we have written we can check, or if we have read a previous write
+      size_t *uucheck = NULL, *poscheck = NULL;
+      poscheck = (size_t*)c->readdata[pp->q];
+      uucheck = (size_t*)c->readdata[pp->q] + 1;
+      size_t expect[2] = {pp->pos, c->p->UUID};
+      if (c->p->sectorSize) {
+        // the first sector's header, its LBA and UUID
+        poscheck = (size_t*)(c->readdata[pp->q] + offsetof(sectorHeaderType, lba));
+        uucheck = (size_t*)(c->readdata[pp->q] + offsetof(sectorHeaderType, uuid));
+        expect[0] = pp->pos / 512;
+      } else if (c->p->pattern) {
+        // no stamp, the start of the write's data instead
+        dataPatternFill(c->p->pattern, (char*)expect, sizeof(expect), written->seed, pp->pos);
+      }
+
+      if (((expect[1] != *uucheck) || (expect[0] != *poscheck)) && (written->latency)) {
+        fprintf(stderr,"*error* position[%zd] '%c' R=%d (success %d) ver=%d wrong. UUID %zd/%zd, pos %zd/%zd\n", (size_t)(pp - positions), pp->action, pp->seed, pp->success, pp->verify, c->p->UUID, *uucheck, pp->pos, *poscheck);
+        fprintf(stderr,"*error* Maybe: combinations of meta-data 'm', multiple threads 'j' and without G_ may fail\n");
+        fprintf(stderr,"*error* as the different threads will clobber data from other threads in real time\n");
+        fprintf(stderr,"*error* Potentially write to -P positions.txt and check after data is written\n");
+        abort();
+      }
+    }
+    positionSetFinishTime(pp, lastreceive);
+  } // good IO
+  pp->success = 1; // the action has completed
+  pp->inFlight = 0;
+  if ((pp >= c->flushes) && (pp < c->flushes + c->QD)) {
+    if (pp->latency) {
+      const double ft = pp->latency;
+      positionContainerAddFlushLatency(c->p, ft);
+      c->flush_totaltime += ft;
+      c->flush_count++;
+      if (ft < c->flush_mintime) c->flush_mintime = ft;
+      if (ft > c->flush_maxtime) c->flush_maxtime = ft;
+    }
+  } else if (c->fp == stdout) {
+    positionStreamPush(pp, c->p->maxbdSize, c->jobdevice);
+  }
+  // log if slow
+  if (pp->latency > 30) {
+    c->slow++;
+    const size_t submitted = *c->submitted;
+    char s[300];
+    sprintf(s, "slow I/O (%c,pos=%zd,size=%d) %.1lf s, submission loop, %zd slow from %zd submitted (%.1lf%%)\n", pp->action, pp->pos, pp->len, pp->latency, c->slow, submitted, c->slow * 100.0 / (c->slow + submitted));
+    syslogString("spit", s);
+    fprintf(stderr,"*warning* %s", s);
+  }
+}
+
+
+// one round's queue: the slots, the iocbs and buffers in them, and the counts. The job's own
+// loop, aioMultiplePositions(), and a device on the shared event loop both fill it a position
+// at a time with queuePosition() and empty it with queueReap(), so they can't drift apart
+typedef struct {
+  positionContainer *p;
+  positionType *positions;
+  size_t QD, alignment, maxSize, finishBytes;
+  int fd;
+  int efd; // completions signal it, -1 for none
+  int flushEvery;
+  int verbose;
+  FILE *fp;
+  char *jobdevice;
+  arenaType *arena;
+
+  struct iocb **cbs, **batch;
+  size_t batchCount;
+  struct io_event *events;
+  char **data, **readdata;
+  unsigned short *dataseed;
+  const char **slotBuffer; // write data comes from the shared buffer cache
+  struct iovec *iovs;
+  unsigned short *freeQueue; // grab [headOfQueue], put back onto [tailOfQueue]
+  size_t headOfQueue, tailOfQueue;
+  positionType *flushes; // async flushes are not positions, they use their own record in the slot they occupy
+  completionType cc;
+
+  discardWorkerType *dw; // NULL if trims aren't done
+  positionType **trimDone;
+  size_t trimQD; // at most this many of the slots are trims
+
+  size_t inFlight, flushesInFlight, trimsInFlight;
+  size_t submitted, received, flushPos;
+  size_t totalReadSubmit, totalWriteSubmit, totalReadBytes, totalWriteBytes;
+  size_t syscalls, engineCalls; // sync calls (fsync/discard) and submit/reap calls
+  size_t dependencyPos; // the position last counted as waiting on its write
+
+  double start, last; // for the progress line
+  size_t lastBytes, lastIOCount;
+} ioQueueType;
+
+#define ISFLUSHRECORD(q, x) (((x) >= (q)->flushes) && ((x) < (q)->flushes + (q)->QD))
+
+
+static void queueSetup(ioQueueType *q, positionContainer *p, const size_t QD, const size_t alignment, const size_t maxSize,
+		       const int fd, const int flushEvery, FILE *fp, char *jobdevice, arenaType *arena, size_t *ioerrors, const int verbose)
+{
+  memset(q, 0, sizeof(ioQueueType));
+  q->p = p;
+  q->positions = p->positions;
+  q->QD = QD;
+  q->alignment = alignment;
+  q->maxSize = maxSize;
+  q->fd = fd;
+  q->efd = -1;
+  q->flushEvery = flushEvery;
+  q->verbose = verbose;
+  q->fp = fp;
+  q->jobdevice = jobdevice;
+  q->arena = arena;
+
+  // setup the buffers to be contiguous
+  if (maxSize * QD >= totalRAM()) {
+    fprintf(stderr,"*info* can't allocate (block size %zd x QD %zd) bytes\n", maxSize, QD);
+    exit(-1);
+  }
+
+  CALLOC(q->cbs, QD, sizeof(struct iocb*));
+  for (size_t i = 0; i < QD; i++) {
+    CALLOC(q->cbs[i], 1, sizeof(struct iocb));
+  }
+  CALLOC(q->batch, QD, sizeof(struct iocb*));
+  CALLOC(q->events, QD, sizeof(struct io_event));
+  CALLOC(q->data, QD, sizeof(char*));
+  CALLOC(q->readdata, QD, sizeof(char*));
+  CALLOC(q->dataseed, QD, sizeof(unsigned short));
+  CALLOC(q->slotBuffer, QD, sizeof(char*));
+  CALLOC(q->iovs, QD * 2, sizeof(struct iovec));
+  CALLOC(q->freeQueue, QD, sizeof(unsigned short));
+  CALLOC(q->flushes, QD, sizeof(positionType));
+
+  // the slabs come from the thread's NUMA local arena if it has one, so they are reused each round
+  if (arena) {
+    q->data[0] = arenaAlloc(arena, maxSize * QD);
+    q->readdata[0] = arenaAlloc(arena, maxSize * QD);
+  } else {
+    CALLOC(q->data[0], maxSize * QD, 1);
+    CALLOC(q->readdata[0], maxSize * QD, 1);
+  }
+  for (size_t i = 0; i < QD; i++) {
+    q->data[i] = q->data[0] + (maxSize * i);
+    q->readdata[i] = q->readdata[0] + (maxSize * i);
+    q->freeQueue[i] = i;
+  }
+
+  q->cc.p = p;
+  q->cc.readdata = q->readdata;
+  q->cc.fd = fd;
+  q->cc.fp = fp;
+  q->cc.jobdevice = jobdevice;
+  q->cc.flushes = q->flushes;
+  q->cc.QD = QD;
+  q->cc.ioerrors = ioerrors;
+  q->cc.submitted = &q->submitted;
+  q->cc.flush_mintime = 9e99;
+
+  q->dependencyPos = (size_t)-1;
+  q->start = timeStamp();
+  q->last = q->start;
+  p->passStart = q->start;
+  p->passEnd = 0;
+}
+
+
+static void queueFree(ioQueueType *q)
+{
+  for (size_t i = 0; i < q->QD; i++) {
+    if (q->slotBuffer[i]) {
+      bufferCacheRelease(q->dataseed[i], q->maxSize);
+    }
+    free(q->cbs[i]);
+  }
+  if (q->arena) {
+    arenaPop(q->arena, q->readdata[0]);
+    arenaPop(q->arena, q->data[0]);
+  } else {
+    free(q->data[0]);
+    free(q->readdata[0]);
+  }
+  free(q->cbs);
+  free(q->batch);
+  free(q->events);
+  free(q->data);
+  free(q->readdata);
+  free(q->dataseed);
+  free(q->slotBuffer);
+  free(q->iovs);
+  free(q->freeQueue);
+  free(q->flushes);
+  free(q->trimDone);
+}
+
+
+// submit the batch with as few calls as possible. A full ring (-EAGAIN, or nothing taken)
+// isn't an error, what the kernel didn't take is moved to the front of the batch and stays in
+// flight, to be submitted first next time. On a real error the rest are given back: the slots
+// return to the freeQueue and the positions are dropped
+static void submitBatch(ioQueueType *q, const int engine, io_context_t ioc, uringType *ring, const int dontExitOnErrors)
+{
+  struct iocb **batch = q->batch;
+  const size_t n = q->batchCount;
+
+  // one timestamp for the batch, it's when they are all handed to the kernel
+  const double now = timeStamp();
+  for (size_t i = 0; i < n; i++) {
+    ((positionType*)batch[i]->data)->submitTime = now;
+  }
+
+  size_t done = 0;
+  int failed = 0;
+  while (done < n) {
+    const int ret = engineSubmit(engine, ioc, ring, n - done, batch + done);
+    q->engineCalls++;
+    if ((ret == 0) || (ret == -EAGAIN)) {
+      break; // the queue is full, retry when some have completed
+    }
+    if (ret < 0) {
+      *q->cc.ioerrors = (*q->cc.ioerrors) + 1;
+      fprintf(stderr,"io_submit() failed, ret = %d, submitted %zd of %zd\n", ret, done, n);
+      if (!dontExitOnErrors) abort();
+      failed = 1;
+      break;
+    }
+    done += ret;
+  }
+
+  if (!failed) {
+    memmove(batch, batch + done, (n - done) * sizeof(struct iocb*));
+    q->batchCount = n - done;
+    return;
+  }
+
+  for (size_t i = done; i < n; i++) {
+    positionType *pp = (positionType*)batch[i]->data;
+    pp->inFlight = 0;
+    if (pp->action == 'R') {
+      q->totalReadSubmit -= pp->len;
+    } else if (pp->action == 'W') {
+      q->totalWriteSubmit -= pp->len;
+    }
+    q->freeQueue[q->tailOfQueue++] = pp->q;
+    if (q->tailOfQueue == q->QD) q->tailOfQueue = 0;
+    q->inFlight--;
+    if (batch[i]->aio_lio_opcode == IO_CMD_FDSYNC) {
+      q->flushesInFlight--; // dropped, the next flush covers these writes
+    } else {
+      q->submitted--;
+    }
+  }
+  q->batchCount = 0;
+}
+
+
+// a finished I/O, completeOne() has been done: count it and give its slot back
+static void queueRelease(ioQueueType *q, positionType *pp)
+{
+  if (ISFLUSHRECORD(q, pp)) {
+    q->flushesInFlight--;
+  } else {
+    q->received++;
+    if (pp->latency) { // good IO
+      if (pp->action == 'R') {
+	q->p->readIOs++;
+	q->p->readBytes += pp->len;
+	q->totalReadBytes += pp->len;
+      } else if (pp->action == 'W') {
+	q->p->writtenIOs++;
+	q->p->writtenBytes += pp->len;
+	q->totalWriteBytes += pp->len;
+      }
+    }
+  }
+  q->freeQueue[q->tailOfQueue++] = pp->q;
+  if (q->tailOfQueue == q->QD) q->tailOfQueue = 0;
+  q->inFlight--;
+}
+
+
+// ret completions in q->events
+static void queueReap(ioQueueType *q, const int ret)
+{
+  const double lastreceive = timeStamp();
+  for (int j = 0; j < ret; j++) {
+    completeOne(&q->cc, &q->events[j], lastreceive);
+    queueRelease(q, (positionType*) q->events[j].obj->data);
+  }
+}
+
+
+// hand completed trims back to the loop: stamp them done and give the slot back
+static void reapTrims(ioQueueType *q, const double waitSeconds)
+{
+  const size_t got = discardWorkerReap(q->dw, q->trimDone, q->QD, waitSeconds);
+  for (size_t j = 0; j < got; j++) {
+    positionType *pp = q->trimDone[j];
+    pp->success = 1;
+    pp->inFlight = 0;
+    q->p->writtenIOs++;
+    if (q->fp == stdout) {
+      positionStreamPush(pp, q->p->maxbdSize, q->jobdevice);
+    }
+    q->freeQueue[q->tailOfQueue++] = pp->q;
+    if (q->tailOfQueue == q->QD) q->tailOfQueue = 0;
+  }
+  q->inFlight -= got;
+  q->trimsInFlight -= got;
+  q->received += got;
+}
+
+
+// take the slot for its prepared iocb, the whole batch is submitted with one call later
+static void queueTake(ioQueueType *q, const int qdIndex)
+{
+  if (q->efd >= 0) {
+    io_set_eventfd(q->cbs[qdIndex], q->efd);
+  }
+  q->batch[q->batchCount++] = q->cbs[qdIndex];
+  q->freeQueue[q->headOfQueue] = -1; // take off queue
+  q->headOfQueue++;
+  if (q->headOfQueue == q->QD) q->headOfQueue = 0;
+  q->inFlight++;
+}
+
+
+// an async fdatasync, covering the writes before it
+static void queueFlush(ioQueueType *q)
+{
+  const int qdIndex = q->freeQueue[q->headOfQueue];
+  positionType *fl = &q->flushes[qdIndex];
+  fl->action = 'F';
+  fl->q = qdIndex;
+  fl->inFlight = 1;
+  fl->latency = 0;
+  io_prep_fdsync(q->cbs[qdIndex], q->fd);
+  q->cbs[qdIndex]->data = fl;
+  if (q->verbose >= 2) {
+    fprintf(stderr,"SYNC: async fdatasync qdIndex=%d\n", qdIndex);
+  }
+  queueTake(q, qdIndex);
+  q->flushesInFlight++;
+  q->flushPos -= q->flushEvery;
+}
+
+
+#define QUEUE_NEXT 0 // queued, or there's nothing to do, onto the next position
+#define QUEUE_WAIT 1 // it waits on an earlier write or a trim, try again later
+#define QUEUE_STOP 2 // it would pass the byte limit, the round is over
+
+// onto the next position, keeping the time it's due
+static size_t queueNext(ioQueueType *q, const size_t sz, const size_t pos, const size_t posIncrement, double *due)
+{
+  const positionType *positions = q->positions;
+  const size_t next = pos + posIncrement;
+  if (next >= sz) {
+    q->p->passStart = timeStamp(); // the next pass is due from now
+    q->p->passEnd = 0;
+    *due = q->p->passStart + positionDelay(&positions[0]);
+    return 0;
+  }
+  for (size_t i = pos + 1; i <= next; i++) {
+    *due += positionDelay(&positions[i]);
+  }
+  q->p->passEnd = next;
+  return next;
+}
+
+
+// the per position step, prepare its iocb in a free slot, or say why it can't go yet
+static int queuePosition(ioQueueType *q, positionType *pp)
+{
+  positionType *positions = q->positions;
+  const size_t index = pp - positions;
+
+  if (pp->inFlight) {
+    if (q->verbose >= 1) {
+      fprintf(stderr,"*info* position collision %zd\n", index);
+    }
+    return QUEUE_NEXT;
+  }
+  if (pp->action == 'S') {
+    return QUEUE_NEXT;
+  }
+  if (pp->action == 'P') {
+    // no longer a drain, the reads after it wait on their own writes below
+    if (q->inFlight > 0) q->p->pauseBarriers++;
+    return QUEUE_NEXT;
+  }
+
+  // a read that verifies a write can't pass it, everything before it keeps the queue full
+  const positionType *written = positionVerifies(positions, pp);
+  if (written && (pp->action == 'R') && written->inFlight) {
+    if (q->dependencyPos != index) {
+      q->p->dependencyWaits++;
+      q->dependencyPos = index;
+    }
+    return QUEUE_WAIT;
+  }
+
+  if (pp->action == 'T') {
+    if (q->dw) {
+      // EN trims at once, the rest of the slots are left to the other I/O
+      if (q->trimsInFlight >= q->trimQD) {
+	return QUEUE_WAIT;
+      }
+      if (q->verbose >= 2) fprintf(stderr,"*info* trim at %zd len = %d\n", pp->pos, pp->len);
+      // the trim holds a slot while a discard worker performs it, which stamps its submitTime
+      const int qdIndex = q->freeQueue[q->headOfQueue];
+      q->freeQueue[q->headOfQueue] = -1;
+      q->headOfQueue++;
+      if (q->headOfQueue == q->QD) q->headOfQueue = 0;
+      pp->q = qdIndex;
+      pp->inFlight = 1;
+      pp->latency = 0;
+      discardWorkerSubmit(q->dw, pp);
+      q->syscalls++;
+      q->inFlight++;
+      q->trimsInFlight++;
+      q->submitted++;
+    }
+    return QUEUE_NEXT;
+  }
+
+  if (q->fd < 0) {
+    return QUEUE_NEXT;
+  }
+  if (q->finishBytes && ((pp->action == 'R') || (pp->action == 'W')) && (q->totalWriteSubmit + q->totalReadSubmit + pp->len > q->finishBytes)) {
+    return QUEUE_STOP;
+  }
+
+  assert(q->headOfQueue < q->QD);
+  const int qdIndex = q->freeQueue[q->headOfQueue];
+  assert(qdIndex >= 0);
+  struct iocb *cb = q->cbs[qdIndex];
+  pp->q = qdIndex;
+  pp->inFlight = 1;
+
+  if (pp->action == 'R') {
+    if (q->verbose >= 2) {
+      fprintf(stderr,"[%zd] read qdIndex=%d\n", pp->pos, qdIndex);
+    }
+    io_prep_pread(cb, q->fd, q->readdata[qdIndex], pp->len, pp->pos);
+    cb->data = pp;
+    q->totalReadSubmit += pp->len;
+  } else if (pp->action == 'F') {
+    if (q->verbose >= 2) {
+      fprintf(stderr,"[%zd] flush qdIndex=%d\n", pp->pos, qdIndex);
+    }
+    io_prep_fsync(cb, q->fd);
+    cb->data = pp;
+  } else if (pp->action == 'W') {
+    if (q->verbose >= 2) {
+      fprintf(stderr,"[%zd] write qdIndex=%d\n", pp->pos, qdIndex);
+    }
+    if (written && (written->latency == 0)) {
+      pp->verify = 0;
+    }
+    prepWrite(cb, q->fd, qdIndex, q->data, q->slotBuffer, q->dataseed, q->iovs, q->alignment, q->maxSize, pp, q->p);
+    q->totalWriteSubmit += pp->len;
+    q->flushPos++;
+  } else {
+    fprintf(stderr,"unknown action %c\n", pp->action);
+    abort();
+  }
+  pp->latency = 0;
+
+  queueTake(q, qdIndex);
+  q->submitted++;
+  if (q->verbose >= 2 || (pp->pos & (q->alignment - 1))) {
+    fprintf(stderr,"fd %d, pos %zd (%% %zd = %zd ... %s), size %d, inFlight %zd, QD %zd, submitted %zd, received %zd\n", q->fd, pp->pos, q->alignment, pp->pos % q->alignment, (pp->pos % q->alignment) ? "NO!!" : "aligned", pp->len, q->inFlight, q->QD, q->submitted, q->received);
+  }
+  return QUEUE_NEXT;
+}
+
+
+// the progress line, once every DISPLAYEVERY seconds
+static void queueProgress(ioQueueType *q, const double thistime, const size_t pos, const int tableMode)
+{
+  const double timeelapsed = thistime - q->last;
+  if (timeelapsed < DISPLAYEVERY) {
+    return;
+  }
+  const size_t bytes = q->totalReadBytes + q->totalWriteBytes;
+  if (!tableMode) {
+    if (q->verbose != -1) {
+      const double speed = TOMB(1.0*(bytes - q->lastBytes) / timeelapsed);
+      const double IOspeed = 1.0*(q->received - q->lastIOCount) / timeelapsed;
+      fprintf(stderr,"[%.1lf] %.1lf GB, qd: %zd, op: %zd, [%zd], %.0lf IO/s, %.1lf MB/s\n", thistime - q->start, TOGB(bytes), q->inFlight, q->received, pos, IOspeed, speed);
+    }
+    if (q->verbose >= 2) {
+      if (q->cc.flush_count) fprintf(stderr,"*info* avg flush time %.4lf (min %.4lf, max %.4lf)\n", q->cc.flush_totaltime / q->cc.flush_count, q->cc.flush_mintime, q->cc.flush_maxtime);
+    }
+  }
+  q->lastBytes = bytes;
+  q->lastIOCount = q->received;
+  q->last = thistime;
+}
+
+
+// a reaped event and when it was reaped, so the latency doesn't include the handover
+typedef struct {
+  struct io_event ev;
+  double received;
+} reapedType;
+
+// the optional second thread per job. It waits for completions and hands the events to the
+// submitter through a single producer/single consumer ring. The positions are only touched by
+// the submitter, which processes them and gives their slots back in drainReaped()
+typedef struct {
+  int engine;
+  io_context_t ioc;
+  uringType *ring;
+  int pollRing;
+  size_t QD;
+  struct io_event *events;
+  size_t engineCalls;
+  double cpu; // user+sys seconds
+
+  reapedType *done; // QD entries, there can't be more completions than slots
+  size_t doneHead __attribute__((aligned(64))); // only the submitter moves this
+  size_t doneTail __attribute__((aligned(64))); // only the reaper moves this
+  int stop __attribute__((aligned(64)));
+  int sleeping __attribute__((aligned(64))); // the submitter is waiting on moved
+  pthread_mutex_t lock;
+  pthread_cond_t moved;
+  pthread_t thread;
+} reaperType;
+
+static void *reaperThread(void *arg)
+{
+  reaperType *r = (reaperType*)arg;
+  struct rusage cpustart, cpuend;
+  getrusage(RUSAGE_THREAD, &cpustart);
+
+  struct timespec timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_nsec = 10000*1000;
+
+  while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+    const int ret = engineGetEvents(r->engine, r->ioc, r->ring, 1, r->QD, r->events, &timeout, r->pollRing, &r->engineCalls);
+    if (ret <= 0) continue;
+
+    const double lastreceive = timeStamp();
+    size_t tail = r->doneTail;
+    for (int j = 0; j < ret; j++) {
+      assert(tail - __atomic_load_n(&r->doneHead, __ATOMIC_ACQUIRE) < r->QD);
+      r->done[tail % r->QD].ev = r->events[j];
+      r->done[tail % r->QD].received = lastreceive;
+      tail++;
+    }
+    __atomic_store_n(&r->doneTail, tail, __ATOMIC_SEQ_CST);
+
+    // only a submitter with nothing to do sleeps, so the wakeup is rarely needed
+    if (__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&r->lock);
+      pthread_cond_signal(&r->moved);
+      pthread_mutex_unlock(&r->lock);
+    }
+  }
+
+  getrusage(RUSAGE_THREAD, &cpuend);
+  r->cpu = (cpuend.ru_utime.tv_sec - cpustart.ru_utime.tv_sec) + (cpuend.ru_utime.tv_usec - cpustart.ru_utime.tv_usec) / 1000000.0 +
+    (cpuend.ru_stime.tv_sec - cpustart.ru_stime.tv_sec) + (cpuend.ru_stime.tv_usec - cpustart.ru_stime.tv_usec) / 1000000.0;
+  return NULL;
+}
+
+// submitter side: nothing can be submitted until the reaper hands slots back, so sleep until
+// it does rather than spin. At most maxWait seconds, a timed position or the end of the run
+// doesn't wait on a completion
+static void waitReaped(reaperType *r, const double maxWait)
+{
+  struct timespec until;
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_nsec += maxWait * 1e9;
+  while (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&r->lock);
+  __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&r->doneTail, __ATOMIC_SEQ_CST) == r->doneHead) {
+    pthread_cond_timedwait(&r->moved, &r->lock, &until);
+  }
+  __atomic_store_n(&r->sleeping, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&r->lock);
+}
+
+// submitter side: process the reaped events, give their slots back to the freeQueue and count
+// them. A position is in flight until here, so it can't be queued again while the reaper has it
+static size_t drainReaped(reaperType *r, ioQueueType *q)
+{
+  const size_t tail = __atomic_load_n(&r->doneTail, __ATOMIC_ACQUIRE);
+  size_t head = r->doneHead;
+  const size_t got = tail - head;
+
+  for (; head != tail; head++) {
+    const reapedType *d = &r->done[head % r->QD];
+    completeOne(&q->cc, &d->ev, d->received);
+    queueRelease(q, (positionType*) d->ev.obj->data);
+  }
+  __atomic_store_n(&r->doneHead, head, __ATOMIC_RELEASE);
+  return got;
+}
+
+
 size_t aioMultiplePositions( positionContainer *p,
                              const size_t sz,
                              const double finishTime,
@@ -39,7 +829,15 @@ size_t aioMultiplePositions( positionContainer *p,
                              const size_t discard_max_bytes,
 			     FILE *fp,
 			     char *jobdevice,
-			     size_t posIncrement
+			     size_t posIncrement,
+			     const int engine,
+			     const int iopoll,
+			     int pollRing,
+			     const int flushBarrier,
+			     const size_t trimQD,
+			     int splitReap,
+			     arenaType *arena,
+			     lazyPositionsType *lazy
                            )
 {
   if (sz == 0) {
@@ -49,20 +847,18 @@ size_t aioMultiplePositions( positionContainer *p,
   //  fprintf(stderr,"*info* positions %zd\n", sz);
   int ret, checkTime = finishTime > 0;
   if (posIncrement < 1) posIncrement = 1;
-  
+
 
   //  fprintf(stderr,"*this time %lf set %lf\n", timedouble(), finishTime);
   //  if (posLimit) {
   //    if (verbose) fprintf(stderr,"*info* limit positions to %zd\n", posLimit);
     //  }
-  
-  if ((finishTime > 0) && (finishTime < timedouble())) {
+
+  if ((finishTime > 0) && (finishTime < timeStamp())) {
     //    fprintf(stderr,"*warning* ignoring time as it's set in the past\n");
     checkTime = 0;
   }
 
-  struct iocb **cbs;
-  struct io_event *events;
   if (origQD >= sz)  {
     origQD = sz;
     //    fprintf(stderr,"*info* QD reduced due to limited positions. Setting q=%zd (verbose %d)\n", origQD, verbose);
@@ -79,21 +875,32 @@ size_t aioMultiplePositions( positionContainer *p,
   //  assert (alignbits == (size_t)alignbits);
 
   io_context_t ioc = 0;
-  if (io_setup(QD, &ioc)) {
-    fprintf(stderr,"*error* io_setup failed with %zd\n", QD);
-    exit(-2);
+  uringType ring;
+  ring.ringfd = -1;
+  if (engine == ENGINE_LIBAIO) {
+    if (io_setup(QD, &ioc)) {
+      fprintf(stderr,"*error* io_setup failed with %zd\n", QD);
+      exit(-2);
+    }
+    if (pollRing && !aioRingUsable(ioc)) {
+      fprintf(stderr,"*warning* the aio completion ring can't be read from userspace, not polling\n");
+      pollRing = 0;
+    }
+  } else {
+    if (uringSetup(&ring, QD, engine == ENGINE_URING_SQPOLL, iopoll)) {
+      exit(-2);
+    }
+    if (fd >= 0) {
+      if (uringRegisterFile(&ring, fd)) {
+        fprintf(stderr,"*warning* io_uring couldn't register the file, using the plain fd\n");
+      }
+    }
   }
 
   assert(QD);
   if (!alignment) alignment=512;
   assert(alignment);
 
-  CALLOC(events, QD, sizeof(struct io_event));
-  CALLOC(cbs, QD, sizeof(struct iocb*));
-  for (size_t i = 0; i < QD; i++) {
-    CALLOC(cbs[i], 1, sizeof(struct iocb));
-  }
-
   if (verbose >= 1) {
     for (size_t i = 0; i < 1; i++) {
       fprintf(stderr,"*info* io_context[%zd] = %p\n", i, (void*)ioc);
@@ -106,85 +913,106 @@ size_t aioMultiplePositions( positionContainer *p,
       maxSize = positions[i].len;
     }
   }
+  if (lazy && (p->maxbs > maxSize)) {
+    maxSize = p->maxbs; // the window doesn't have every length yet
+  }
   assert(maxSize > 0);
   assert(maxSize <= 1L*1024*1024*1024); // shouldn't be more than 1GB!?
 
   /* setup I/O control block, randomised just for this run. So we can check verification afterwards */
-  char **data = NULL;
-  CALLOC(data, QD, sizeof(char*));
-
-  unsigned short *dataseed = NULL;
-  CALLOC(dataseed, QD, sizeof(unsigned short));
-
-  // setup the buffers to be contiguous
-  if (maxSize * QD >= totalRAM()) {
-    fprintf(stderr,"*info* can't allocate (block size %zd x QD %zd) bytes\n", maxSize, QD);
-    exit(-1);
-  }
-  //  if (verbose) fprintf(stderr,"*info* allocating %zd bytes\n", randomBufferSize * QD);
-  CALLOC(data[0], maxSize * QD, 1);
-
-  char **readdata = NULL;
-  CALLOC(readdata, QD, sizeof(char*));
-
-  // setup the buffers to be contiguous
-  //  if (verbose) fprintf(stderr,"*info* allocating %zd bytes\n", randomBufferSize * QD);
-  CALLOC(readdata[0], maxSize * QD, 1);
-
-  unsigned short *freeQueue; // qd collisions
-  size_t headOfQueue = 0, tailOfQueue = 0;
-  CALLOC(freeQueue, QD, sizeof(size_t));
-  for (size_t i = 0; i < QD; i++) {
-    freeQueue[i] = i;
-  }
-
-  // grab [headOfQueue], put back onto [tailOfQueue]
-
-  // there are 256 queue slots
-  // O(1) next queue slot
-  // take a slot, free a slot
-  // free list
-  // qd[..255] in flight
-
-  // setup pointers
-  for (size_t i = 0; i <QD; i++) {
-    data[i] = data[0] + (maxSize * i);
-    readdata[i] = readdata[0] + (maxSize * i);
+  ioQueueType q;
+  queueSetup(&q, p, QD, alignment, maxSize, fd, flushEvery, fp, jobdevice, arena, ioerrors, verbose);
+  q.finishBytes = finishBytes;
+
+  // the slabs are contiguous, so register them as two fixed buffers
+  if (engine != ENGINE_LIBAIO) {
+    if (uringRegisterBuffers(&ring, q.data[0], q.readdata[0], maxSize * QD)) {
+      fprintf(stderr,"*warning* io_uring couldn't register %zd bytes of buffers (check ulimit -l), using unregistered buffers\n", 2 * maxSize * QD);
+    }
   }
 
-  // copy the randomBuffer to each data[]
   // sz is already > 0
   assert(sz);
   unsigned short firstseed = positions[0].seed;
 
-  // set the first values of all the write data
+  // set the first values of all the read data, write data is fetched from the cache on first use
   for (size_t i = 0; i < QD; i++) {
-    generateRandomBuffer(data[i], maxSize, firstseed);
-    generateRandomBuffer(readdata[i], maxSize, firstseed);
-    dataseed[i] = firstseed;
+    generateRandomBuffer(q.readdata[i], maxSize, firstseed);
+    q.dataseed[i] = firstseed;
   }
 
-  size_t inFlight = 0, pos = 0;
-
-  const double start = timedouble();
-  double last = start, roundstart = start;
-  //  double lastreceive = start;
-
-  size_t submitted = 0, flushPos = 0, received = 0, slow = 0;
-  size_t totalWriteBytes = 0, totalReadBytes = 0;
-  size_t totalWriteSubmit = 0, totalReadSubmit = 0;
+  // trims go to their own worker threads, only if the device can discard
+  discardWorkerType dw;
+  int trimming = 0;
+  if (discard_max_bytes >= alignment) {
+    for (size_t i = 0; i < sz; i++) {
+      if (positions[i].action == 'T') {
+	trimming = 1;
+	break;
+      }
+    }
+  }
+  if (trimming) {
+    q.trimQD = MAX(trimQD, 1);
+    discardWorkerStart(&dw, fd, q.trimQD, QD, maxSize, alignment);
+    CALLOC(q.trimDone, QD, sizeof(positionType*));
+    q.dw = &dw;
+  }
 
-  size_t lastBytes = 0, lastIOCount = 0;
+  size_t pos = 0;
+  double due = q.start + positionDelay(&positions[0]); // when positions[pos] can go
 
   struct timespec timeout;
   timeout.tv_sec = 0;
   timeout.tv_nsec = 10000*1000; // 1ms seconds
 
-  double flush_totaltime = 0, flush_mintime = 9e99, flush_maxtime = 0;
-  size_t flush_count = 0;
   double thistime = 0;
-  int qdIndex = 0;
-  int printed = 0;
+  int lazyHalf = -1; // the half of a lazy window the cursor is in
+
+  // split mode: a second thread reaps, on the SMT sibling of this one if there is one
+  reaperType *reaper = NULL;
+  cpu_set_t origMask;
+  if (splitReap && (trimming || QDbarrier || lazy)) {
+    fprintf(stderr,"*warning* a separate reaper thread can't be used with trims, a QD barrier or lazy positions, using one thread\n");
+    splitReap = 0;
+  }
+  if (splitReap) {
+    CALLOC(reaper, 1, sizeof(reaperType));
+    reaper->engine = engine;
+    reaper->ioc = ioc;
+    reaper->ring = &ring;
+    reaper->pollRing = pollRing;
+    reaper->QD = QD;
+    CALLOC(reaper->events, QD, sizeof(struct io_event));
+    CALLOC(reaper->done, QD, sizeof(reapedType));
+    pthread_mutex_init(&reaper->lock, NULL);
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reaper->moved, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &origMask);
+    const int cpu = sched_getcpu();
+    const int sibling = (cpu >= 0) ? getSiblingCPU(cpu) : -1;
+    if ((sibling >= 0) && CPU_ISSET(sibling, &origMask)) {
+      cpu_set_t mask;
+      CPU_ZERO(&mask);
+      CPU_SET(cpu, &mask);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+      CPU_ZERO(&mask);
+      CPU_SET(sibling, &mask);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &mask);
+    }
+    if (verbose >= 1) {
+      fprintf(stderr,"*info* submitting on CPU %d, reaping on CPU %d\n", cpu, sibling);
+    }
+    pthread_create(&reaper->thread, &attr, reaperThread, reaper);
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(reaper->thread, "spit-reap");
+  }
 
 
   for (size_t i = 0; i < sz; i++) {
@@ -192,193 +1020,58 @@ size_t aioMultiplePositions( positionContainer *p,
     positions[i].success = 0;
   }
 
-  size_t timesinceMB = 0;
-
   if (verbose >= 2)fprintf(stderr,"*info* starting...%zd, finishTime %lf\n", sz, finishTime);
 
   size_t thiskeeprunning = 1;
-	
+
   while (keepRunning && thiskeeprunning) {
-    thistime = timedouble();
+    thistime = timeStamp();
     if (checkTime && (thistime > finishTime)) {
       thiskeeprunning = 0;
       goto endoffunction;
       //      break;
     }
     assert (pos < sz);
-    if (0) fprintf(stderr,"pos %zd, inflight %zd (%zd %zd)\n", positions[pos].pos, inFlight, tailOfQueue, headOfQueue);
-    if (inFlight > QD) {
-      fprintf(stderr,"*error* inFlight %zd %zd\n", inFlight, QD);
-    }
-    size_t cursubmitted = submitted;
-    //    fprintf(stderr,"pos %zd, %lf    %lf\n", pos, thistime, start + positions[pos].usoffset/1000000.0);
-
-    
-    
-    if (thistime >= roundstart + positions[pos].usoffset) {
-      while (sz && inFlight < MIN(cursubmitted * 2 + 1, QD) && keepRunning) {
-	if (!positions[pos].inFlight) {
-
-	  // submit requests, one at a time
-	  assert(pos < sz);
-	  if (positions[pos].action != 'S') { // if we have some positions, sz > 0
-	    const size_t newpos = positions[pos].pos;
-	    const size_t len = positions[pos].len;
-
-	    if (positions[pos].action == 'T') {
-	      if (discard_max_bytes >= alignment) {
-		if (verbose >= 2) fprintf(stderr,"*info* trim at %zd len = %zd\n", newpos, len);
-		positions[pos].submitTime = timedouble();
-		performDiscard(fd, NULL, newpos, newpos+len, maxSize, alignment, NULL, 0, 0);
-		p->writtenIOs++;
-		positions[pos].finishTime = timedouble();
-	      }
-
-	      goto nextpos;
-	    }
-
-	    assert(headOfQueue < QD);
-	    qdIndex = freeQueue[headOfQueue];
-	    assert(qdIndex >= 0);
-
-	    assert(positions[pos].inFlight == 0);
-
-	    // setup the request
-	    if (fd >= 0) {
-	      positions[pos].q = qdIndex;
-	      positions[pos].inFlight = 1;
-
-	      // watermark the block with the position on the device
-
-	      if (positions[pos].action=='D') {
-		abort();
-		thistime = timedouble();
-
-		//if (verbose >= 2) {
-		//	      fprintf(stderr,"delay %u\n", positions[pos].msdelay * 1000);
-		//	      }
-
-		goto nextpos;
-	      } else if (positions[pos].action=='R') {
-		if (verbose >= 2) {
-		  fprintf(stderr,"[%zd] read qdIndex=%d\n", newpos, qdIndex);
-		}
-
-		/*
-		  if (positions[pos].seed != dataseed[qdIndex]) {
-		  generateRandomBuffer(readdata[qdIndex], positions[pos].len, positions[pos].seed);
-		  dataseed[qdIndex] = positions[pos].seed;
-		  }*/
-
-		io_prep_pread(cbs[qdIndex], fd, readdata[qdIndex], len, newpos);
-		cbs[qdIndex]->data = &positions[pos];
-
-		if (finishBytes && (totalWriteSubmit + totalReadSubmit + len > finishBytes)) {
-		  goto endoffunction;
-		}
-		totalReadSubmit += len;
-
-
-	      } else if (positions[pos].action=='F') {
-		if (verbose >= 2) {
-		  fprintf(stderr,"[%zd] flush qdIndex=%d\n", newpos, qdIndex);
-		}
-
-		io_prep_fsync(cbs[qdIndex], fd);
-		cbs[qdIndex]->data = &positions[pos];
-	      } else if (positions[pos].action == 'W') {
-		if (verbose >= 2) {
-		  fprintf(stderr,"[%zd] write qdIndex=%d\n", newpos, qdIndex);
-		}
-
-		if (positions[pos].seed != dataseed[qdIndex]) {
-		  generateRandomBuffer(data[qdIndex], positions[pos].len, positions[pos].seed);
-		  dataseed[qdIndex] = positions[pos].seed;
-		}
-
-		size_t *posdest = (size_t*)data[qdIndex];
-		*posdest = newpos;
-
-		size_t *uuiddest = (size_t*)data[qdIndex] + 1;
-		*uuiddest = p->UUID;
-
-		if (positions[pos].verify) {
-		  if (positions[positions[pos].verify].finishTime == 0) {
-		    positions[pos].verify = 0;
-		  }
-		}
-
-		io_prep_pwrite(cbs[qdIndex], fd, data[qdIndex], len, newpos);
-		cbs[qdIndex]->data = &positions[pos];
-
-		if (finishBytes && (totalWriteSubmit + totalReadSubmit + len > finishBytes)) {
-		  goto endoffunction;
-		}
-		totalWriteSubmit += len;
-
-		flushPos++;
-	      } else if (positions[pos].action == 'P')  {
-		if (inFlight > 0) {
-		  pos--;  // if in flight repeat
-		  goto nextpos;
-		} else {
-		  // else skip this one
-		  goto nextpos;
-		}
-	      } else {
-		fprintf(stderr,"unknown action %c\n", positions[pos].action);
-		abort();
-	      }
-
-	      positions[pos].submitTime = timedouble();
-	      positions[pos].finishTime = 0;
-
-
-	      // for the speed limiting
-	      timesinceMB += len;
-
-	      ret = io_submit(ioc, 1, &cbs[qdIndex]);
-
-	      if (ret > 0) {
-		// if success
-		freeQueue[headOfQueue] = -1; // take off queue
-		//	      freeQueue[headOfQueue] = -1;
-		headOfQueue++;
-		if (headOfQueue == QD) headOfQueue = 0;
-
-		inFlight++;
-		//	      lastsubmit = thistime; // last good submit
-		submitted++;
-		if (verbose >= 2 || (newpos & (alignment - 1))) {
-		  fprintf(stderr,"fd %d, pos %zd (%% %zd = %zd ... %s), size %zd, inFlight %zd, QD %zd, submitted %zd, received %zd\n", fd, newpos, alignment, newpos % alignment, (newpos % alignment) ? "NO!!" : "aligned", len, inFlight, QD, submitted, received);
-		}
-
-	      } else {
-		*ioerrors = (*ioerrors) + 1;
-		fprintf(stderr,"io_submit() failed, ret = %d\n", ret);
-		perror("io_submit()");
-		if(!dontExitOnErrors) abort();
-	      }
-	    }
-	  }
-	} else {
-	  if (verbose >= 1) {
-	    fprintf(stderr,"*info* position collision %zd\n",pos);
-	  }
-	}
+    if (0) fprintf(stderr,"pos %zd, inflight %zd (%zd %zd)\n", positions[pos].pos, q.inFlight, q.tailOfQueue, q.headOfQueue);
+    if (q.inFlight > QD) {
+      fprintf(stderr,"*error* inFlight %zd %zd\n", q.inFlight, QD);
+    }
+    size_t cursubmitted = q.submitted;
+    //    fprintf(stderr,"pos %zd, %lf    %lf\n", pos, thistime, due);
 
 
 
-      nextpos:
+    if (thistime >= due) {
+      while (sz && q.inFlight < MIN(cursubmitted * 2 + 1, QD) && keepRunning) {
+	if (flushEvery && (q.flushPos >= (size_t)flushEvery)) {
+	  // a flush is due. With a barrier it waits for the earlier I/O to finish first
+	  if (flushBarrier && (q.inFlight > 0)) break;
+	  queueFlush(&q);
+	  continue;
+	}
+	if (flushBarrier && q.flushesInFlight) {
+	  break; // and nothing passes the flush until it's back
+	}
+	if (thistime < due) {
+	  break; // timed positions (a trace replay or a rate limit) wait until they're due
+	}
+
+	// lazy positions, each half of the window is generated as the cursor gets to it
+	if (lazy && ((pos >= sz / 2) != lazyHalf)) {
+	  if (!lazyPositionsEnter(lazy, positions, pos)) break; // the last lap still has I/O in flight there
+	  lazyHalf = (pos >= sz / 2);
+	}
 
-	// onto the next one
-	pos += posIncrement;
-	if (pos >= sz) {
-	  pos = 0;
-	  roundstart = timedouble(); // start of the round
-	  // 
+	const int queued = queuePosition(&q, &positions[pos]);
+	if (queued == QUEUE_WAIT) {
+	  break;
+	} else if (queued == QUEUE_STOP) {
+	  goto endoffunction;
 	}
-	if (posLimit && (submitted >= posLimit)) {
+
+	// onto the next one
+	pos = queueNext(&q, sz, pos, posIncrement, &due);
+	if (posLimit && (q.submitted >= posLimit)) {
 	  // if Px is passed in
 	  //fprintf(stderr,"end of function one shot\n");
 	  goto endoffunction; // only go through once
@@ -388,256 +1081,158 @@ size_t aioMultiplePositions( positionContainer *p,
       // if the IO hasn't started yet, sleep a bit
       if (pos > 0) {
 	// convert to seconds, then 1/2 of it
-	//	usleep((positions[pos].usoffset - positions[pos-1].usoffset)*1000000 / 10);
+	//	usleep(positionDelay(&positions[pos])*1000000 / 10);
       }
     }
 
-    double timeelapsed = timedouble() - last;
-    if (timeelapsed >= DISPLAYEVERY) {
-      const double speed = TOMB(1.0*(totalReadBytes + totalWriteBytes - lastBytes) / timeelapsed);
-      const double IOspeed = 1.0*(received - lastIOCount) / timeelapsed;
-      //if (benchl) logSpeedAdd2(benchl, TOMB(totalReadBytes + totalWriteBytes - lastBytes), (received - lastIOCount));
-      if (!tableMode) {
-        if (verbose != -1) {
-          //	      fprintf(stderr,"[%.1lf] %.1lf GiB, qd: %zd, op: %zd, [%zd], %.0lf IO/s, %.1lf MB/s\n", gt - start, TOGiB(totalReadBytes + totalWriteBytes), inFlight, received, pos, submitted / (gt - start), speed);
-          fprintf(stderr,"[%.1lf] %.1lf GB, qd: %zd, op: %zd, [%zd], %.0lf IO/s, %.1lf MB/s\n", thistime - start, TOGB(totalReadBytes + totalWriteBytes), inFlight, received, pos, IOspeed, speed);
-        }
-        if (verbose >= 2) {
-          if (flush_count) fprintf(stderr,"*info* avg flush time %.4lf (min %.4lf, max %.4lf)\n", flush_totaltime / flush_count, flush_mintime, flush_maxtime);
-        }
-      }
-      lastBytes = totalReadBytes + totalWriteBytes;
-      lastIOCount = received;
-      last = thistime;
+    // the new ones, after any a full queue left over from last time
+    if (q.batchCount) {
+      submitBatch(&q, engine, ioc, &ring, dontExitOnErrors);
     }
 
-    if (flushEvery) {
-      //      if (flushPos >= flushEvery) {
-      flushPos = flushPos - flushEvery;
-      if (verbose >= 2) {
-        fprintf(stderr,"[%zd] SYNC: calling fsync()\n", pos);
+    queueProgress(&q, timeStamp(), pos, tableMode);
+
+    if (reaper) {
+      // the reaper has waited for the completions, process them here. If nothing moved, sleep until
+      // the reaper has some or the next position is due
+      if (!drainReaped(reaper, &q) && (q.submitted == cursubmitted)) {
+	double maxWait = timeout.tv_nsec / 1e9;
+	if (due > thistime) {
+	  const double untilDue = due - timeStamp();
+	  if (untilDue < maxWait) maxWait = untilDue;
+	}
+	if (maxWait > 0) {
+	  waitReaped(reaper, maxWait);
+	}
       }
-      fsync(fd);
-      flush_count++;
-      //      }
+      continue;
     }
 
+    // trims complete on the discard workers, only wait on them if nothing else is in flight
+    if (q.trimsInFlight) {
+      reapTrims(&q, (q.inFlight == q.trimsInFlight) ? 0.01 : 0);
+    }
+    const size_t ioInFlight = q.inFlight - q.trimsInFlight - q.batchCount;
+
+    // if the next position isn't due, wait for completions until it is, or sleep, rather than spin
+    struct timespec wait = timeout;
+    if (due > thistime) {
+      const double untilDue = due - timeStamp();
+      if ((untilDue > 0) && (untilDue < timeout.tv_nsec / 1e9)) {
+	wait.tv_nsec = untilDue * 1e9;
+      }
+      if ((untilDue > 0) && (q.inFlight == 0)) {
+	nanosleep(&wait, NULL);
+      }
+    }
 
     // return, 1..inFlight wait for a bit
     if (QDbarrier) {
-      if (inFlight >= QD) {
-        ret = io_getevents(ioc, QD, inFlight, events, &timeout);
+      if (q.inFlight >= QD && ioInFlight) {
+        ret = engineGetEvents(engine, ioc, &ring, ioInFlight, ioInFlight, q.events, &wait, pollRing, &q.engineCalls);
       } else {
         ret = 0;
       }
+    } else if (ioInFlight) {
+      ret = engineGetEvents(engine, ioc, &ring, 1, ioInFlight, q.events, &wait, pollRing, &q.engineCalls);
     } else {
-      ret = io_getevents(ioc, 1, inFlight, events, &timeout);
+      ret = 0;
     }
 
-    //    }
     if (ret > 0) {
-      double lastreceive = timedouble();
-
-      // verify it's all ok
-      size_t rio = 0, rlen = 0, wio = 0, wlen = 0;
-      for (int j = 0; j < ret; j++) {
-        //	struct iocb *my_iocb = events[j].obj;
-        //if (alll) logSpeedAdd2(alll, TOMB(events[j].res), 1);
-        struct iocb *my_iocb = events[j].obj;
-        positionType *pp = (positionType*) my_iocb->data;
-        assert(pp->inFlight);
-
-
-        int rescode = events[j].res;
-        int rescode2 = events[j].res2;
-
-        if ((rescode < 0) || (rescode2 != 0)) { // if return of bytes written or read / IO error
-          *ioerrors = (*ioerrors) + 1;
-          if (printed++ < 10) {
-            fprintf(stderr,"*error* AIO failure codes[fd=%d]: res=%d and res2=%d, [%zd] = %zd, len %d, inFlight %zd, returned %d results\n", fd, rescode, rescode2, pos, positions[pos].pos, positions[pos].len, inFlight, ret);
-            //	    fprintf(stderr,"*error* last successful submission was %.3lf seconds ago\n", timedouble() - lastsubmit);
-            //	    fprintf(stderr,"*error* last successful receive was %.3lf seconds ago\n", timedouble() - lastreceive);
-          } else {
-
-            //	    fprintf(stderr,"*error* further output supressed\n");
-          }
-          if (*ioerrors > 1000000) {
-            fprintf(stderr,"*info* over %zd IO errors. Exiting...\n", *ioerrors);
-            exit(-1);
-          }
-          //	  fprintf(stderr,"%ld %s %s\n", events[j].res, strerror(events[j].res2), (char*) my_iocb->u.c.buf);
-        } else { // good IO
-          //	  fprintf(stderr,"---> %d %d\n", rescode, rescode2);
-          //successful result
-
-          //	  if (pp->success) {
-          //	    fprintf(stderr,"*warning* AIO duplicate result at position %zd\n", pp->pos);
-          //	  }
-
-          //fprintf(stderr,"'%c' %d %u\n", pp->action, pp->q, pp->len);
-          if (pp->action == 'R') {
-            rio++;
-            rlen += pp->len;
-          } else if (pp->action == 'W') {
-            wio++;
-            wlen += pp->len;
-          }
-
-
-          if (pp->verify && (pp->action == 'R')) {
-            //	    if (pp->seed != dataseed[pp->q]) {
-            //	    //n	      generateRandomBuffer(readdata[pp->q], pp->len, pp->seed);
-            //	      dataseed[pp->q] = pp->seed;
-            //	    }
-
-            // if we know we have written we can check, or if we have read a previous write
-            size_t *uucheck = NULL, *poscheck = NULL;
-            poscheck = (size_t*)readdata[pp->q];
-            uucheck = (size_t*)readdata[pp->q] + 1;
-
-            if (((p->UUID != *uucheck) || (pp->pos != *poscheck)) && (positions[pp->verify].finishTime)) {
-              fprintf(stderr,"*error* position[%zd] '%c' R=%d (success %d) ver=%d wrong. UUID %zd/%zd, pos %zd/%zd\n", pos, pp->action, pp->seed, pp->success, pp->verify, p->UUID, *uucheck, pp->pos, *poscheck);
-              fprintf(stderr,"*error* Maybe: combinations of meta-data 'm', multiple threads 'j' and without G_ may fail\n");
-              fprintf(stderr,"*error* as the different threads will clobber data from other threads in real time\n");
-              fprintf(stderr,"*error* Potentially write to -P positions.txt and check after data is written\n");
-              abort();
-            }
-          }
-          pp->finishTime = lastreceive;
-        } // good IO
-        pp->success = 1; // the action has completed
-        pp->inFlight = 0;
-	if (fp == stdout) {
-	  positionDumpOne(fp, pp, p->maxbdSize, 0, jobdevice);
-	}
-        // log if slow
-        if (pp->finishTime - pp->submitTime > 30) {
-          slow++;
-          char s[300];
-          sprintf(s, "slow I/O (%c,pos=%zd,size=%d) %.1lf s, submission loop, %zd slow from %zd submitted (%.1lf%%)\n", pp->action, pp->pos, pp->len, pp->finishTime - pp->submitTime, slow, submitted, slow * 100.0 / (slow + submitted));
-          syslogString("spit", s);
-          fprintf(stderr,"*warning* %s", s);
-        }
-
-        freeQueue[tailOfQueue++] = pp->q;
-        if (tailOfQueue == QD) tailOfQueue = 0;
-      } // for j
-
-      p->readIOs += rio;
-      p->readBytes += rlen;
-      totalReadBytes += rlen;
-
-      p->writtenIOs += wio;
-      p->writtenBytes += wlen;
-      totalWriteBytes += wlen;
-
-      inFlight -= ret;
-      received += ret;
+      queueReap(&q, ret);
     }
-
-
-    //    if (ret < 0) {
-    //      fprintf(stderr,"eek\n");
-    //    }
   } // while keepRunning
 
 endoffunction:
-  // receive outstanding I/Os
+  // submit anything batched up before we left the loop, what doesn't fit is retried below
+  if (q.batchCount) {
+    submitBatch(&q, engine, ioc, &ring, dontExitOnErrors);
+  }
 
-  {}
+  // receive outstanding I/Os
   size_t count = 0;
-  double snaptime = timedouble();
+  double snaptime = timeStamp();
   double lastprint = snaptime;
-  while (inFlight) {
+
+  if (reaper) {
+    // let the reaper finish what's in flight, then anything left is picked up below
+    while (q.inFlight && (timeStamp() - snaptime < 36)) {
+      if (q.batchCount) {
+	submitBatch(&q, engine, ioc, &ring, dontExitOnErrors);
+      }
+      if (!drainReaped(reaper, &q)) {
+	waitReaped(reaper, timeout.tv_nsec / 1e9);
+      }
+    }
+    __atomic_store_n(&reaper->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(reaper->thread, NULL);
+    drainReaped(reaper, &q);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &origMask);
+
+    q.syscalls += (engine == ENGINE_LIBAIO) ? reaper->engineCalls : 0; // the ring counts its own
+    p->reaperCPU += reaper->cpu;
+    pthread_mutex_destroy(&reaper->lock);
+    pthread_cond_destroy(&reaper->moved);
+    free(reaper->events);
+    free(reaper->done);
+    free(reaper);
+    reaper = NULL;
+  }
+  while (q.inFlight) {
     count++;
     if (count > 3600) break;
 
-    if (inFlight) {
-      int ret = io_getevents(ioc, 0, inFlight, events, NULL);
+    if (q.batchCount) {
+      submitBatch(&q, engine, ioc, &ring, dontExitOnErrors);
+    }
+    if (q.trimsInFlight) {
+      reapTrims(&q, 0);
+    }
+    if (q.inFlight) {
+      int ret = 0;
+      if (q.inFlight > q.trimsInFlight + q.batchCount) {
+        ret = engineGetEvents(engine, ioc, &ring, 0, q.inFlight - q.trimsInFlight - q.batchCount, q.events, NULL, pollRing, &q.engineCalls);
+      }
       if (ret > 0) {
-        for (int j = 0; j < ret; j++) {
-          // TODO refactor into the same code as above
-          struct iocb *my_iocb = events[j].obj;
-          positionType *pp = (positionType*) my_iocb->data;
-
-          int rescode = events[j].res;
-          int rescode2 = events[j].res2;
-
-          if ((rescode < 0) || (rescode2 != 0)) { // if return of bytes written or read
-            *ioerrors = (*ioerrors) + 1;
-    
-            fprintf(stderr,"*error* AIO failure codes[fd=%d]: res=%d and res2=%d, %zd, inFlight %zd, returned %d results\n", fd, rescode, rescode2, pp->pos, inFlight, ret);
-
-          } else {        
-            pp->finishTime = timedouble();
-          }
-          freeQueue[tailOfQueue++] = pp->q;
-          if (tailOfQueue == QD) tailOfQueue = 0;
-
-          // log if slow
-          if (pp->finishTime - pp->submitTime > 30) {
-            slow++;
-            char s[300];
-            sprintf(s, "slow I/O (%c,pos=%zd, size=%d) %.1lf s, no submission/post loop, %zd slow from %zd submitted (%.1lf%%)\n", pp->action, pp->pos, pp->len, pp->finishTime - pp->submitTime, slow, submitted, slow * 100.0 / (slow + submitted));
-            syslogString("spit", s);
-            fprintf(stderr,"*warning* %s", s);
-          }
-
-
-          pp->inFlight = 0;
-          pp->success = 1; // the action has completed
-	  if (fp == stdout) {
-	    positionDumpOne(fp, pp, p->maxbdSize, 0, jobdevice);
-	  }
-
-          if (pp->action == 'R') {
-            p->readIOs++;
-            p->readBytes += pp->len;
-            totalReadBytes += pp->len;
-          } else if (pp->action == 'W') {
-            p->writtenIOs++;
-            p->writtenBytes += pp->len;
-            totalWriteBytes += pp->len;
-          }
-        }
-        inFlight -= ret;
+	queueReap(&q, ret);
       } else {
-        if (count > 5 && (timedouble() - lastprint >=3)) {
-          fprintf(stderr,"*warning* waiting for %zd IOs in flight, iteration %zd, %zd seconds...\n", inFlight, count, (size_t)(timedouble() - snaptime));
-          lastprint = timedouble();
+        if (count > 5 && (timeStamp() - lastprint >=3)) {
+          fprintf(stderr,"*warning* waiting for %zd IOs in flight, iteration %zd, %zd seconds...\n", q.inFlight, count, (size_t)(timeStamp() - snaptime));
+          lastprint = timeStamp();
         }
         usleep(10000);
       }
     }
   }
-  if (inFlight) {
-    fprintf(stderr,"*warning* timed out after %.0lf seconds. Flight requests still = %zd\n", timedouble() - snaptime, inFlight);
+  if (q.inFlight) {
+    fprintf(stderr,"*warning* timed out after %.0lf seconds. Flight requests still = %zd\n", timeStamp() - snaptime, q.inFlight);
   }
 
-  free(events);
-  for (size_t i = 0; i < QD; i++) {
-    free(cbs[i]);
+  queueFree(&q);
+  if (trimming) {
+    discardWorkerStop(&dw);
   }
-  free(cbs);
-
-  free(data[0]);
-  free(data);
-  free(dataseed);
-  free(readdata[0]);
-  free(readdata);
-  free(freeQueue);
-  if (inFlight) {
+  if (q.inFlight) {
     fprintf(stderr,"*warning* about to io_destroy()... should be instant before a 'succeeded' message.\n");
   }
-  io_destroy(ioc);
-  if (inFlight) {
+  if (engine == ENGINE_LIBAIO) {
+    q.syscalls += q.engineCalls;
+    io_destroy(ioc);
+  } else {
+    // with the ring only io_uring_enter() calls are real syscalls, SQPOLL and a full CQ avoid them
+    q.syscalls += ring.enterCalls;
+    uringFree(&ring);
+  }
+  p->syscalls += q.syscalls;
+  if (q.inFlight) {
     fprintf(stderr,"*info* io_destroy() succeeded\n");
   }
 
-  *ios = received;
+  *ios = q.received;
 
-  *totalWB = totalWriteSubmit;
-  *totalRB = totalReadSubmit;
+  *totalWB = q.totalWriteSubmit;
+  *totalRB = q.totalReadSubmit;
 
   for (size_t i = 0; i < pos; i += posIncrement) {
     if (positions[i].action == 'R' || positions[i].action == 'W') {
@@ -648,3 +1243,165 @@ endoffunction:
   return (*totalWB) + (*totalRB);
 }
 
+
+
+/*
+ * One device's round driven from a shared event loop thread, see eventLoop.c. Each device has
+ * its own io_context, and its completions signal an eventfd (IOCB_FLAG_RESFD) that the loop
+ * waits on with epoll. The loop calls aioDeviceSubmit() and aioDeviceReap(), which step the
+ * same queue as aioMultiplePositions(). The job's own thread opens and closes the device so
+ * the memory stays on its NUMA node.
+ */
+struct aioDeviceType {
+  ioQueueType q;
+  size_t sz, posLimit, posIncrement;
+  double finishTime;
+  int checkTime;
+  int tableMode;
+  io_context_t ioc;
+  size_t ioerrors;
+
+  size_t pos;
+  double due;
+  int stopping;
+};
+
+
+aioDeviceType *aioDeviceOpen(positionContainer *p, const size_t sz, const double finishTime, const size_t finishBytes, size_t QD,
+			     const int verbose, const int tableMode, size_t alignment, const size_t posLimit, const int fd,
+			     const int flushEvery, FILE *fp, char *jobdevice, size_t posIncrement, arenaType *arena)
+{
+  if (sz == 0) {
+    fprintf(stderr,"*warning* sz == 0!\n");
+    return NULL;
+  }
+  aioDeviceType *d;
+  CALLOC(d, 1, sizeof(aioDeviceType));
+  if (QD > sz) QD = sz;
+  if (!alignment) alignment = 512;
+  if (posIncrement < 1) posIncrement = 1;
+
+  d->sz = sz;
+  d->posLimit = posLimit;
+  d->posIncrement = posIncrement;
+  d->finishTime = finishTime;
+  d->checkTime = (finishTime > 0) && (finishTime >= timeStamp());
+  d->tableMode = tableMode;
+
+  if (io_setup(QD, &d->ioc)) {
+    fprintf(stderr,"*error* io_setup failed with %zd\n", QD);
+    exit(-2);
+  }
+
+  size_t maxSize = 0;
+  for (size_t i = 0; i < sz; i++) {
+    if (p->positions[i].len > maxSize) {
+      maxSize = p->positions[i].len;
+    }
+    p->positions[i].inFlight = 0;
+    p->positions[i].success = 0;
+  }
+
+  queueSetup(&d->q, p, QD, alignment, maxSize, fd, flushEvery, fp, jobdevice, arena, &d->ioerrors, verbose);
+  d->q.finishBytes = finishBytes;
+  d->q.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (d->q.efd < 0) {
+    perror("eventfd");
+    exit(-2);
+  }
+
+  d->due = d->q.start + positionDelay(&p->positions[0]);
+  return d;
+}
+
+
+int aioDeviceEventFd(const aioDeviceType *d)
+{
+  return d->q.efd;
+}
+
+
+// fill the device's queue as far as its positions, timing and limits allow
+void aioDeviceSubmit(aioDeviceType *d)
+{
+  ioQueueType *q = &d->q;
+  positionType *positions = q->positions;
+  const double thistime = timeStamp();
+  if ((d->checkTime && (thistime > d->finishTime)) || !keepRunning) {
+    d->stopping = 1;
+  }
+
+  while (!d->stopping && (q->inFlight < q->QD)) {
+    if (thistime < d->due) break;
+
+    if (q->flushEvery && (q->flushPos >= (size_t)q->flushEvery)) {
+      queueFlush(q);
+      continue;
+    }
+
+    const int queued = queuePosition(q, &positions[d->pos]);
+    if (queued == QUEUE_WAIT) {
+      break;
+    } else if (queued == QUEUE_STOP) {
+      d->stopping = 1;
+      break;
+    }
+
+    d->pos = queueNext(&d->q, d->sz, d->pos, d->posIncrement, &d->due);
+    if (d->posLimit && (q->submitted >= d->posLimit)) {
+      d->stopping = 1;
+    }
+  }
+
+  if (q->batchCount) {
+    submitBatch(q, ENGINE_LIBAIO, d->ioc, NULL, 1);
+  }
+  queueProgress(q, timeStamp(), d->pos, d->tableMode);
+}
+
+
+// the eventfd was readable, take everything that has completed
+void aioDeviceReap(aioDeviceType *d)
+{
+  ioQueueType *q = &d->q;
+  uint64_t n = 0;
+  if (read(q->efd, &n, sizeof(n)) == sizeof(n)) {
+    q->engineCalls++;
+  }
+
+  struct timespec zero = {0, 0};
+  int ret;
+  do {
+    ret = io_getevents(d->ioc, 0, q->QD, q->events, &zero);
+    q->engineCalls++;
+    if (ret <= 0) break;
+    queueReap(q, ret);
+  } while ((size_t)ret == q->QD);
+}
+
+
+int aioDeviceFinished(const aioDeviceType *d)
+{
+  return d->stopping && (d->q.inFlight == 0);
+}
+
+
+// tear down on the job's thread, with the same results as aioMultiplePositions()
+size_t aioDeviceClose(aioDeviceType *d, size_t *ios, size_t *totalRB, size_t *totalWB, size_t *ioerrors)
+{
+  ioQueueType *q = &d->q;
+  if (q->inFlight) {
+    fprintf(stderr,"*warning* closing a device with %zd I/Os in flight\n", q->inFlight);
+  }
+  io_destroy(d->ioc);
+  close(q->efd);
+  queueFree(q);
+
+  q->p->syscalls += q->engineCalls;
+  *ioerrors += d->ioerrors;
+  *ios = q->received;
+  *totalWB = q->totalWriteSubmit;
+  *totalRB = q->totalReadSubmit;
+  free(d);
+  return (*totalWB) + (*totalRB);
+}
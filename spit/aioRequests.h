@@ -5,6 +5,8 @@
 
 #include "logSpeed.h"
 #include "positions.h"
+#include "bufferArena.h"
+#include "lazyPositions.h"
 
 size_t aioMultiplePositions( positionContainer *p,
                              const size_t sz,
@@ -26,9 +28,31 @@ size_t aioMultiplePositions( positionContainer *p,
                              const size_t discard_max_bytes,
 			     FILE *fp,
 			     char *jobdevice,
-			     size_t posIncrement
+			     size_t posIncrement,
+			     const int engine,
+			     const int iopoll,
+			     int pollRing,
+			     const int flushBarrier,
+			     const size_t trimQD,
+			     int splitReap,
+			     arenaType *arena,
+			     lazyPositionsType *lazy
                            );
 
+int aioRingUsable(io_context_t ioc);
+
+// one device's round, stepped by a shared event loop thread
+typedef struct aioDeviceType aioDeviceType;
+
+aioDeviceType *aioDeviceOpen(positionContainer *p, const size_t sz, const double finishTime, const size_t finishBytes, size_t QD,
+			     const int verbose, const int tableMode, size_t alignment, const size_t posLimit, const int fd,
+			     const int flushEvery, FILE *fp, char *jobdevice, size_t posIncrement, arenaType *arena);
+int aioDeviceEventFd(const aioDeviceType *d);
+void aioDeviceSubmit(aioDeviceType *d);
+void aioDeviceReap(aioDeviceType *d);
+int aioDeviceFinished(const aioDeviceType *d);
+size_t aioDeviceClose(aioDeviceType *d, size_t *ios, size_t *totalRB, size_t *totalWB, size_t *ioerrors);
+
 int aioVerifyWrites(positionType *positions,
                     const size_t maxpos,
                     const size_t maxBufferSize,
@@ -21,6 +21,9 @@
 #include "devices.h"
 #include "utils.h"
 #include "blockVerify.h"
+#include "bufferKernels.h"
+#include "sectorHeader.h"
+#include "positionSort.h"
 #include "jobType.h"
 
 extern int keepRunning;
@@ -48,26 +51,25 @@ typedef struct {
   double finishTime;
   int quiet;
   int overridesize;
+  const dataPatternType **patterns; // by deviceid, NULL for the cyclic buffer
+  const size_t *sectorSizes; // by deviceid, 0 without sector headers
 } threadInfoType;
 
-// sorting function, used by qsort
-static int seedcompare(const void *p1, const void *p2)
+
+// a torn write has some of its sectors from another write or never written, the rest good
+static void reportSectors(const positionType *p, const size_t len, const size_t sectorSize, const sectorCheckType *r)
 {
-  const positionType *pos1 = (positionType*)p1;
-  const positionType *pos2 = (positionType*)p2;
-
-  if (pos1->deviceid < pos2->deviceid) return -1;
-  else if (pos1->deviceid > pos2->deviceid) return 1;
-  else {
-    if (pos1->submitTime < pos2->submitTime) return -1;
-    else if (pos1->submitTime > pos2->submitTime) return 1;
-    else return 0;
+  const size_t pos = p->pos;
+  fprintf(stderr,"\n*error* position %zd, %zd of %zd %zd byte sectors bad from sector %zd (offset %zd): %zd from another write, %zd bad CRC or not written, %zd misplaced, %zd wrong data\n", pos, r->bad, r->sectors, sectorSize, r->firstBad, pos + r->firstBad * sectorSize, r->torn, r->crc, r->misplaced, r->data);
+  if ((r->bad < r->sectors) && (r->torn || r->crc || r->misplaced)) {
+    fprintf(stderr,"*error* torn write at position %zd, len %zd: %zd sectors of write generation %u made it", pos, len, r->sectors - r->bad, r->generation);
+    if (r->torn) fprintf(stderr,", %zd are from generation %u", r->torn, r->otherGeneration);
+    fprintf(stderr,"\n");
   }
 }
 
 
-
-int verifyPosition(const int fd, const positionType *p, const char *randomBuffer, char *buf, size_t *diff, const int seed, int quiet, size_t overridesize)
+int verifyPosition(const int fd, const positionType *p, const char *randomBuffer, char *buf, size_t *diff, const int seed, int quiet, size_t overridesize, size_t sectorSize)
 {
   const size_t pos = p->pos;
   const size_t len = overridesize ? overridesize : p->len;
@@ -82,7 +84,21 @@ int verifyPosition(const int fd, const positionType *p, const char *randomBuffer
     return -1;
   }
 
-  int dataok = strncmp(buf+16, randomBuffer+16, len-16-2) == 0;
+  if (!sectorSize && (ret == (ssize_t)len)) {
+    sectorSize = sectorHeaderDetect(buf, len);
+  }
+  if (sectorSize && (ret == (ssize_t)len)) {
+    // each sector on its own, randomBuffer has the data between the headers
+    sectorCheckType r;
+    if (sectorHeaderCheck(buf, randomBuffer, len, sectorSize, pos, p->seed, &r) == 0) return 0;
+    if (*diff < 3) reportSectors(p, len, sectorSize, &r);
+    *diff = (*diff)+1;
+    return -3;
+  }
+
+  // past the position and UUID stamp. Binary data has NULs so it's not a string compare
+  const size_t firstdiff = (len > 16) ? 16 + bufferMismatch(buf + 16, randomBuffer + 16, len - 16) : len;
+  int dataok = (firstdiff == len);
 
   if (ret != (int)len) {
     fprintf(stderr,"\n*error* position %zd, wrong len %zd instead of %zd (data ok: %d)\n", pos, ret, len, dataok);
@@ -99,7 +115,7 @@ int verifyPosition(const int fd, const positionType *p, const char *randomBuffer
 
     if (*diff < 3) {
       size_t lines = 0, starterror = 0;
-      for (size_t i = 16; i < len; i++) {
+      for (size_t i = firstdiff; i < len; i++) {
         if (buf[i] != randomBuffer[i]) {
           if (lines < 10)
             fprintf(stderr,"\n*error* difference at block[%zd] offset %zd, disk '%c', should be '%c', seed %d\n", pos, i, buf[i], randomBuffer[i], seed);
@@ -224,17 +240,22 @@ static void *runThread(void *arg)
     if (!keepRunning) {
       break;
     }
-    if (positions[i].action == 'W' && positions[i].finishTime>0) {
+    if (positions[i].action == 'W' && positions[i].latency>0) {
       threadContext->bytesRead += positions[i].len;
-      if (positions[i].seed != lastseed) {
+      const dataPatternType *pattern = threadContext->patterns[positions[i].deviceid];
+      if (pattern) {
+        // the whole block comes from (seed, pos), so it's regenerated every time
+        dataPatternFill(pattern, randombuf, threadContext->overridesize ? (size_t)threadContext->overridesize : positions[i].len, positions[i].seed, positions[i].pos);
+        lastseed = -1;
+      } else if (positions[i].seed != lastseed) {
         generateRandomBuffer(randombuf, threadContext->overridesize ? (size_t)threadContext->overridesize : threadContext->pc->maxbs, positions[i].seed);
         lastseed = positions[i].seed;
       }
 
       //      double start = timedouble();
       size_t pos = threadContext->pc->positions[i].pos;
-      memcpy(randombuf, &pos, sizeof(size_t));
-      int ret = verifyPosition(fd, &threadContext->pc->positions[i], randombuf, buf, &diff, lastseed, threadContext->quiet, threadContext->overridesize);
+      if (!pattern) memcpy(randombuf, &pos, sizeof(size_t));
+      int ret = verifyPosition(fd, &threadContext->pc->positions[i], randombuf, buf, &diff, lastseed, threadContext->quiet, threadContext->overridesize, threadContext->sectorSizes[positions[i].deviceid]);
 
       //      threadContext->elapsed = timedouble() - start;
       switch (ret) {
@@ -303,7 +324,34 @@ int verifyPositions(positionContainer *pc, size_t threads, jobType *job, const s
 
   if (process) {
     positionContainerCollapse(pc); // this will sort before collapsing using pos sort.
-    qsort(pc->positions, pc->sz, sizeof(positionType), seedcompare); // post collapse, sort by time
+    positionSortBySubmit(pc->positions, pc->sz); // post collapse, sort by time
+  }
+
+  // the data pattern and sector headers of each device come from its first job's C and g commands
+  const dataPatternType **patterns = NULL;
+  dataPatternType *parsed = NULL;
+  size_t *sectorSizes = NULL;
+  char *seen = NULL;
+  CALLOC(patterns, 65536, sizeof(dataPatternType*));
+  CALLOC(parsed, MAX(job->count, 1), sizeof(dataPatternType));
+  CALLOC(sectorSizes, 65536, sizeof(size_t));
+  CALLOC(seen, 65536, 1);
+  for (int j = 0; j < job->count; j++) {
+    const int hasPattern = dataPatternParse(&parsed[j], job->strings[j]);
+    const size_t sectorSize = sectorHeaderParse(job->strings[j]);
+    const unsigned short id = job->deviceid[j];
+    if (!seen[id]) {
+      seen[id] = 1;
+      patterns[id] = hasPattern ? &parsed[j] : NULL;
+      sectorSizes[id] = sectorSize;
+    } else {
+      if ((hasPattern != (patterns[id] != NULL)) || (hasPattern && memcmp(&parsed[j], patterns[id], sizeof(dataPatternType)))) {
+	if (!quiet) fprintf(stderr,"*warning* the jobs on '%s' write different data patterns, verifying with the first job's\n", job->devices[j]);
+      }
+      if (sectorSize != sectorSizes[id]) {
+	if (!quiet) fprintf(stderr,"*warning* the jobs on '%s' write different sector headers, verifying with the first job's\n", job->devices[j]);
+      }
+    }
   }
 
   pthread_t *pt = NULL;
@@ -317,6 +365,8 @@ int verifyPositions(positionContainer *pc, size_t threads, jobType *job, const s
     threadContext[i].job = job;
     threadContext[i].id = i;
     threadContext[i].overridesize = overridesize;
+    threadContext[i].patterns = patterns;
+    threadContext[i].sectorSizes = sectorSizes;
     threadContext[i].numThreads = threads;
     threadContext[i].startInc = (size_t) (i*(num * 1.0 / threads));
     threadContext[i].endExc =   (size_t) ((i+1)*(num * 1.0 / threads));
@@ -366,6 +416,10 @@ int verifyPositions(positionContainer *pc, size_t threads, jobType *job, const s
 
   free(pt);
   free(threadContext);
+  free(patterns);
+  free(sectorSizes);
+  free(parsed);
+  free(seen);
 
   if (r_correct) *r_correct = correct;
   if (r_incorrect) *r_incorrect = incorrect;
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <numa.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "bufferArena.h"
+
+void arenaInit(arenaType *a, const int numa)
+{
+  memset(a, 0, sizeof(arenaType));
+  a->numa = numa;
+}
+
+
+// map a chunk, hugetlb pages if the pool has them, otherwise 2 MiB aligned and advised for THP
+static void chunkMap(arenaType *a, arenaChunkType *c, size_t size)
+{
+  size = ((size + ARENA_PAGE - 1) / ARENA_PAGE) * ARENA_PAGE;
+
+  c->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (c->map != MAP_FAILED) {
+    c->base = c->map;
+    c->mapped = size;
+    c->pages = ARENA_HUGETLB;
+  } else {
+    c->mapped = size + ARENA_PAGE;
+    c->map = mmap(NULL, c->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c->map == MAP_FAILED) {
+      fprintf(stderr,"*error* out of memory! can't map %zd bytes\n", c->mapped);
+      abort();
+    }
+    c->base = (char*)((((uintptr_t)c->map) + ARENA_PAGE - 1) & ~(ARENA_PAGE - 1));
+    c->pages = (madvise(c->base, size, MADV_HUGEPAGE) == 0) ? ARENA_THP : ARENA_4K;
+  }
+  c->size = size;
+
+  // bind before the first touch. The pages are zero and only faulted in when the I/O uses them,
+  // a slab sized for the largest block may only ever see small ones
+  if ((a->numa >= 0) && (numa_available() >= 0) && (a->numa <= numa_max_node())) {
+    numa_tonode_memory(c->base, c->size, a->numa);
+  }
+}
+
+
+char *arenaAlloc(arenaType *a, const size_t size)
+{
+  assert(size > 0);
+  if (a->depth >= ARENA_MAXALLOCS) {
+    fprintf(stderr,"*error* buffer arena has too many allocations\n");
+    abort();
+  }
+  const size_t need = ((size + 4095) / 4096) * 4096;
+
+  size_t c = a->chunk, off = a->offset;
+  while ((c < a->numChunks) && (off + need > a->chunks[c].size)) {
+    c++;
+    off = 0;
+  }
+  if (c == a->numChunks) {
+    if (a->numChunks >= ARENA_MAXCHUNKS) {
+      fprintf(stderr,"*error* buffer arena has too many chunks\n");
+      abort();
+    }
+    chunkMap(a, &a->chunks[a->numChunks++], need);
+  }
+
+  char *p = a->chunks[c].base + off;
+  a->stackChunk[a->depth] = a->chunk;
+  a->stackOffset[a->depth] = a->offset;
+  a->stackPtr[a->depth] = p;
+  a->depth++;
+  a->chunk = c;
+  a->offset = off + need;
+  return p;
+}
+
+
+// allocations are returned in the reverse order
+void arenaPop(arenaType *a, const char *p)
+{
+  assert(a->depth > 0);
+  a->depth--;
+  assert(a->stackPtr[a->depth] == p);
+  a->chunk = a->stackChunk[a->depth];
+  a->offset = a->stackOffset[a->depth];
+}
+
+
+size_t arenaBytes(const arenaType *a)
+{
+  size_t sum = 0;
+  for (size_t i = 0; i < a->numChunks; i++) {
+    sum += a->chunks[i].size;
+  }
+  return sum;
+}
+
+
+// the smallest page size used by any chunk
+const char *arenaPagesString(const arenaType *a)
+{
+  int pages = ARENA_HUGETLB;
+  for (size_t i = 0; i < a->numChunks; i++) {
+    pages = MIN(pages, a->chunks[i].pages);
+  }
+  if (a->numChunks == 0) return "none";
+  return (pages == ARENA_HUGETLB) ? "hugetlb 2 MiB" : (pages == ARENA_THP) ? "THP" : "4 KiB";
+}
+
+
+void arenaFree(arenaType *a)
+{
+  for (size_t i = 0; i < a->numChunks; i++) {
+    munmap(a->chunks[i].map, a->chunks[i].mapped);
+  }
+  arenaInit(a, a->numa);
+}
@@ -0,0 +1,46 @@
+#ifndef _BUFFERARENA_H
+#define _BUFFERARENA_H
+
+#include <stddef.h>
+
+// per-thread I/O buffer memory: 2 MiB pages bound to a NUMA node, handed out as a stack so
+// each round's slabs land on the same memory, already faulted in by the rounds before
+
+#define ARENA_PAGE (2L*1024*1024)
+#define ARENA_MAXCHUNKS 16
+#define ARENA_MAXALLOCS 16
+
+#define ARENA_4K 0
+#define ARENA_THP 1
+#define ARENA_HUGETLB 2
+
+typedef struct {
+  char *base;
+  size_t size;
+  size_t mapped; // the full mapping, including alignment slop
+  char *map;
+  int pages; // ARENA_4K, ARENA_THP or ARENA_HUGETLB
+} arenaChunkType;
+
+typedef struct {
+  int numa; // -1 for no binding
+  arenaChunkType chunks[ARENA_MAXCHUNKS];
+  size_t numChunks;
+
+  size_t chunk, offset; // the top of the stack
+  size_t stackChunk[ARENA_MAXALLOCS], stackOffset[ARENA_MAXALLOCS];
+  const char *stackPtr[ARENA_MAXALLOCS];
+  size_t depth;
+} arenaType;
+
+void arenaInit(arenaType *a, const int numa);
+
+char *arenaAlloc(arenaType *a, const size_t size);
+void arenaPop(arenaType *a, const char *p);
+
+size_t arenaBytes(const arenaType *a);
+const char *arenaPagesString(const arenaType *a);
+
+void arenaFree(arenaType *a);
+
+#endif
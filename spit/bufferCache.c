@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "bufferCache.h"
+
+/*
+ * Each entry holds generateRandomBuffer(seed, size). Entries are shared by every QD slot and
+ * thread that writes with that seed, so a seed change is a lookup instead of a regenerate.
+ * A slot holds a reference while it uses the buffer; only unreferenced entries are evicted.
+ */
+
+typedef struct bufferCacheEntry {
+  unsigned short seed;
+  size_t size;
+  char *buf;
+  size_t refs;
+  struct bufferCacheEntry *hashNext;
+  struct bufferCacheEntry *lruPrev, *lruNext; // head is most recently used
+} bufferCacheEntry;
+
+static pthread_mutex_t bcLock = PTHREAD_MUTEX_INITIALIZER;
+static bufferCacheEntry *bcHash[65536]; // by seed
+static bufferCacheEntry *bcLRUHead = NULL, *bcLRUTail = NULL;
+static size_t bcBudget = BUFFERCACHE_DEFAULT_BYTES;
+static size_t bcBytes = 0, bcEntries = 0;
+static size_t bcHits = 0, bcMisses = 0, bcEvictions = 0;
+
+
+static void lruUnlink(bufferCacheEntry *e)
+{
+  if (e->lruPrev) e->lruPrev->lruNext = e->lruNext; else bcLRUHead = e->lruNext;
+  if (e->lruNext) e->lruNext->lruPrev = e->lruPrev; else bcLRUTail = e->lruPrev;
+  e->lruPrev = e->lruNext = NULL;
+}
+
+static void lruPushHead(bufferCacheEntry *e)
+{
+  e->lruPrev = NULL;
+  e->lruNext = bcLRUHead;
+  if (bcLRUHead) bcLRUHead->lruPrev = e;
+  bcLRUHead = e;
+  if (!bcLRUTail) bcLRUTail = e;
+}
+
+static void entryFree(bufferCacheEntry *e)
+{
+  bufferCacheEntry **pp = &bcHash[e->seed];
+  while (*pp != e) pp = &(*pp)->hashNext;
+  *pp = e->hashNext;
+  lruUnlink(e);
+  bcBytes -= e->size;
+  bcEntries--;
+  free(e->buf);
+  free(e);
+}
+
+// evict the least recently used unreferenced entries until need bytes fit
+static void evictFor(const size_t need)
+{
+  bufferCacheEntry *e = bcLRUTail;
+  while (e && (bcBytes + need > bcBudget)) {
+    bufferCacheEntry *prev = e->lruPrev;
+    if (e->refs == 0) {
+      entryFree(e);
+      bcEvictions++;
+    }
+    e = prev;
+  }
+}
+
+
+void bufferCacheSetBudget(const size_t bytes)
+{
+  pthread_mutex_lock(&bcLock);
+  bcBudget = bytes;
+  evictFor(0);
+  pthread_mutex_unlock(&bcLock);
+}
+
+
+const char *bufferCacheGet(const unsigned short seed, const size_t size)
+{
+  assert(size > 0);
+  pthread_mutex_lock(&bcLock);
+
+  for (bufferCacheEntry *e = bcHash[seed]; e; e = e->hashNext) {
+    if (e->size == size) {
+      e->refs++;
+      lruUnlink(e);
+      lruPushHead(e);
+      bcHits++;
+      pthread_mutex_unlock(&bcLock);
+      return e->buf;
+    }
+  }
+
+  // miss. Generate outside the lock so other seeds aren't held up behind it, then look again in
+  // case another thread got there first, and if so use its buffer and throw this one away
+  bcMisses++;
+  pthread_mutex_unlock(&bcLock);
+
+  char *buf;
+  CALLOC(buf, size, 1);
+  generateRandomBuffer(buf, size, seed);
+
+  pthread_mutex_lock(&bcLock);
+  for (bufferCacheEntry *e = bcHash[seed]; e; e = e->hashNext) {
+    if (e->size == size) {
+      e->refs++;
+      lruUnlink(e);
+      lruPushHead(e);
+      pthread_mutex_unlock(&bcLock);
+      free(buf);
+      return e->buf;
+    }
+  }
+
+  // if everything is referenced the cache runs over budget until they are released
+  evictFor(size);
+
+  bufferCacheEntry *e;
+  CALLOC(e, 1, sizeof(bufferCacheEntry));
+  e->buf = buf;
+  e->seed = seed;
+  e->size = size;
+  e->refs = 1;
+
+  e->hashNext = bcHash[seed];
+  bcHash[seed] = e;
+  lruPushHead(e);
+  bcBytes += size;
+  bcEntries++;
+
+  pthread_mutex_unlock(&bcLock);
+  return e->buf;
+}
+
+
+void bufferCacheRelease(const unsigned short seed, const size_t size)
+{
+  pthread_mutex_lock(&bcLock);
+  for (bufferCacheEntry *e = bcHash[seed]; e; e = e->hashNext) {
+    if (e->size == size) {
+      assert(e->refs > 0);
+      e->refs--;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&bcLock);
+}
+
+
+void bufferCacheStats(size_t *hits, size_t *misses, size_t *evictions, size_t *entries, size_t *bytes)
+{
+  pthread_mutex_lock(&bcLock);
+  *hits = bcHits;
+  *misses = bcMisses;
+  *evictions = bcEvictions;
+  *entries = bcEntries;
+  *bytes = bcBytes;
+  pthread_mutex_unlock(&bcLock);
+}
+
+
+void bufferCacheFree()
+{
+  pthread_mutex_lock(&bcLock);
+  while (bcLRUHead) {
+    entryFree(bcLRUHead);
+  }
+  bcHits = bcMisses = bcEvictions = 0;
+  pthread_mutex_unlock(&bcLock);
+}
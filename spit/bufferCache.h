@@ -0,0 +1,19 @@
+#ifndef _BUFFERCACHE_H
+#define _BUFFERCACHE_H
+
+#include <stddef.h>
+
+// process-wide, read-only generated write buffers keyed by (seed, size), bounded by an LRU byte budget
+
+#define BUFFERCACHE_DEFAULT_BYTES (256L*1024*1024)
+
+void bufferCacheSetBudget(const size_t bytes);
+
+const char *bufferCacheGet(const unsigned short seed, const size_t size);
+void bufferCacheRelease(const unsigned short seed, const size_t size);
+
+void bufferCacheStats(size_t *hits, size_t *misses, size_t *evictions, size_t *entries, size_t *bytes);
+
+void bufferCacheFree();
+
+#endif
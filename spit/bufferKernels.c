@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufferKernels.h"
+
+#if defined(__x86_64__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#define GOLDEN 0x9e3779b97f4a7c15ULL
+#define MIX1 0xbf58476d1ce4e5b9ULL
+#define MIX2 0x94d049bb133111ebULL
+
+
+static inline uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * MIX1;
+  z = (z ^ (z >> 27)) * MIX2;
+  return z ^ (z >> 31);
+}
+
+
+static size_t mismatchScalar(const char *a, const char *b, const size_t len)
+{
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    if (x != y) break;
+  }
+  for (; i < len; i++) {
+    if (a[i] != b[i]) return i;
+  }
+  return len;
+}
+
+static size_t checksumScalar(const char *buffer, const size_t len)
+{
+  size_t checksum = 0;
+  for (size_t i = 0; i < len; i++) {
+    checksum += (i ^ buffer[i]);
+  }
+  return checksum;
+}
+
+static void fillScalar(char *out, const size_t words, uint64_t x)
+{
+  for (size_t k = 0; k < words; k++, out += 8) {
+    x += GOLDEN;
+    const uint64_t v = mix64(x);
+    memcpy(out, &v, 8);
+  }
+}
+
+static uint32_t crcTable[256]; // reflected 0x1EDC6F41, made by kernelsSelect()
+
+static uint32_t crc32cScalar(const char *buffer, const size_t len)
+{
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < len; i++) {
+    crc = crcTable[(crc ^ (unsigned char)buffer[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void stampScalar(char *buffer, const size_t sectors, const size_t sectorSize, const char *header)
+{
+  uint64_t lba;
+  memcpy(&lba, header + 8, 8);
+  const uint32_t zero = 0;
+  for (size_t s = 0; s < sectors; s++, lba += sectorSize / 512) {
+    char *sector = buffer + s * sectorSize;
+    memcpy(sector, header, 32);
+    memcpy(sector + 4, &zero, 4);
+    memcpy(sector + 8, &lba, 8);
+    const uint32_t crc = crc32cScalar(sector, sectorSize);
+    memcpy(sector + 4, &crc, 4);
+  }
+}
+
+// the checksum of [from, len) carrying on from sum
+static size_t checksumTail(const char *buffer, size_t from, const size_t len, size_t sum)
+{
+  for (; from < len; from++) {
+    sum += (from ^ buffer[from]);
+  }
+  return sum;
+}
+
+
+#ifdef KERNELS_X86
+
+__attribute__((target("avx2")))
+static size_t mismatchAVX2(const char *a, const char *b, const size_t len)
+{
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    const __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+    const __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+    if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != 0xffffffffU) {
+      const unsigned int m0 = ~(unsigned int)_mm256_movemask_epi8(e0);
+      if (m0) return i + __builtin_ctz(m0);
+      return i + 32 + __builtin_ctz(~(unsigned int)_mm256_movemask_epi8(e1));
+    }
+  }
+  const size_t rest = mismatchScalar(a + i, b + i, len - i);
+  return i + rest;
+}
+
+/*
+ * The checksum 256 bytes at a time. For i = H + L, with L the low 8 bits, i ^ sext(c) is
+ * H + (L ^ c) if c >= 0 and (2^64 - 256 - H) + (L ^ c) if c < 0. The L ^ c bytes are summed
+ * with SAD and the negative bytes counted from their sign bits.
+ */
+__attribute__((target("avx2,popcnt")))
+static size_t checksumAVX2(const char *buffer, const size_t len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lanes = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+					 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+  __m256i low[8];
+  for (int k = 0; k < 8; k++) {
+    low[k] = _mm256_add_epi8(lanes, _mm256_set1_epi8((char)(k * 32)));
+  }
+
+  __m256i acc = zero;
+  size_t sum = 0, i = 0;
+  for (; i + 256 <= len; i += 256) {
+    size_t neg = 0;
+    for (int k = 0; k < 8; k++) {
+      const __m256i v = _mm256_loadu_si256((const __m256i*)(buffer + i + 32 * k));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_xor_si256(v, low[k]), zero));
+      neg += __builtin_popcount((unsigned int)_mm256_movemask_epi8(v));
+    }
+    sum += i * (256 - neg) - (i + 256) * neg;
+  }
+  uint64_t part[4];
+  _mm256_storeu_si256((__m256i*)part, acc);
+  sum += part[0] + part[1] + part[2] + part[3];
+  return checksumTail(buffer, i, len, sum);
+}
+
+// the low 64 bits of a * b, b split into its 32 bit halves
+__attribute__((target("avx2")))
+static inline __m256i mullo64AVX2(const __m256i a, const __m256i b, const __m256i bhi)
+{
+  const __m256i lo = _mm256_mul_epu32(a, b);
+  const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, bhi));
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static void fillAVX2(char *out, const size_t words, const uint64_t x)
+{
+  const __m256i m1 = _mm256_set1_epi64x(MIX1), m1hi = _mm256_set1_epi64x(MIX1 >> 32);
+  const __m256i m2 = _mm256_set1_epi64x(MIX2), m2hi = _mm256_set1_epi64x(MIX2 >> 32);
+  const __m256i step = _mm256_set1_epi64x(4 * GOLDEN);
+  __m256i v = _mm256_setr_epi64x(x + GOLDEN, x + 2 * GOLDEN, x + 3 * GOLDEN, x + 4 * GOLDEN);
+  size_t k = 0;
+  for (; k + 4 <= words; k += 4, out += 32) {
+    __m256i z = mullo64AVX2(_mm256_xor_si256(v, _mm256_srli_epi64(v, 30)), m1, m1hi);
+    z = mullo64AVX2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), m2, m2hi);
+    _mm256_storeu_si256((__m256i*)out, _mm256_xor_si256(z, _mm256_srli_epi64(z, 31)));
+    v = _mm256_add_epi64(v, step);
+  }
+  fillScalar(out, words - k, x + k * GOLDEN);
+}
+
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSSE42(const char *buffer, const size_t len)
+{
+  uint64_t crc = 0xffffffff, w;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    memcpy(&w, buffer + i, 8);
+    crc = _mm_crc32_u64(crc, w);
+  }
+  for (; i < len; i++) {
+    crc = _mm_crc32_u8((uint32_t)crc, (unsigned char)buffer[i]);
+  }
+  return ~(uint32_t)crc;
+}
+
+/*
+ * The headers go in with one 32 byte store a sector. The crc32 instruction takes 3 cycles but
+ * can start one a cycle, so four sectors are summed at once as independent chains. It's the
+ * same for AVX-512, which has nothing faster for CRC32C without carry-less multiply folding
+ */
+__attribute__((target("avx2,sse4.2")))
+static void stampAVX2(char *buffer, const size_t sectors, const size_t sectorSize, const char *header)
+{
+  __m256i h = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)header), _mm256_setr_epi32(-1, 0, -1, -1, -1, -1, -1, -1));
+  const __m256i step = _mm256_setr_epi64x(0, sectorSize / 512, 0, 0);
+  for (size_t s = 0; s < sectors; s++) {
+    _mm256_storeu_si256((__m256i*)(buffer + s * sectorSize), h);
+    h = _mm256_add_epi64(h, step);
+  }
+
+  size_t s = 0;
+  for (; s + 4 <= sectors; s += 4) {
+    const char *p0 = buffer + s * sectorSize, *p1 = p0 + sectorSize, *p2 = p1 + sectorSize, *p3 = p2 + sectorSize;
+    uint64_t c0 = 0xffffffff, c1 = c0, c2 = c0, c3 = c0, w0, w1, w2, w3;
+    for (size_t i = 0; i < sectorSize; i += 8) {
+      memcpy(&w0, p0 + i, 8);
+      memcpy(&w1, p1 + i, 8);
+      memcpy(&w2, p2 + i, 8);
+      memcpy(&w3, p3 + i, 8);
+      c0 = _mm_crc32_u64(c0, w0);
+      c1 = _mm_crc32_u64(c1, w1);
+      c2 = _mm_crc32_u64(c2, w2);
+      c3 = _mm_crc32_u64(c3, w3);
+    }
+    const uint32_t crc[4] = {~(uint32_t)c0, ~(uint32_t)c1, ~(uint32_t)c2, ~(uint32_t)c3};
+    for (int k = 0; k < 4; k++) {
+      memcpy(buffer + (s + k) * sectorSize + 4, &crc[k], 4);
+    }
+  }
+  for (; s < sectors; s++) {
+    const uint32_t crc = crc32cSSE42(buffer + s * sectorSize, sectorSize);
+    memcpy(buffer + s * sectorSize + 4, &crc, 4);
+  }
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t mismatchAVX512(const char *a, const char *b, const size_t len)
+{
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    const __mmask64 ne = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+    if (ne) return i + __builtin_ctzll(ne);
+  }
+  if (i < len) {
+    const __mmask64 m = (1ULL << (len - i)) - 1;
+    const __mmask64 ne = _mm512_mask_cmpneq_epi8_mask(m, _mm512_maskz_loadu_epi8(m, a + i), _mm512_maskz_loadu_epi8(m, b + i));
+    if (ne) return i + __builtin_ctzll(ne);
+  }
+  return len;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static size_t checksumAVX512(const char *buffer, const size_t len)
+{
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i low[4];
+  {
+    char l[256];
+    for (int k = 0; k < 256; k++) l[k] = (char)k;
+    for (int k = 0; k < 4; k++) low[k] = _mm512_loadu_si512(l + 64 * k);
+  }
+
+  __m512i acc = zero;
+  size_t sum = 0, i = 0;
+  for (; i + 256 <= len; i += 256) {
+    size_t neg = 0;
+    for (int k = 0; k < 4; k++) {
+      const __m512i v = _mm512_loadu_si512(buffer + i + 64 * k);
+      acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_xor_si512(v, low[k]), zero));
+      neg += __builtin_popcountll(_mm512_movepi8_mask(v));
+    }
+    sum += i * (256 - neg) - (i + 256) * neg;
+  }
+  sum += _mm512_reduce_add_epi64(acc);
+  return checksumTail(buffer, i, len, sum);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static void fillAVX512(char *out, const size_t words, const uint64_t x)
+{
+  const __m512i m1 = _mm512_set1_epi64(MIX1), m2 = _mm512_set1_epi64(MIX2);
+  const __m512i step = _mm512_set1_epi64(8 * GOLDEN);
+  __m512i v = _mm512_add_epi64(_mm512_set1_epi64(x), _mm512_mullo_epi64(_mm512_setr_epi64(1, 2, 3, 4, 5, 6, 7, 8), _mm512_set1_epi64(GOLDEN)));
+  size_t k = 0;
+  for (; k + 8 <= words; k += 8, out += 64) {
+    __m512i z = _mm512_mullo_epi64(_mm512_xor_si512(v, _mm512_srli_epi64(v, 30)), m1);
+    z = _mm512_mullo_epi64(_mm512_xor_si512(z, _mm512_srli_epi64(z, 27)), m2);
+    _mm512_storeu_si512(out, _mm512_xor_si512(z, _mm512_srli_epi64(z, 31)));
+    v = _mm512_add_epi64(v, step);
+  }
+  fillScalar(out, words - k, x + k * GOLDEN);
+}
+
+#endif
+
+
+static size_t (*mismatchFn)(const char *, const char *, const size_t) = mismatchScalar;
+static size_t (*checksumFn)(const char *, const size_t) = checksumScalar;
+static void (*fillFn)(char *, const size_t, uint64_t) = fillScalar;
+static uint32_t (*crcFn)(const char *, const size_t) = crc32cScalar;
+static void (*stampFn)(char *, const size_t, const size_t, const char *) = stampScalar;
+static int kernelLevel = KERNELS_SCALAR;
+
+
+int kernelsSelect(const int level)
+{
+  if (crcTable[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c >> 1) ^ ((c & 1) ? 0x82f63b78 : 0);
+      crcTable[i] = c;
+    }
+  }
+
+  int best = KERNELS_SCALAR;
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2")) best = KERNELS_AVX2;
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) best = KERNELS_AVX512;
+#endif
+  if ((level >= 0) && (level < best)) best = level;
+
+  mismatchFn = mismatchScalar;
+  checksumFn = checksumScalar;
+  fillFn = fillScalar;
+  crcFn = crc32cScalar;
+  stampFn = stampScalar;
+#ifdef KERNELS_X86
+  if (best >= KERNELS_AVX2) {
+    crcFn = crc32cSSE42;
+    stampFn = stampAVX2;
+  }
+  if (best == KERNELS_AVX2) {
+    mismatchFn = mismatchAVX2;
+    checksumFn = checksumAVX2;
+    fillFn = fillAVX2;
+  } else if (best == KERNELS_AVX512) {
+    mismatchFn = mismatchAVX512;
+    checksumFn = checksumAVX512;
+    fillFn = fillAVX512;
+  }
+#endif
+  kernelLevel = best;
+  return best;
+}
+
+// before main(), so the I/O threads never see the pointers change
+__attribute__((constructor))
+static void kernelsInit(void)
+{
+  kernelsSelect(-1);
+}
+
+
+int kernelsLevel(void)
+{
+  return kernelLevel;
+}
+
+const char *kernelsName(const int level)
+{
+  switch (level) {
+  case KERNELS_AVX2: return "avx2";
+  case KERNELS_AVX512: return "avx512";
+  default: return "scalar";
+  }
+}
+
+
+size_t bufferMismatch(const char *a, const char *b, const size_t len)
+{
+  return mismatchFn(a, b, len);
+}
+
+size_t bufferChecksum(const char *buffer, const size_t len)
+{
+  return checksumFn(buffer, len);
+}
+
+void bufferFillSplitmix(char *out, const size_t words, const uint64_t x)
+{
+  fillFn(out, words, x);
+}
+
+uint32_t bufferCrc32c(const char *buffer, const size_t len)
+{
+  return crcFn(buffer, len);
+}
+
+void bufferStampSectors(char *buffer, const size_t sectors, const size_t sectorSize, const char *header)
+{
+  stampFn(buffer, sectors, sectorSize, header);
+}
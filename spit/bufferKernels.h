@@ -0,0 +1,36 @@
+#ifndef _BUFFERKERNELS_H
+#define _BUFFERKERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the inner loops of generating and verifying write data, with AVX2 and AVX-512 versions
+// picked for the CPU at startup
+
+#define KERNELS_SCALAR 0
+#define KERNELS_AVX2 1
+#define KERNELS_AVX512 2
+
+// the best the CPU has, or at most level. Returns the level used
+int kernelsSelect(const int level);
+int kernelsLevel(void);
+const char *kernelsName(const int level);
+
+// the first offset where a and b differ, len if they're the same
+size_t bufferMismatch(const char *a, const char *b, const size_t len);
+
+// the sum of (i ^ buffer[i]), the char sign extended
+size_t bufferChecksum(const char *buffer, const size_t len);
+
+// words of the splitmix64 stream after x, out[k] = mix64(x + (k+1) 0x9e3779b97f4a7c15)
+void bufferFillSplitmix(char *out, const size_t words, const uint64_t x);
+
+// the CRC32C (Castagnoli) of len bytes
+uint32_t bufferCrc32c(const char *buffer, const size_t len);
+
+// the 32 byte header is copied to the start of each sector, with the uint64 at offset 8 going up
+// by sectorSize / 512 a sector. The CRC32C of each sector, taken with the uint32 at offset 4 zero,
+// then goes there. sectorSize is a multiple of 8
+void bufferStampSectors(char *buffer, const size_t sectors, const size_t sectorSize, const char *header);
+
+#endif
@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "dataPattern.h"
+#include "bufferKernels.h"
+
+#define GOLDEN 0x9e3779b97f4a7c15ULL
+
+
+// the splitmix64 finaliser, a bijection. Word w of a block with key k is mix64(k + (w+1) GOLDEN),
+// which is the splitmix64 stream, so any part of a block can be made without the rest
+static inline uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// digits and a point only, so C2e0.9 is C2 then e0.9
+static double parseNumber(const char *s, const char **endp)
+{
+  char num[32];
+  size_t n = 0;
+  while ((n < sizeof(num) - 1) && (isdigit(s[n]) || (s[n] == '.'))) {
+    num[n] = s[n];
+    n++;
+  }
+  num[n] = 0;
+  *endp = s + n;
+  return n ? atof(num) : 0;
+}
+
+
+int dataPatternParse(dataPatternType *d, const char *jobstring)
+{
+  memset(d, 0, sizeof(dataPatternType));
+  const char *charC = strchr(jobstring, 'C');
+  if (!charC) return 0;
+
+  const char *endp = NULL;
+  double kib = 4;
+  d->compress = parseNumber(charC + 1, &endp);
+  d->dedupe = 1;
+  if (*endp == ':') d->dedupe = parseNumber(endp + 1, &endp);
+  if (*endp == ':') kib = parseNumber(endp + 1, &endp);
+  if (d->compress < 1) d->compress = 1;
+  if (d->dedupe < 1) d->dedupe = 1;
+  if (kib < 4) kib = 4;
+
+  d->blockSize = alignedNumber(kib * 1024 + 4095, 4096);
+  d->randomBytes = MAX(8, ((size_t) ceil(d->blockSize / d->compress) + 7) / 8 * 8);
+  d->randomBytes = MIN(d->randomBytes, d->blockSize);
+  d->uniqueBelow = (d->dedupe == 1) ? UINT64_MAX : (uint64_t) ldexp(1.0 / d->dedupe, 64);
+  return 1;
+}
+
+
+void dataPatternFill(const dataPatternType *d, char *buf, const size_t len, const unsigned short seed, const size_t pos)
+{
+  assert(((pos | len) & 7) == 0);
+  const uint64_t seedKey = mix64(seed + GOLDEN);
+  const size_t bs = d->blockSize;
+  const size_t end = pos + len;
+
+  for (size_t off = pos; off < end; ) {
+    const size_t b = off / bs;
+    const size_t blockStart = b * bs;
+    const size_t to = MIN(end, blockStart + bs);
+
+    // unique blocks are keyed by their number, the others by one of the seed's pool
+    const uint64_t h = mix64(seedKey ^ (b * GOLDEN));
+    const uint64_t key = (h < d->uniqueBelow) ? h : mix64(~seedKey ^ (h % DATAPATTERN_POOL));
+
+    const size_t randomEnd = MIN(to, blockStart + d->randomBytes);
+    char *out = buf + (off - pos);
+    if (off < randomEnd) {
+      bufferFillSplitmix(out, (randomEnd - off) / 8, key + ((off - blockStart) / 8) * GOLDEN);
+      out += randomEnd - off;
+    }
+    if (randomEnd < to) {
+      memset(out, 0, to - MAX(off, randomEnd));
+    }
+    off = to;
+  }
+}
+
+
+void dataPatternReport(const dataPatternType *d, const char *prefix)
+{
+  if ((d->compress == 1) && (d->dedupe == 1)) {
+    fprintf(stderr,"*info* %s data pattern: incompressible random data, every %.0lf KiB block unique\n", prefix, TOKiB(d->blockSize));
+    return;
+  }
+  fprintf(stderr,"*info* %s data pattern: %g:1 compressible (%zd random bytes per %.0lf KiB block), %g:1 dedupe (%.1lf%% of the blocks unique, the rest copies of %d per seed)\n", prefix, d->compress, d->randomBytes, TOKiB(d->blockSize), d->dedupe, 100.0 / d->dedupe, DATAPATTERN_POOL);
+}
@@ -0,0 +1,29 @@
+#ifndef _DATAPATTERN_H
+#define _DATAPATTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// write data with a chosen compression and dedupe ratio. Each block of the device is generated
+// from (seed, block number), so any block can be regenerated to verify it. The default, without
+// a pattern, is the seed's ASCII ramp repeating every 4 KiB, which reduces to almost nothing
+
+#define DATAPATTERN_POOL 64 // the duplicate blocks are copies of this many per seed
+
+typedef struct {
+  double compress; // ratio, 1 is incompressible
+  double dedupe; // ratio, 1 is every block unique
+  size_t blockSize; // the compression and dedupe granularity
+  size_t randomBytes; // per block, the rest is zero
+  uint64_t uniqueBelow; // a block is unique when its hash is below this
+} dataPatternType;
+
+// from the C job string command, Ccompress:dedupe:KiB. Returns 0 if the string has no pattern
+int dataPatternParse(dataPatternType *d, const char *jobstring);
+
+// the data for len bytes at device offset pos, pos and len multiples of 8
+void dataPatternFill(const dataPatternType *d, char *buf, const size_t len, const unsigned short seed, const size_t pos);
+
+void dataPatternReport(const dataPatternType *d, const char *prefix);
+
+#endif
@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "discardWorker.h"
+
+static void *discardWorkerThread(void *arg)
+{
+  discardWorkerType *d = (discardWorkerType*)arg;
+
+  pthread_mutex_lock(&d->lock);
+  while (1) {
+    while (!d->stop && d->pendingHead == d->pendingTail) {
+      pthread_cond_wait(&d->work, &d->lock);
+    }
+    if (d->pendingHead == d->pendingTail) break; // stopping and nothing left
+
+    positionType *p = d->pending[d->pendingTail++];
+    if (d->pendingTail == d->size) d->pendingTail = 0;
+    pthread_mutex_unlock(&d->lock);
+
+    // the latency is the discard's, not the time waiting for a worker
+    p->submitTime = timeStamp();
+    performDiscard(d->fd, NULL, p->pos, p->pos + p->len, d->maxSize, d->alignment, NULL, 0, 0);
+    positionSetFinishTime(p, timeStamp());
+
+    pthread_mutex_lock(&d->lock);
+    d->done[d->doneHead++] = p;
+    if (d->doneHead == d->size) d->doneHead = 0;
+    pthread_cond_signal(&d->finished);
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return NULL;
+}
+
+
+void discardWorkerStart(discardWorkerType *d, const int fd, const size_t numThreads, const size_t QD, const size_t maxSize, const size_t alignment)
+{
+  assert(numThreads > 0);
+  d->fd = fd;
+  d->maxSize = maxSize;
+  d->alignment = alignment;
+  d->numThreads = numThreads;
+  d->size = QD + 1;
+  d->stop = 0;
+  d->pendingHead = d->pendingTail = 0;
+  d->doneHead = d->doneTail = 0;
+  CALLOC(d->pending, d->size, sizeof(positionType*));
+  CALLOC(d->done, d->size, sizeof(positionType*));
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->work, NULL);
+  pthread_cond_init(&d->finished, NULL);
+
+  CALLOC(d->threads, numThreads, sizeof(pthread_t));
+  for (size_t i = 0; i < numThreads; i++) {
+    pthread_create(&d->threads[i], NULL, discardWorkerThread, d);
+    pthread_setname_np(d->threads[i], "spit-discard");
+  }
+}
+
+
+// the caller owns the slot, so there is always room
+void discardWorkerSubmit(discardWorkerType *d, positionType *p)
+{
+  pthread_mutex_lock(&d->lock);
+  d->pending[d->pendingHead++] = p;
+  if (d->pendingHead == d->size) d->pendingHead = 0;
+  pthread_cond_signal(&d->work);
+  pthread_mutex_unlock(&d->lock);
+}
+
+
+// return up to max completed trims, waiting up to waitSeconds if there are none yet
+size_t discardWorkerReap(discardWorkerType *d, positionType **ret, const size_t max, const double waitSeconds)
+{
+  size_t got = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if ((d->doneHead == d->doneTail) && (waitSeconds > 0)) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const double until = ts.tv_sec + ts.tv_nsec / 1000000000.0 + waitSeconds;
+    ts.tv_sec = (time_t)until;
+    ts.tv_nsec = (long)((until - floor(until)) * 1000000000.0);
+    pthread_cond_timedwait(&d->finished, &d->lock, &ts);
+  }
+  while ((d->doneTail != d->doneHead) && (got < max)) {
+    ret[got++] = d->done[d->doneTail++];
+    if (d->doneTail == d->size) d->doneTail = 0;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return got;
+}
+
+
+void discardWorkerStop(discardWorkerType *d)
+{
+  pthread_mutex_lock(&d->lock);
+  d->stop = 1;
+  pthread_cond_broadcast(&d->work);
+  pthread_mutex_unlock(&d->lock);
+
+  for (size_t i = 0; i < d->numThreads; i++) {
+    pthread_join(d->threads[i], NULL);
+  }
+  free(d->threads);
+  free(d->pending);
+  free(d->done);
+  pthread_mutex_destroy(&d->lock);
+  pthread_cond_destroy(&d->work);
+  pthread_cond_destroy(&d->finished);
+}
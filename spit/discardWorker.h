@@ -0,0 +1,38 @@
+#ifndef _DISCARDWORKER_H
+#define _DISCARDWORKER_H
+
+#include <pthread.h>
+
+#include "positions.h"
+
+// a small pool of threads that perform BLKDISCARD for the I/O loop, so trims don't block it
+typedef struct {
+  int fd;
+  size_t maxSize;
+  size_t alignment;
+  size_t numThreads;
+  pthread_t *threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work;     // signalled when there are trims to do
+  pthread_cond_t finished; // signalled when a trim has completed
+
+  // pending and completed rings, each can hold every slot
+  size_t size;
+  positionType **pending;
+  size_t pendingHead, pendingTail;
+  positionType **done;
+  size_t doneHead, doneTail;
+
+  int stop;
+} discardWorkerType;
+
+void discardWorkerStart(discardWorkerType *d, const int fd, const size_t numThreads, const size_t QD, const size_t maxSize, const size_t alignment);
+
+void discardWorkerSubmit(discardWorkerType *d, positionType *p);
+
+size_t discardWorkerReap(discardWorkerType *d, positionType **ret, const size_t max, const double waitSeconds);
+
+void discardWorkerStop(discardWorkerType *d);
+
+#endif
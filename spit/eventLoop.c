@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "eventLoop.h"
+
+#define EVENTLOOP_MAXEVENTS 64
+
+static void *eventLoopThread(void *arg)
+{
+  eventLoopType *l = (eventLoopType*)arg;
+  struct epoll_event evs[EVENTLOOP_MAXEVENTS];
+  struct rusage cpustart, cpuend;
+  getrusage(RUSAGE_THREAD, &cpustart);
+
+  while (1) {
+    pthread_mutex_lock(&l->lock);
+    while (l->incoming) {
+      eventLoopItem *it = l->incoming;
+      l->incoming = it->next;
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.ptr = it;
+      if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, aioDeviceEventFd(it->dev), &ev) != 0) {
+	perror("epoll_ctl");
+	exit(-1);
+      }
+      it->next = l->active;
+      l->active = it;
+      l->devices++;
+    }
+    const int stop = l->stop;
+    pthread_mutex_unlock(&l->lock);
+    if (stop && !l->active) break;
+
+    // the short timeout paces positions with time offsets and notices the end of a round
+    const int n = epoll_wait(l->epfd, evs, EVENTLOOP_MAXEVENTS, l->active ? 1 : 100);
+    for (int i = 0; i < n; i++) {
+      if (evs[i].data.ptr == NULL) {
+	uint64_t v;
+	if (read(l->wakefd, &v, sizeof(v)) < 0) {
+	  // already drained, nothing to do
+	}
+      } else {
+	aioDeviceReap(((eventLoopItem*)evs[i].data.ptr)->dev);
+      }
+    }
+
+    eventLoopItem **pit = &l->active;
+    while (*pit) {
+      eventLoopItem *it = *pit;
+      aioDeviceSubmit(it->dev);
+      if (aioDeviceFinished(it->dev)) {
+	epoll_ctl(l->epfd, EPOLL_CTL_DEL, aioDeviceEventFd(it->dev), NULL);
+	*pit = it->next;
+	pthread_mutex_lock(&l->lock);
+	it->finished = 1;
+	pthread_cond_broadcast(&l->done);
+	pthread_mutex_unlock(&l->lock);
+      } else {
+	pit = &it->next;
+      }
+    }
+    l->passes++;
+  }
+
+  getrusage(RUSAGE_THREAD, &cpuend);
+  l->cpu = (cpuend.ru_utime.tv_sec - cpustart.ru_utime.tv_sec) + (cpuend.ru_utime.tv_usec - cpustart.ru_utime.tv_usec) / 1000000.0
+    + (cpuend.ru_stime.tv_sec - cpustart.ru_stime.tv_sec) + (cpuend.ru_stime.tv_usec - cpustart.ru_stime.tv_usec) / 1000000.0;
+  return NULL;
+}
+
+
+void eventLoopStart(eventLoopType *l, const int id)
+{
+  l->id = id;
+  l->incoming = NULL;
+  l->active = NULL;
+  l->stop = 0;
+  l->devices = 0;
+  l->passes = 0;
+  l->cpu = 0;
+  pthread_mutex_init(&l->lock, NULL);
+  pthread_cond_init(&l->done, NULL);
+
+  l->epfd = epoll_create1(EPOLL_CLOEXEC);
+  l->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((l->epfd < 0) || (l->wakefd < 0)) {
+    perror("eventLoopStart");
+    exit(-1);
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL; // the wake fd
+  epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->wakefd, &ev);
+
+  char s[100];
+  sprintf(s, "spit-loop%d", id);
+  pthread_create(&l->thread, NULL, eventLoopThread, l);
+  pthread_setname_np(l->thread, s);
+}
+
+
+static void eventLoopWake(eventLoopType *l)
+{
+  const uint64_t one = 1;
+  if (write(l->wakefd, &one, sizeof(one)) < 0) {
+    // the counter is non-zero so the loop will wake anyway
+  }
+}
+
+
+// hand a device to the loop and wait until its round has finished
+void eventLoopRun(eventLoopType *l, aioDeviceType *dev)
+{
+  eventLoopItem it;
+  it.dev = dev;
+  it.finished = 0;
+
+  pthread_mutex_lock(&l->lock);
+  assert(!l->stop);
+  it.next = l->incoming;
+  l->incoming = &it;
+  eventLoopWake(l);
+  while (!it.finished) {
+    pthread_cond_wait(&l->done, &l->lock);
+  }
+  pthread_mutex_unlock(&l->lock);
+}
+
+
+void eventLoopStop(eventLoopType *l)
+{
+  pthread_mutex_lock(&l->lock);
+  l->stop = 1;
+  eventLoopWake(l);
+  pthread_mutex_unlock(&l->lock);
+
+  pthread_join(l->thread, NULL);
+  close(l->epfd);
+  close(l->wakefd);
+  pthread_cond_destroy(&l->done);
+  pthread_mutex_destroy(&l->lock);
+}
@@ -0,0 +1,38 @@
+#ifndef _EVENTLOOP_H
+#define _EVENTLOOP_H
+
+#include <pthread.h>
+
+#include "aioRequests.h"
+
+// one thread that drives the I/O of several jobs, waiting on their completion eventfds with epoll
+typedef struct eventLoopItem {
+  aioDeviceType *dev;
+  int finished;
+  struct eventLoopItem *next;
+} eventLoopItem;
+
+typedef struct {
+  int id;
+  int epfd;
+  int wakefd; // eventfd, written when a device is added or on stop
+  pthread_t thread;
+
+  pthread_mutex_t lock;
+  pthread_cond_t done; // broadcast when a device has finished its round
+  eventLoopItem *incoming; // added by eventLoopRun(), moved to active by the loop
+  int stop;
+
+  // only the loop thread touches these
+  eventLoopItem *active;
+  size_t devices, passes;
+  double cpu; // user+sys seconds
+} eventLoopType;
+
+void eventLoopStart(eventLoopType *l, const int id);
+
+void eventLoopRun(eventLoopType *l, aioDeviceType *dev);
+
+void eventLoopStop(eventLoopType *l);
+
+#endif
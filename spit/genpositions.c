@@ -155,7 +155,7 @@ int main(int argc, char *argv[])
       perror("genpositions");
       exit(1);
     }
-    pc.positions[count].finishTime = timedouble();
+    positionSetFinishTime(&pc.positions[count], timedouble());
 
 
     if (sequenceChoice == 1) {
@@ -8,18 +8,29 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 
 #include <assert.h>
 #include <pthread.h>
 
 #include <math.h>
 #include <limits.h>
+#include <ctype.h>
 
 #include "jobType.h"
 #include "utils.h"
 #include "list.h"
 #include "latency.h"
 #include "aioRequests.h"
+#include "uringRequests.h"
+#include "bufferCache.h"
+#include "eventLoop.h"
+#include "lazyPositions.h"
+#include "positionSkew.h"
+#include "traceReplay.h"
+#include "sectorHeader.h"
+#include "positionLog.h"
+#include "positionStream.h"
 #include "blockVerify.h"
 
 extern volatile int keepRunning;
@@ -35,6 +46,8 @@ void jobInit(jobType *job)
   job->deviceid = NULL;
   job->suggestedNUMA = NULL;
   job->delay = NULL;
+  job->lengths = NULL;
+  job->trace = NULL;
 }
 
 void jobAddBoth(jobType *job, char *device, char *jobstring, int suggestedNUMA)
@@ -191,6 +204,7 @@ typedef struct {
   size_t iopstarget;
   size_t iopsdecrease;
   char *randomBuffer;
+  arenaType arena;
   size_t numThreads;
   size_t waitForThreads;
   size_t *go;
@@ -224,6 +238,21 @@ typedef struct {
   int notexclusive;
   size_t posIncrement;
   int jmodonly;
+  int engine;
+  int pollRing;
+  int iopoll;
+  int splitReap;
+  int eventLoopGroup; // -1 for the job's own thread
+  int lazy;
+  int lazyKeep; // -v or -P to a file, every completed lazy position is kept
+  lazyPositionsType lazyGen;
+  skewType skew;
+  dataPatternType pattern; // 'C', the write data
+  const traceType *trace; // replayed instead of generated positions
+  double replaySpeed; // 0 is as fast as possible
+  eventLoopType *loop;
+  int flushBarrier;
+  size_t trimQD;
 
   // results
   double result_writeIOPS;
@@ -245,44 +274,76 @@ static void *runThread(void *arg)
   // create the positions and the r/w status
   //    threadContext->seqFiles = seqFiles;
   //    threadContext->seqFilesMaxSizeBytes = seqFilesMaxSizeBytes;
-  positionContainerCreatePositions(&threadContext->pos, threadContext->jobdeviceid, threadContext->seqFiles, threadContext->seqFilesMaxSizeBytes, threadContext->rw, &threadContext->len, MIN(4096,threadContext->blockSize), threadContext->startingBlock, threadContext->minbdSize, threadContext->maxbdSize, threadContext->seed, threadContext->mod, threadContext->remain, threadContext->fourkEveryMiB, threadContext->jumpK, threadContext->firstPPositions);
+  if (threadContext->trace) {
+    char prefix[20];
+    snprintf(prefix, sizeof(prefix), "[t%zd]", threadContext->id);
+    tracePositions(threadContext->trace, &threadContext->pos, threadContext->jobdeviceid, threadContext->minbdSize, threadContext->maxbdSize, threadContext->seed, threadContext->replaySpeed, (verbose || threadContext->id == 0) ? prefix : NULL);
+    if (verbose >= 2) {
+      positionContainerCheck(&threadContext->pos, threadContext->minbdSize, threadContext->maxbdSize, 0 /*traced I/O can overlap*/);
+    }
+  } else if (threadContext->lazy) {
+    // only a window of positions, the I/O loop generates the rest as it goes
+    lazyPositionsInit(&threadContext->lazyGen, &threadContext->pos, threadContext->jobdeviceid, threadContext->seqFiles, threadContext->rw, &threadContext->len, threadContext->minbdSize, threadContext->maxbdSize, threadContext->seed);
+    if (threadContext->skew.type != SKEW_NONE) {
+      skewSetup(&threadContext->skew, threadContext->lazyGen.count);
+      threadContext->lazyGen.skew = &threadContext->skew;
+      skewCountSetup(&threadContext->lazyGen.skewCount, &threadContext->skew);
+      if (verbose || threadContext->id == 0) {
+        char prefix[20];
+        snprintf(prefix, sizeof(prefix), "[t%zd]", threadContext->id);
+        skewReport(&threadContext->skew, threadContext->lazyGen.slot, prefix);
+      }
+    }
+    lazyPositionsFill(&threadContext->lazyGen, threadContext->pos.positions);
+    if (threadContext->lazyKeep) {
+      lazyPositionsKeep(&threadContext->lazyGen);
+    }
+    if (verbose || threadContext->id == 0) {
+      fprintf(stderr,"*info* [t%zd] lazy positions: %zd blocks of %.0lf KiB per pass, a window of %zd positions (%.1lf MiB)\n", threadContext->id, threadContext->lazyGen.count, TOKiB(threadContext->lazyGen.slot), threadContext->pos.sz, TOMiB(threadContext->pos.sz * sizeof(positionType)));
+    }
+  } else {
+    positionContainerCreatePositions(&threadContext->pos, threadContext->jobdeviceid, threadContext->seqFiles, threadContext->seqFilesMaxSizeBytes, threadContext->rw, &threadContext->len, MIN(4096,threadContext->blockSize), threadContext->startingBlock, threadContext->minbdSize, threadContext->maxbdSize, threadContext->seed, threadContext->mod, threadContext->remain, threadContext->fourkEveryMiB, threadContext->jumpK, threadContext->firstPPositions);
 
-  for (size_t e = 0; e < threadContext->pos.sz; e++) {
-    assert(threadContext->pos.positions[e].len > 0);
-  }
-  
+    for (size_t e = 0; e < threadContext->pos.sz; e++) {
+      assert(threadContext->pos.positions[e].len > 0);
+    }
 
-  if (verbose >= 2) {
-    positionContainerCheck(&threadContext->pos, threadContext->minbdSize, threadContext->maxbdSize, threadContext->metaData ? 0 : 1 /*don't exit if meta*/);
-  }
 
-  if (threadContext->seqFiles == 0 || threadContext->firstPPositions) positionContainerRandomize(&threadContext->pos, threadContext->seed);
+    if (verbose >= 2) {
+      positionContainerCheck(&threadContext->pos, threadContext->minbdSize, threadContext->maxbdSize, threadContext->metaData ? 0 : 1 /*don't exit if meta*/);
+    }
+
+    if (threadContext->seqFiles == 0 || threadContext->firstPPositions) positionContainerRandomize(&threadContext->pos, threadContext->seed);
 
-  if (threadContext->jumbleRun) positionContainerJumble(&threadContext->pos, threadContext->jumbleRun, threadContext->seed);
+    if (threadContext->jumbleRun) positionContainerJumble(&threadContext->pos, threadContext->jumbleRun, threadContext->seed);
 
-  if (threadContext->jmodonly) positionContainerModOnly(&threadContext->pos, threadContext->jmodonly, threadContext->id);
+    if (threadContext->jmodonly) positionContainerModOnly(&threadContext->pos, threadContext->jmodonly, threadContext->id);
 
-  //      positionPrintMinMax(threadContext->pos.positions, threadContext->pos.sz, threadContext->minbdSize, threadContext->maxbdSize, threadContext->minSizeInBytes, threadContext->maxSizeInBytes);
-  threadContext->anywrites = (threadContext->rw.wprob > 0) || (threadContext->rw.tprob > 0);
-  //  calcLBA(&threadContext->pos); // calc LBA coverage
+    if (threadContext->skew.type != SKEW_NONE) positionContainerSkew(&threadContext->pos, &threadContext->skew, threadContext->seed, verbose || threadContext->id == 0);
 
+    //      positionPrintMinMax(threadContext->pos.positions, threadContext->pos.sz, threadContext->minbdSize, threadContext->maxbdSize, threadContext->minSizeInBytes, threadContext->maxSizeInBytes);
+    //  calcLBA(&threadContext->pos); // calc LBA coverage
 
-  if (threadContext->uniqueSeeds) {
-    positionContainerUniqueSeeds(&threadContext->pos, threadContext->seed, threadContext->verifyUnique);
-  } else if (threadContext->metaData) {
-    positionContainerAddMetadataChecks(&threadContext->pos, threadContext->metaData);
-  }
+    if (threadContext->uniqueSeeds) {
+      positionContainerUniqueSeeds(&threadContext->pos, threadContext->seed, threadContext->verifyUnique);
+    } else if (threadContext->metaData) {
+      positionContainerAddMetadataChecks(&threadContext->pos, threadContext->metaData);
+    }
 
-  if (threadContext->iopstarget) {
-    positionContainerAddDelay(&threadContext->pos, threadContext->iopstarget, threadContext->id, threadContext->iopsdecrease);
+    if (threadContext->iopstarget) {
+      positionContainerAddDelay(&threadContext->pos, threadContext->iopstarget, threadContext->id, threadContext->iopsdecrease);
+    }
   }
+  threadContext->anywrites = (threadContext->rw.wprob > 0) || (threadContext->rw.tprob > 0);
 
   if (threadContext->dumpPos /* && !iRandom*/) {
     positionContainerDump(&threadContext->pos, threadContext->dumpPos);
   }
 
 
-  CALLOC(threadContext->randomBuffer, threadContext->highBlockSize, 1);
+  // the thread is already pinned, so this memory is allocated and faulted on its own NUMA node
+  arenaInit(&threadContext->arena, threadContext->jobnuma);
+  threadContext->randomBuffer = arenaAlloc(&threadContext->arena, threadContext->highBlockSize);
   memset(threadContext->randomBuffer, 0, threadContext->highBlockSize);
   generateRandomBufferCyclic(threadContext->randomBuffer, threadContext->highBlockSize, threadContext->seed, threadContext->highBlockSize);
 
@@ -377,6 +438,36 @@ static void *runThread(void *arg)
     fprintf(stderr,"*****************\n");
   }
 
+  // polled completions only work with O_DIRECT, no flushes, and a queue that has poll queues
+  if (threadContext->iopoll) {
+    const int io_poll = getIOPoll(suffix);
+    if (io_poll <= 0) {
+      fprintf(stderr,"*warning* [t%zd] polled I/O needs /sys/block/%s/queue/io_poll to be 1 (%s), using interrupts\n", threadContext->id, suffix ? suffix : "?", io_poll < 0 ? "not a block device" : "it's 0, check the driver's poll_queues");
+      threadContext->iopoll = 0;
+    } else if (!direct) {
+      fprintf(stderr,"*warning* [t%zd] polled I/O needs O_DIRECT, using interrupts\n", threadContext->id);
+      threadContext->iopoll = 0;
+    } else if (threadContext->flushEvery) {
+      fprintf(stderr,"*warning* [t%zd] polled I/O can't flush, using interrupts\n", threadContext->id);
+      threadContext->iopoll = 0;
+    }
+  }
+
+  // the shared event loop only does libaio reads, writes and flushes
+  if (threadContext->loop) {
+    const char *why = NULL;
+    if (threadContext->engine != ENGINE_LIBAIO || threadContext->pollRing) why = "io_uring";
+    else if (threadContext->splitReap) why = "a split reaper";
+    else if (threadContext->rw.tprob > 0) why = "trims";
+    else if (threadContext->QDbarrier || threadContext->flushBarrier) why = "barriers";
+    else if (threadContext->lazy) why = "lazy positions";
+    else if (threadContext->trace) why = "trace replay";
+    if (why) {
+      fprintf(stderr,"*warning* [t%zd] the shared event loop can't do %s, using the job's own thread\n", threadContext->id, why);
+      threadContext->loop = NULL;
+    }
+  }
+
   if (!threadContext->exec && (threadContext->finishSeconds < threadContext->runSeconds)) {
     fprintf(stderr,"*warning* timing %.1lf > %.1lf doesn't make sense\n", threadContext->runSeconds, threadContext->finishSeconds);
   }
@@ -387,7 +478,12 @@ static void *runThread(void *arg)
   for (int i = 0; i < (int)threadContext->pos.sz; i++) {
     sumrange += threadContext->pos.positions[i].len;
   }
-  if ((threadContext->id == 0) && (sumrange < outerrange*0.99)) {
+  // a pass over the device is longer than the array with lazy positions
+  const size_t passPositions = threadContext->lazy ? threadContext->lazyGen.count : threadContext->pos.sz;
+  if (threadContext->lazy) {
+    sumrange = threadContext->lazyGen.count * threadContext->lazyGen.slot;
+  }
+  if ((threadContext->id == 0) && (sumrange < outerrange*0.99) && !threadContext->trace) {
     fprintf(stderr,"*warning* the range covered (%zd positions covering %.3lf GiB) is < 99%% of available range (%.3lf GiB)\n", threadContext->pos.sz, TOGiB(sumrange), TOGiB(outerrange));
   }
   if (verbose >= 1)
@@ -443,7 +539,7 @@ static void *runThread(void *arg)
       timeLimit = INF_SECONDS;
       doRounds = 1; // but do if nN with x
     } else if (threadContext->positionLimit || threadContext->runonce) {
-      posLimit = threadContext->pos.sz;
+      posLimit = passPositions;
       totalPosLimit = posLimit * iteratorMax;
       timeLimit = INF_SECONDS;
       if (threadContext->runonce) {
@@ -458,14 +554,14 @@ static void *runThread(void *arg)
     // if we specify xn
     roundByteLimit = outerrange * threadContext->LBAtimes;
   } else if (threadContext->positionLimit) {
-    posLimit = threadContext->pos.sz * threadContext->positionLimit;
+    posLimit = passPositions * threadContext->positionLimit;
   }
 
   if (threadContext->posIncrement) {
     if (posLimit) {
       posLimit = posLimit / threadContext->posIncrement;
     } else {
-      posLimit = threadContext->pos.sz / threadContext->posIncrement;
+      posLimit = passPositions / threadContext->posIncrement;
     }
     fprintf(stderr,"*info* posLimit = %zd\n", posLimit);
   }
@@ -489,6 +585,10 @@ static void *runThread(void *arg)
     fprintf(stderr,"*info* discardInfo: alignment_offset %zd / max %zd / granularity %zd / zeroes_data %zd\n", alignment_offset, discard_max_bytes, discard_granularity, discard_zeroes_data);
   }
 
+  if (threadContext->engine != ENGINE_LIBAIO && (verbose || threadContext->id == 0)) {
+    fprintf(stderr,"*info* [t%zd] using the io_uring engine%s%s\n", threadContext->id, threadContext->engine == ENGINE_URING_SQPOLL ? " with SQPOLL" : "", threadContext->iopoll ? ", polled completions" : "");
+  }
+
   if (threadContext->rw.tprob > 0 || threadContext->performPreDiscard) {
     if (discard_max_bytes == 0) {
       fprintf(stderr,"*error* TRIM/DISCARD is not supported and it has been specified\n");
@@ -497,6 +597,10 @@ static void *runThread(void *arg)
 
 
   size_t totalB = 0, ioerrors = 0, totalP = 0;
+
+  struct rusage cpustart;
+  getrusage(RUSAGE_THREAD, &cpustart);
+  const double loopstart = timedouble();
   
   while (keepRunning) {
 
@@ -508,7 +612,16 @@ static void *runThread(void *arg)
 
     if (verbose) fprintf(stderr,"*iteration* %zd\n", iteratorCount);
 
-    totalB += aioMultiplePositions(&threadContext->pos, threadContext->pos.sz, timedouble() + timeLimit, roundByteLimit, threadContext->queueDepth, -1 /* verbose */, 0, MIN(logbs, threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, posLimit , 1, fd, threadContext->flushEvery, &ioerrors, threadContext->QDbarrier, discard_max_bytes, threadContext->fp, threadContext->jobdevice, threadContext->posIncrement);
+    if (threadContext->loop) {
+      // this thread sleeps while the loop thread does the I/O
+      aioDeviceType *dev = aioDeviceOpen(&threadContext->pos, threadContext->pos.sz, timeStamp() + timeLimit, roundByteLimit, threadContext->queueDepth, -1 /* verbose */, 0, MIN(logbs, threadContext->blockSize), posLimit, fd, threadContext->flushEvery, threadContext->fp, threadContext->jobdevice, threadContext->posIncrement, &threadContext->arena);
+      if (dev) {
+        eventLoopRun(threadContext->loop, dev);
+        totalB += aioDeviceClose(dev, &ios, &shouldReadBytes, &shouldWriteBytes, &ioerrors);
+      }
+    } else {
+      totalB += aioMultiplePositions(&threadContext->pos, threadContext->pos.sz, timeStamp() + timeLimit, roundByteLimit, threadContext->queueDepth, -1 /* verbose */, 0, MIN(logbs, threadContext->blockSize), &ios, &shouldReadBytes, &shouldWriteBytes, posLimit , 1, fd, threadContext->flushEvery, &ioerrors, threadContext->QDbarrier, discard_max_bytes, threadContext->fp, threadContext->jobdevice, threadContext->posIncrement, threadContext->engine, threadContext->iopoll, threadContext->pollRing, threadContext->flushBarrier, threadContext->trimQD, threadContext->splitReap, &threadContext->arena, threadContext->lazy ? &threadContext->lazyGen : NULL);
+    }
     totalP += posLimit;
 
     if (!doRounds) break;
@@ -536,11 +649,15 @@ static void *runThread(void *arg)
       }
     }
     if (keepRunning && doRounds && (iteratorCount < iteratorMax)) {
-      if (threadContext->rerandomize) {
+      if (threadContext->lazy) {
+        if (threadContext->rerandomize) {
+          lazyPositionsSeed(&threadContext->lazyGen, threadContext->seed + iteratorCount); // a new permutation from the start
+        }
+      } else if (threadContext->rerandomize) {
         fprintf(stderr,"*info* shuffling positions, 1st = %zd\n", threadContext->pos.positions[0].pos);
         positionContainerRandomize(&threadContext->pos, threadContext->seed + iteratorCount);
       }
-      if (threadContext->addBlockSize) {
+      if (threadContext->addBlockSize && !threadContext->lazy) {
         fprintf(stderr,"*info* adding %zd to all positions, 1st = %zd\n", threadContext->highBlockSize, threadContext->pos.positions[0].pos);
         positionAddBlockSize(threadContext->pos.positions, threadContext->pos.sz, threadContext->highBlockSize, threadContext->minbdSize, threadContext->maxbdSize);
       }
@@ -553,11 +670,51 @@ static void *runThread(void *arg)
   }
   if (suffix) free(suffix);
 
+  {
+    struct rusage cpuend;
+    getrusage(RUSAGE_THREAD, &cpuend);
+    const double loopelapsed = timedouble() - loopstart;
+    const double usr = (cpuend.ru_utime.tv_sec - cpustart.ru_utime.tv_sec) + (cpuend.ru_utime.tv_usec - cpustart.ru_utime.tv_usec) / 1000000.0;
+    const double sys = (cpuend.ru_stime.tv_sec - cpustart.ru_stime.tv_sec) + (cpuend.ru_stime.tv_usec - cpustart.ru_stime.tv_usec) / 1000000.0;
+    const size_t totalIOs = threadContext->pos.readIOs + threadContext->pos.writtenIOs;
+
+    const double reap = threadContext->pos.reaperCPU; // the split reaper threads, if any
+
+    if (verbose || threadContext->pollRing || threadContext->iopoll || threadContext->splitReap) {
+      fprintf(stderr,"*info* [t%zd] %.0lf IOPS, CPU %.1lf%% (user %.1lf%%, sys %.1lf%%, reaper %.1lf%%), %.2lf us CPU per I/O%s%s%s\n", threadContext->id, totalIOs / loopelapsed, (usr + sys + reap) * 100.0 / loopelapsed, usr * 100.0 / loopelapsed, sys * 100.0 / loopelapsed, reap * 100.0 / loopelapsed, totalIOs ? (usr + sys + reap) * 1000000.0 / totalIOs : 0, threadContext->pollRing ? ", polling the completion ring" : "", threadContext->iopoll ? ", polled I/O" : "", threadContext->splitReap ? ", split submit/reap" : "");
+    }
+    if (verbose) {
+      fprintf(stderr,"*info* [t%zd] %zd syscalls for %zd I/Os, %.3lf syscalls per I/O\n", threadContext->id, threadContext->pos.syscalls, totalIOs, totalIOs ? threadContext->pos.syscalls * 1.0 / totalIOs : 0);
+      fprintf(stderr,"*info* [t%zd] buffer arena %.1lf MiB, %s pages, NUMA %d\n", threadContext->id, TOMiB(arenaBytes(&threadContext->arena)), arenaPagesString(&threadContext->arena), threadContext->jobnuma);
+    }
+    if (verbose && threadContext->lazy) {
+      fprintf(stderr,"*info* [t%zd] lazy positions: %zd generated, %zd waits for the last lap's I/O, %zd kept\n", threadContext->id, threadContext->lazyGen.generated, threadContext->lazyGen.stalls, threadContext->lazyGen.kept);
+      if ((verbose >= 3) && threadContext->lazyGen.skew) {
+        char prefix[20];
+        snprintf(prefix, sizeof(prefix), "[t%zd]", threadContext->id);
+        skewCountCheck(&threadContext->lazyGen.skewCount, prefix);
+      }
+    }
+    if ((verbose || threadContext->metaData) && (threadContext->pos.dependencyWaits || threadContext->pos.pauseBarriers)) {
+      fprintf(stderr,"*info* [t%zd] %zd reads waited on the write they verify, instead of %zd full queue drains\n", threadContext->id, threadContext->pos.dependencyWaits, threadContext->pos.pauseBarriers);
+    }
+  }
 
   if (verbose >= 2) {
     fprintf(stderr,"*info [thread %zd] finished '%s'\n", threadContext->id, threadContext->jobstring);
   }
   threadContext->pos.elapsedTime = timedouble() - starttime;
+  // the I/O buffers aren't needed after the last round, give them back before the verify
+  arenaFree(&threadContext->arena);
+  threadContext->randomBuffer = NULL;
+  if (threadContext->lazyKeep) {
+    lazyPositionsRestore(&threadContext->lazyGen, &threadContext->pos);
+  }
+  if (threadContext->trace && (verbose >= 3)) {
+    char prefix[20];
+    snprintf(prefix, sizeof(prefix), "[t%zd]", threadContext->id);
+    traceCheckPositions(threadContext->trace, &threadContext->pos, threadContext->replaySpeed, prefix);
+  }
 
   pthread_mutex_lock(threadContext->gomutex);
   (*threadContext->go_finished)++;
@@ -1020,6 +1177,9 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
 
   keepRunning = 1;
 
+  // the submit/finish stamp clock, calibrated once
+  clockSetup(verbose);
+
   //  if (notexclusive) {
   //    fprintf(stderr,"*warning* specifying to open devices without O_EXCL\n");
   //  }
@@ -1080,6 +1240,7 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
     threadContext[i].allPC = allThreadsPC;
   }
 
+  int patternWarned = 0;
   for (int i = 0; i < num; i++) {
     size_t localminbdsize = minSizeInBytes, localmaxbdsize = maxSizeInBytes;
     threadContext[i].runSeconds = runseconds;
@@ -1247,6 +1408,28 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
       }
     }
 
+    // e (zipf), H (hot set) or V (pareto) skew
+    if (skewParse(&threadContext[i].skew, job->strings[i]) != SKEW_NONE) {
+      if (threadContext[i].skew.type == SKEW_ZIPF) fprintf(stderr,"*info* zipf access, theta %g\n", threadContext[i].skew.theta);
+      else if (threadContext[i].skew.type == SKEW_HOT) fprintf(stderr,"*info* hot set access, %g%% of the I/O to %g%% of the blocks\n", threadContext[i].skew.hotIO * 100, threadContext[i].skew.hotLBA * 100);
+      else fprintf(stderr,"*info* pareto access, %g%% of the I/O to %g%% of the blocks, recursively\n", (1 - threadContext[i].skew.paretoH) * 100, threadContext[i].skew.paretoH * 100);
+    }
+
+    // 'C' writes data with a compression and dedupe ratio, C on its own is incompressible
+    if (dataPatternParse(&threadContext[i].pattern, job->strings[i])) {
+      threadContext[i].pos.pattern = &threadContext[i].pattern;
+      if (verbose || (i == 0)) {
+        char prefix[20];
+        snprintf(prefix, sizeof(prefix), "[t%d]", i);
+        dataPatternReport(&threadContext[i].pattern, prefix);
+      }
+      if (verify && !patternWarned) {
+        // the positions files don't have the UUID, so it can't go in the pattern
+        fprintf(stderr,"*warning* the C data only depends on the seed and offset, so -v can't tell a block from one an earlier run wrote with the same seed. Leave out -R and R so each run gets its own seed\n");
+        patternWarned = 1;
+      }
+    }
+
     double fourkEveryMiB = 0;
     {
       char *sf = strchr(job->strings[i], 'a');
@@ -1291,6 +1474,52 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
       }
     }
 
+    // 'i' is the io_uring engine, 'i2' also turns on SQPOLL
+    threadContext[i].engine = ENGINE_LIBAIO;
+    {
+      char *iU = strchr(job->strings[i], 'i');
+      if (iU) {
+        threadContext[i].engine = ENGINE_URING;
+        if (*(iU+1) == '2') {
+          threadContext[i].engine = ENGINE_URING_SQPOLL;
+        }
+      }
+    }
+
+    // 'h' is polled (IOPOLL) completions, which needs io_uring
+    threadContext[i].iopoll = 0;
+    if (strchr(job->strings[i], 'h')) {
+      threadContext[i].iopoll = 1;
+      if (threadContext[i].engine == ENGINE_LIBAIO) {
+        threadContext[i].engine = ENGINE_URING;
+      }
+    }
+
+    // 'd' splits the job into a submitter thread and a reaper thread
+    threadContext[i].splitReap = 0;
+    if (strchr(job->strings[i], 'd')) {
+      threadContext[i].splitReap = 1;
+    }
+
+    // 'o' or 'oN' has the job's I/O driven by shared event loop thread N
+    threadContext[i].eventLoopGroup = -1;
+    threadContext[i].loop = NULL;
+    {
+      char *oN = strchr(job->strings[i], 'o');
+      if (oN) {
+        threadContext[i].eventLoopGroup = isdigit(*(oN+1)) ? atoi(oN+1) : 0;
+      }
+    }
+
+    // 'l' generates positions as the I/O runs instead of all of them up front
+    threadContext[i].lazy = (strchr(job->strings[i], 'l') != NULL);
+
+    // 'c' reaps by polling the completion ring in userspace
+    threadContext[i].pollRing = 0;
+    if (strchr(job->strings[i], 'c')) {
+      threadContext[i].pollRing = 1;
+    }
+
     // 'O' is really 'X1'
     threadContext[i].runonce = 0;
     {
@@ -1355,11 +1584,51 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
         lengthsSetupLowHighAlignSeq(&threadContext[i].len, bs, highbs, 4096);
       else
         lengthsSetupLowHighAlignPower(&threadContext[i].len, bs, highbs, 4096);
+    } else if (job->lengths && !strchr(job->strings[i], 'M')) {
+      // the -k size distribution
+      lengthsCopy(&threadContext[i].len, job->lengths);
+      bs = lengthsMin(&threadContext[i].len);
+      highbs = lengthsMax(&threadContext[i].len);
     } else {
       lengthsAdd(&threadContext[i].len, bs, 1);
     }
+    threadContext[i].trace = job->trace;
+    if (job->trace) {
+      highbs = MAX(highbs, job->trace->maxLen); // the buffers fit the largest traced I/O
+    }
     threadContext[i].blockSize = bs;
     threadContext[i].highBlockSize = highbs;
+    if (verbose >= 3) {
+      char prefix[20];
+      snprintf(prefix, sizeof(prefix), "[t%d]", i);
+      lengthsCheck(&threadContext[i].len, prefix);
+    }
+
+    // 'g' stamps every 4 KiB sector with a header, g512 every 512 bytes, to find torn writes
+    threadContext[i].pos.sectorSize = sectorHeaderParse(job->strings[i]);
+    if (threadContext[i].pos.sectorSize) {
+      if (threadContext[i].blockSize < threadContext[i].pos.sectorSize) {
+	fprintf(stderr,"*error* the block size %zd is smaller than the %zd byte sector headers\n", threadContext[i].blockSize, threadContext[i].pos.sectorSize);
+	exit(1);
+      }
+      if (verbose || (i == 0)) {
+	fprintf(stderr,"*info* [t%d] sector headers every %zd bytes: LBA, UUID, seed, write generation and CRC32C\n", i, threadContext[i].pos.sectorSize);
+      }
+      if (threadContext[i].pos.pattern && (threadContext[i].pattern.dedupe > 1) && (i == 0)) {
+	fprintf(stderr,"*warning* sector headers make every sector unique, the C dedupe ratio won't hold\n");
+      }
+    }
+
+    // 'v' scales the replayed trace's times, v2 is twice as fast, v0.5 half speed, v0 as fast as possible
+    threadContext[i].replaySpeed = 1;
+    {
+      char *vChar = strchr(job->strings[i], 'v');
+      if (vChar) {
+        threadContext[i].replaySpeed = (*(vChar+1)) ? MAX(0, atof(vChar + 1)) : 0;
+        if (!job->trace && (i == 0)) fprintf(stderr,"*warning* 'v' only applies to a -W trace replay\n");
+      }
+      if (job->trace && !job->trace->timed) threadContext[i].replaySpeed = 0;
+    }
 
 
     size_t qDepth = origqd, QDbarrier = 0;
@@ -1454,7 +1723,7 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
 
 
     if ((ramBytesForPositions || verbose || (fitinram < mp)) && (i==0)) {
-      fprintf(stderr,"*info* using %.3lf GiB RAM for positions (%d threads, %ld record size), we can store max ", TOGiB(useRAM), num, sizeof(positionType));
+      fprintf(stderr,"*info* using %.3lf GiB RAM for positions (%d threads, %ld bytes per position, was %d), we can store max ", TOGiB(useRAM), num, sizeof(positionType), POSITION_OLDBYTES);
       commaPrint0dp(stderr, fitinram);
       fprintf(stderr," positions in RAM\n");
     }
@@ -1532,6 +1801,15 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
       }
     }
 
+    if (job->trace) {
+      // the actions come from the trace, flushes go with the writes
+      const traceType *t = job->trace;
+      const double n = t->reads + t->writes + t->trims + t->flushes;
+      rprob = t->reads / n;
+      wprob = (t->writes + t->flushes) / n;
+      tprob = t->trims / n;
+    }
+
     threadContext[i].rw.rprob = rprob;
     threadContext[i].rw.wprob = wprob;
     threadContext[i].rw.tprob = tprob;
@@ -1552,6 +1830,21 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
     }
     threadContext[i].flushEvery = flushEvery;
 
+    // the number of trims the discard workers have outstanding, E4 is four at a time
+    threadContext[i].trimQD = 1;
+    {
+      char *eChar = strchr(job->strings[i], 'E');
+      if (eChar && *(eChar+1)) {
+        threadContext[i].trimQD = MAX(1, atoi(eChar + 1));
+      }
+    }
+
+    // flushes overlap other I/O unless 'Y' asks for barrier ordering
+    threadContext[i].flushBarrier = 0;
+    if (strchr(job->strings[i], 'Y')) {
+      threadContext[i].flushBarrier = 1;
+    }
+
 
 
     {
@@ -1726,6 +2019,33 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
     if (threadContext[i].firstPPositions) mp = MIN(mp, threadContext[i].firstPPositions); // min of calculated and specified
 
     mp = MIN(sizeLimitCount, MIN(countintime, MIN(mp, fitinram)));
+    if (threadContext[i].lazy) {
+      mp = lazyPositionsWindow(qDepth); // the whole device is covered whatever the RAM
+      if (metaData || uniqueSeeds || threadContext[i].iopstarget || threadContext[i].jumbleRun) {
+	if (i == 0) fprintf(stderr,"*warning* lazy positions don't do 'm', 'u', 'U', 'S' or shuffle runs, ignoring them\n");
+	metaData = 0;
+	uniqueSeeds = 0;
+	threadContext[i].iopstarget = 0;
+	threadContext[i].jumbleRun = 0;
+      }
+    }
+    if (threadContext[i].trace) {
+      mp = threadContext[i].trace->count; // the whole trace whatever the time or RAM
+      if (threadContext[i].lazy || metaData || uniqueSeeds || threadContext[i].iopstarget || threadContext[i].jumbleRun || threadContext[i].rerandomize || threadContext[i].addBlockSize || threadContext[i].skew.type != SKEW_NONE) {
+	if (i == 0) fprintf(stderr,"*warning* trace replay doesn't do 'l', 'm', 'u', 'U', 'S', 'n', 'N', shuffle runs or skew, ignoring them\n");
+	threadContext[i].lazy = 0;
+	metaData = 0;
+	uniqueSeeds = 0;
+	threadContext[i].iopstarget = 0;
+	threadContext[i].jumbleRun = 0;
+	threadContext[i].rerandomize = 0;
+	threadContext[i].addBlockSize = 0;
+	threadContext[i].skew.type = SKEW_NONE;
+      }
+    }
+    // the window is regenerated as the I/O runs, so each half's completed positions are put
+    // aside first for the verify or the positions file
+    threadContext[i].lazyKeep = threadContext[i].lazy && (verify || (savePositions && (savePositions != stdout)));
     
     if (mp <= qDepth) { // check qd isn't too high
       qDepth = mp;
@@ -1817,12 +2137,43 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
     fprintf( stderr, "*info* NUMA binding disabled\n" );
   }
 
+  // -P - streams every completion, written by one thread off the I/O path
+  if (savePositions == stdout) {
+    positionStreamStart(fileno(stdout));
+  }
+
+  // the shared event loops, one thread for each 'oN' group
+  int numLoops = 0;
+  for (int i = 0; i < num; i++) {
+    if (threadContext[i].eventLoopGroup >= numLoops) numLoops = threadContext[i].eventLoopGroup + 1;
+  }
+  eventLoopType *loops = NULL;
+  if (numLoops) {
+    CALLOC(loops, numLoops, sizeof(eventLoopType));
+    int loopThreads = 0, loopJobs = 0;
+    for (int l = 0; l < numLoops; l++) {
+      loops[l].epfd = -1;
+      for (int i = 0; i < num; i++) {
+	if (threadContext[i].eventLoopGroup == l) {
+	  if (loops[l].epfd < 0) {
+	    eventLoopStart(&loops[l], l);
+	    loopThreads++;
+	  }
+	  threadContext[i].loop = &loops[l];
+	  loopJobs++;
+	}
+      }
+    }
+    fprintf(stderr,"*info* %d jobs driven by %d event loop thread(s)\n", loopJobs, loopThreads);
+  }
+
   for (int tid = 0; tid < num; tid++) {
     char s[100];
     sprintf(s,"spit-t%d", tid);
-    pthread_create(&(pt[tid]), NULL, runThread, &(threadContext[tid]));
-    pthread_setname_np(pt[tid], strdup(s));
 
+    // pin before the thread starts, so everything it allocates is on its node
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
     if( do_numa ) {
 
       long numa = 0;
@@ -1838,7 +2189,7 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
       }
 
       ++numa_thread_counter[ numa ];
-      int rc = pinThread( &pt[tid], numa_threads[ numa ], cpuCountPerNuma( numa ) );
+      int rc = pinThreadAttr( &attr, numa_threads[ numa ], cpuCountPerNuma( numa ) );
       if (rc) {
         fprintf(stderr,"*error* failed to pin thread %d to NUMA %ld\n", tid, numa);
         exit(-1);
@@ -1848,6 +2199,10 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
         fprintf( stderr, "*info* pinned thread %d to NUMA %ld\n", tid, numa);
       }
     }
+
+    pthread_create(&(pt[tid]), &attr, runThread, &(threadContext[tid]));
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(pt[tid], strdup(s));
   }
 
   if(verbose >=2 ) {
@@ -1878,9 +2233,30 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
     lengthsFree(&threadContext[i].len);
   }
   keepRunning = 0; // the
+  if (loops) {
+    for (int l = 0; l < numLoops; l++) {
+      if (loops[l].epfd >= 0) {
+	eventLoopStop(&loops[l]);
+	if (verbose) {
+	  fprintf(stderr,"*info* event loop %d: %zd device rounds, %zd passes, CPU %.2lf s\n", l, loops[l].devices, loops[l].passes, loops[l].cpu);
+	}
+      }
+    }
+    free(loops);
+  }
+  positionStreamStop();
   // now wait for the timer thread (probably don't need this)
   pthread_join(pt[num], NULL);
 
+  {
+    size_t hits, misses, evictions, entries, bytes;
+    bufferCacheStats(&hits, &misses, &evictions, &entries, &bytes);
+    if (verbose && (hits + misses)) {
+      fprintf(stderr,"*info* write buffer cache: %zd hits, %zd misses (%.1lf%% hit), %zd evictions, %zd buffers, %.1lf MiB\n", hits, misses, hits * 100.0 / (hits + misses), evictions, entries, TOMiB(bytes));
+    }
+    bufferCacheFree();
+  }
+
   if (result) {
     result->writeIOPS = threadContext[num].result_writeIOPS;
     result->readIOPS = threadContext[num].result_readIOPS;
@@ -1913,7 +2289,12 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
   positionContainer mergedpc = positionContainerMerge(origpc, num);
 
   if (savePositions && (savePositions != stdout)) {
-    positionContainerSave(&mergedpc, savePositions, mergedpc.maxbdSize, 0, job);
+    int logFlags = 0;
+    if (positionLogIsBinary(savePositions, &logFlags)) {
+      positionLogSave(&mergedpc, savePositions, mergedpc.maxbdSize, job, logFlags);
+    } else {
+      positionContainerSave(&mergedpc, savePositions, mergedpc.maxbdSize, 0, job);
+    }
     latencyOverTime(&mergedpc);
     fclose(savePositions);
   }
@@ -1938,7 +2319,6 @@ void jobRunThreads(jobType *job, const int num, char *filePrefix,
   // free
   for (int i = 0; i < num; i++) {
     positionContainerFree(&threadContext[i].pos);
-    free(threadContext[i].randomBuffer);
   }
 
 
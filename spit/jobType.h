@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include "devices.h"
 #include "diskStats.h"
+#include "lengths.h"
+
+struct traceType; // traceReplay.h
 
 typedef struct {
   int count;
@@ -12,6 +15,8 @@ typedef struct {
   int *deviceid;
   double *delay;
   int *suggestedNUMA;
+  const lengthsType *lengths; // -k, for the jobs without a k or M block size
+  const struct traceType *trace; // -W, replayed by every job
 } jobType;
 
 
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "bufferKernels.h"
+
+/*
+ * kernelbench: GB/s of the write data kernels, the splitmix fill, the compare, the checksum and
+ * the sector header stamp, at each level the CPU supports. Each one is checked against the scalar
+ * version first, so this is also the test for the SIMD kernels
+ */
+
+volatile int keepRunning = 1;
+int verbose = 0;
+
+
+static void usage(void)
+{
+  fprintf(stderr,"Usage:\n  kernelbench [-s KiB] [-t seconds]\n");
+  fprintf(stderr,"\nReports the GB/s of the buffer kernels at each level the CPU supports\n");
+  fprintf(stderr,"  -s n  buffer size in KiB (default 256)\n");
+  fprintf(stderr,"  -t n  seconds per kernel (default 0.5)\n");
+}
+
+
+// the same answer as the scalar kernels, at every length up to a few blocks and from odd offsets
+static int crossCheck(const int level, char *a, char *b, const size_t size)
+{
+  int bad = 0;
+  const size_t maxlen = MIN(size, 1100);
+
+  for (size_t words = 0; words < maxlen / 8; words++) {
+    const uint64_t x = words * 0x12345678ULL;
+    kernelsSelect(KERNELS_SCALAR);
+    bufferFillSplitmix(a, words, x);
+    kernelsSelect(level);
+    memset(b, 0, words * 8);
+    bufferFillSplitmix(b, words, x);
+    if (memcmp(a, b, words * 8) != 0) {
+      fprintf(stderr,"*error* %s fill differs with %zd words\n", kernelsName(level), words);
+      bad++;
+      break;
+    }
+  }
+
+  for (size_t off = 0; off < 8; off++) {
+    for (size_t len = 0; off + len <= maxlen; len++) {
+      kernelsSelect(KERNELS_SCALAR);
+      const size_t s1 = bufferChecksum(a + off, len);
+      kernelsSelect(level);
+      const size_t s2 = bufferChecksum(a + off, len);
+      if (s1 != s2) {
+	fprintf(stderr,"*error* %s checksum differs at offset %zd, length %zd\n", kernelsName(level), off, len);
+	bad++;
+	break;
+      }
+    }
+  }
+
+  memcpy(b, a, maxlen);
+  for (size_t len = 1; len <= maxlen; len++) {
+    for (size_t at = (len > 80) ? len - 80 : 0; at <= len; at++) {
+      if (at < len) b[at] ^= 0x80;
+      const size_t m = bufferMismatch(a, b, len);
+      if (at < len) b[at] ^= 0x80;
+      if (m != at) {
+	fprintf(stderr,"*error* %s mismatch found %zd instead of %zd, length %zd\n", kernelsName(level), m, at, len);
+	bad++;
+	len = maxlen;
+	break;
+      }
+    }
+  }
+
+  // the sector headers, on the random data still in a
+  const char header[32] = "SPT1....LBA.....UUID....gen.sd..";
+  for (size_t sectorSize = 512; sectorSize <= 4096; sectorSize *= 8) {
+    for (size_t sectors = 1; sectors <= MIN(9, size / sectorSize); sectors++) {
+      memcpy(b, a, sectors * sectorSize);
+      kernelsSelect(KERNELS_SCALAR);
+      bufferStampSectors(a, sectors, sectorSize, header);
+      kernelsSelect(level);
+      bufferStampSectors(b, sectors, sectorSize, header);
+      if (memcmp(a, b, sectors * sectorSize) != 0) {
+	fprintf(stderr,"*error* %s sector stamp differs, %zd sectors of %zd bytes\n", kernelsName(level), sectors, sectorSize);
+	bad++;
+	break;
+      }
+    }
+  }
+  return bad;
+}
+
+
+static double rate(const size_t bytes, const size_t iterations, const double elapsed)
+{
+  return (elapsed > 0) ? bytes * (double)iterations / elapsed / 1e9 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  size_t size = 256 * 1024;
+  double seconds = 0.5;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:t:h")) != -1) {
+    switch (opt) {
+    case 's':
+      size = alignedNumber(atof(optarg) * 1024, 4096);
+      if (size < 4096) size = 4096;
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      usage();
+      exit(1);
+    }
+  }
+
+  char *a = aligned_alloc(4096, size), *b = aligned_alloc(4096, size);
+  if (!a || !b) {
+    fprintf(stderr,"*error* can't allocate %zd bytes\n", size);
+    exit(1);
+  }
+
+  const int best = kernelsSelect(-1);
+  fprintf(stderr,"*info* kernels: %s selected, %.0lf KiB buffers, %.2lf s per kernel\n", kernelsName(best), TOKiB(size), seconds);
+
+  int bad = 0;
+  fprintf(stdout, "%-8s %12s %12s %12s %12s\n", "kernel", "fill GB/s", "cmp GB/s", "csum GB/s", "stamp GB/s");
+  for (int level = KERNELS_SCALAR; level <= best; level++) {
+    kernelsSelect(KERNELS_SCALAR);
+    bufferFillSplitmix(a, size / 8, level);
+    bad += crossCheck(level, a, b, size);
+
+    kernelsSelect(level);
+    double start = timedouble();
+    size_t n = 0;
+    do {
+      bufferFillSplitmix(a, size / 8, n++);
+    } while (timedouble() - start < seconds);
+    const double fill = rate(size, n, timedouble() - start);
+
+    memcpy(b, a, size);
+    size_t same = 0;
+    start = timedouble();
+    n = 0;
+    do {
+      same += (bufferMismatch(a, b, size) == size);
+      n++;
+    } while (timedouble() - start < seconds);
+    const double cmp = rate(size, n, timedouble() - start);
+    if (same != n) bad++;
+
+    start = timedouble();
+    n = 0;
+    do {
+      bufferChecksum(a, size);
+      n++;
+    } while (timedouble() - start < seconds);
+    const double csum = rate(size, n, timedouble() - start);
+
+    // a header and a CRC32C every 4 KiB, as g does
+    const char header[32] = {0};
+    start = timedouble();
+    n = 0;
+    do {
+      bufferStampSectors(a, size / 4096, 4096, header);
+      n++;
+    } while (timedouble() - start < seconds);
+    const double stamp = rate(size, n, timedouble() - start);
+
+    fprintf(stdout, "%-8s %12.2lf %12.2lf %12.2lf %12.2lf\n", kernelsName(level), fill, cmp, csum, stamp);
+  }
+  kernelsSelect(-1);
+
+  free(a);
+  free(b);
+
+  if (bad) {
+    fprintf(stderr,"*error* %d kernel(s) disagree with the scalar versions\n", bad);
+    exit(1);
+  }
+  return 0;
+}
@@ -19,26 +19,33 @@
 void latencyClear(latencyType *lat) {
   histSetup(&lat->histRead, 0, 10000, 2e-2);
   histSetup(&lat->histWrite, 0, 10000, 2e-2);
+  histSetup(&lat->histFlush, 0, 10000, 2e-2);
+  histSetup(&lat->histTrim, 0, 10000, 2e-2);
 }  
 
 void latencySetup(latencyType *lat, positionContainer *pc) {
   
-  for (int i = 0; i < (int) pc->sz; i++) if (pc->positions[i].finishTime>0) {
+  for (int i = 0; i < (int) pc->sz; i++) if (pc->positions[i].latency>0) {
     if (pc->positions[i].action == 'R')
-      histAdd(&lat->histRead, 1000 * (pc->positions[i].finishTime - pc->positions[i].submitTime));
+      histAdd(&lat->histRead, 1000 * pc->positions[i].latency);
     else if (pc->positions[i].action == 'W')
-      histAdd(&lat->histWrite, 1000 * (pc->positions[i].finishTime - pc->positions[i].submitTime));
+      histAdd(&lat->histWrite, 1000 * pc->positions[i].latency);
+    else if (pc->positions[i].action == 'T')
+      histAdd(&lat->histTrim, 1000 * pc->positions[i].latency);
+  }
+  for (size_t i = 0; i < pc->flushCount; i++) {
+    histAdd(&lat->histFlush, 1000 * pc->flushLatency[i]);
   }
 }
 void latencySetupSizeonly(latencyType *lat, positionContainer *pc, size_t size) {
   
   for (int i = 0; i < (int) pc->sz; i++)
-    if (pc->positions[i].finishTime>0)
+    if (pc->positions[i].latency>0)
       if (pc->positions[i].len == size) {
 	if (pc->positions[i].action == 'R')
-	  histAdd(&lat->histRead, 1000 * (pc->positions[i].finishTime - pc->positions[i].submitTime));
+	  histAdd(&lat->histRead, 1000 * pc->positions[i].latency);
 	else if (pc->positions[i].action == 'W')
-	  histAdd(&lat->histWrite, 1000 * (pc->positions[i].finishTime - pc->positions[i].submitTime));
+	  histAdd(&lat->histWrite, 1000 * pc->positions[i].latency);
       }
 }
 
@@ -61,15 +68,15 @@ void latencyOverTime(positionContainer *origpc) {
     double lowesttime = 9e9;
     for (size_t i = 0; i <origpc->sz; i++) {
       positionType *p = &origpc->positions[i];
-      if (p->finishTime > 0) {
+      if (p->latency > 0) {
 	if (p->submitTime < lowesttime) lowesttime = p->submitTime;
       }
     }
     
     for (size_t i = 0; i <origpc->sz; i++) {
       positionType *p = &origpc->positions[i];
-      if (p->finishTime > 0) {
-	fprintf(fp, "%lf %lf %c %d\n", p->submitTime - lowesttime, p->finishTime - p->submitTime, p->action, p->len);
+      if (p->latency > 0) {
+	fprintf(fp, "%lf %lf %c %d\n", p->submitTime - lowesttime, p->latency, p->action, p->len);
       }
     }
     fclose(fp);
@@ -85,15 +92,15 @@ void latencyLenVsLatency(positionContainer *origpc, int num) {
   srand48(0);
   size_t count = 0 ;
   for (int n = 0; n < num; n++) {
-    for (int i = 0; i < (int) origpc[n].sz; i++) if (origpc[n].positions[i].finishTime > 0) {
+    for (int i = 0; i < (int) origpc[n].sz; i++) if (origpc[n].positions[i].latency > 0) {
 	if (origpc[n].positions[i].action == 'R') {
 	  count++;
 	  double v = 1 - (drand48()*0.1);
-	  fprintf(fp_r, "%.6lf\t%.6lf\n", origpc[n].positions[i].len * v, origpc[n].positions[i].finishTime - origpc[n].positions[i].submitTime);
+	  fprintf(fp_r, "%.6lf\t%.6lf\n", origpc[n].positions[i].len * v, origpc[n].positions[i].latency);
 	} else if (origpc[n].positions[i].action == 'W') {
 	  count++;
 	  double v = 1 + (drand48()*0.1);
-	  fprintf(fp_w, "%.6lf\t%.6lf\n", origpc[n].positions[i].len * v, origpc[n].positions[i].finishTime - origpc[n].positions[i].submitTime);
+	  fprintf(fp_w, "%.6lf\t%.6lf\n", origpc[n].positions[i].len * v, origpc[n].positions[i].latency);
 	} 
       }
   }
@@ -136,12 +143,24 @@ void latencyStats(latencyType *lat) {
     fprintf(stderr,"*info* write latency: n = %zd, mean = %.3lf ms, median = %.2lf ms, 99.9%% <= %.2lf ms, 99.99%% <= %.2lf ms, 99.999%% <= %.2lf ms\n", histCount(&lat->histWrite), histMean(&lat->histWrite), median, three9, four9, five9);
     histSave(&lat->histWrite, "spit-latency-histogram-write.txt", 1);
   }
+  if (histCount(&lat->histFlush)) {
+    histSumPercentages(&lat->histFlush, &median, &three9, &four9, &five9, 1);
+    fprintf(stderr,"*info* flush latency: n = %zd, mean = %.3lf ms, median = %.2lf ms, 99.9%% <= %.2lf ms, 99.99%% <= %.2lf ms, 99.999%% <= %.2lf ms\n", histCount(&lat->histFlush), histMean(&lat->histFlush), median, three9, four9, five9);
+    histSave(&lat->histFlush, "spit-latency-histogram-flush.txt", 1);
+  }
+  if (histCount(&lat->histTrim)) {
+    histSumPercentages(&lat->histTrim, &median, &three9, &four9, &five9, 1);
+    fprintf(stderr,"*info* trim latency: n = %zd, mean = %.3lf ms, median = %.2lf ms, 99.9%% <= %.2lf ms, 99.99%% <= %.2lf ms, 99.999%% <= %.2lf ms\n", histCount(&lat->histTrim), histMean(&lat->histTrim), median, three9, four9, five9);
+    histSave(&lat->histTrim, "spit-latency-histogram-trim.txt", 1);
+  }
 }
 
 
 void latencyFree(latencyType *lat) {
   histFree(&lat->histRead);
   histFree(&lat->histWrite);
+  histFree(&lat->histFlush);
+  histFree(&lat->histTrim);
 }
 
 
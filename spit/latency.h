@@ -7,6 +7,8 @@
 typedef struct {
   histogramType histRead;
   histogramType histWrite;
+  histogramType histFlush;
+  histogramType histTrim;
 
 } latencyType;
 
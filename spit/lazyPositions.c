@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "lazyPositions.h"
+
+extern int verbose;
+
+#define LAZY_MINWINDOW 65536
+
+
+size_t lazyPositionsWindow(const size_t QD)
+{
+  size_t w = MAX(LAZY_MINWINDOW, 8 * QD);
+  return w + (w & 1);
+}
+
+
+static uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+void lazyPositionsSeed(lazyPositionsType *g, const size_t seed)
+{
+  uint64_t s = seed;
+  for (int i = 0; i < 4; i++) {
+    s += 0x9e3779b97f4a7c15ULL;
+    g->keys[i] = mix64(s);
+  }
+  g->lenseed = seed;
+  g->xsubi[0] = g->xsubi[1] = g->xsubi[2] = seed;
+  g->next = 0;
+  g->fresh[0] = g->fresh[1] = 0;
+}
+
+
+void lazyPositionsInit(lazyPositionsType *g, positionContainer *pc, const unsigned short deviceid, const int sf, const probType rw,
+		       const lengthsType *len, const size_t minbdSize, const size_t maxbdSize, const unsigned short seed)
+{
+  memset(g, 0, sizeof(lazyPositionsType));
+  g->minbdSize = minbdSize;
+  g->slot = lengthsMax(len);
+  assert(g->slot > 0);
+  g->count = (maxbdSize - minbdSize) / g->slot;
+  if (g->count < 1) {
+    fprintf(stderr, "*error* device size [%zd, %zd) is smaller than the block size (%zd)\n", minbdSize, maxbdSize, g->slot);
+    exit(1);
+  }
+  g->sf = sf;
+  g->rw = rw;
+  g->len = len;
+  g->seed = seed;
+  g->deviceid = deviceid;
+
+  g->halfBits = 1;
+  while ((1ULL << (2 * g->halfBits)) < g->count) g->halfBits++;
+  g->halfMask = (1ULL << g->halfBits) - 1;
+  lazyPositionsSeed(g, seed);
+
+  pc->minbs = lengthsMin(len);
+  pc->maxbs = lengthsMax(len);
+  pc->minbdSize = minbdSize;
+  pc->maxbdSize = maxbdSize;
+  g->window = pc->sz;
+  assert((g->window % 2) == 0);
+}
+
+
+static uint64_t feistel(const lazyPositionsType *g, uint64_t x)
+{
+  uint64_t l = x >> g->halfBits, r = x & g->halfMask;
+  for (int i = 0; i < 4; i++) {
+    const uint64_t t = l ^ (mix64(r ^ g->keys[i]) & g->halfMask);
+    l = r;
+    r = t;
+  }
+  return (l << g->halfBits) | r;
+}
+
+
+// the slot for the k'th position of a pass
+uint64_t lazyPositionsIndex(const lazyPositionsType *g, const size_t k)
+{
+  uint64_t idx;
+  const size_t streams = abs(g->sf);
+  if (g->sf == 0) {
+    idx = k;
+    do { // the domain is at most 4x count, so this is a couple of rounds
+      idx = feistel(g, idx);
+    } while (idx >= g->count);
+    return idx;
+  } else if ((streams == 1) || (streams > g->count)) {
+    idx = k;
+  } else {
+    // the first count % streams streams are a block longer, they take the last k's alone
+    const size_t per = g->count / streams, rem = g->count % streams;
+    size_t s = k % streams, step = k / streams;
+    if (k >= per * streams) {
+      s = k - per * streams;
+      step = per;
+    }
+    idx = s * per + MIN(s, rem) + step;
+  }
+  if (g->sf < 0) {
+    idx = g->count - 1 - idx;
+  }
+  return idx;
+}
+
+
+static void generate(lazyPositionsType *g, positionType *p, const size_t n)
+{
+  const size_t minbs = lengthsMin(g->len), maxbs = lengthsMax(g->len);
+  for (size_t i = 0; i < n; i++) {
+    memset(&p[i], 0, sizeof(positionType));
+    const size_t k = g->skew ? skewRank(g->skew, g->xsubi) : g->next;
+    if (g->skew && (verbose >= 3)) skewCountAdd(&g->skewCount, k);
+    p[i].pos = g->minbdSize + lazyPositionsIndex(g, k) * g->slot;
+    p[i].len = (minbs == maxbs) ? minbs : lengthsGet(g->len, &g->lenseed);
+    p[i].seed = g->seed;
+    p[i].deviceid = g->deviceid;
+    if (g->rw.rprob == 1) {
+      p[i].action = 'R';
+    } else if (g->rw.wprob == 1) {
+      p[i].action = 'W';
+    } else {
+      const double d = erand48(g->xsubi);
+      p[i].action = (d <= g->rw.rprob) ? 'R' : (d <= g->rw.rprob + g->rw.wprob) ? 'W' : 'T';
+    }
+    g->next++;
+    if (g->next == g->count) g->next = 0;
+  }
+  g->generated += n;
+}
+
+
+void lazyPositionsFill(lazyPositionsType *g, positionType *positions)
+{
+  generate(g, positions, g->window);
+  g->fresh[0] = g->fresh[1] = 1;
+}
+
+
+// the completed positions in the half, as positionContainerMerge() would keep them. The half is
+// about to be regenerated, so they're packed at the front of it first
+static void keepHalf(lazyPositionsType *g, positionType *p, const size_t n)
+{
+  size_t done = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (p[i].latency != 0) {
+      p[done++] = p[i];
+    }
+  }
+  if (done && (fwrite(p, sizeof(positionType), done, g->keep) != done)) {
+    perror("lazy positions");
+    fprintf(stderr,"*error* can't keep %zd completed positions for the verify/-P\n", done);
+    exit(1);
+  }
+  g->kept += done;
+}
+
+
+int lazyPositionsEnter(lazyPositionsType *g, positionType *positions, const size_t start)
+{
+  const size_t half = g->window / 2;
+  const int h = (start >= half);
+  if (!g->fresh[h]) {
+    positionType *p = positions + h * half;
+    for (size_t i = 0; i < half; i++) {
+      if (p[i].inFlight) {
+	g->stalls++;
+	return 0;
+      }
+    }
+    if (g->keep) {
+      keepHalf(g, p, half);
+    }
+    generate(g, p, half);
+  }
+  g->fresh[h] = 0;
+  return 1;
+}
+
+
+void lazyPositionsKeep(lazyPositionsType *g)
+{
+  g->keep = tmpfile();
+  if (!g->keep) {
+    perror("tmpfile");
+    fprintf(stderr,"*error* can't create a file to keep the lazy positions in\n");
+    exit(1);
+  }
+  g->kept = 0;
+}
+
+
+void lazyPositionsRestore(lazyPositionsType *g, positionContainer *pc)
+{
+  if (!g->keep) return;
+
+  positionType *p = realloc(pc->positions, (g->kept + pc->sz) * sizeof(positionType));
+  if (!p) {
+    fprintf(stderr,"*error* can't allocate %zd positions to verify\n", g->kept + pc->sz);
+    exit(1);
+  }
+  rewind(g->keep);
+  if (fread(p + pc->sz, sizeof(positionType), g->kept, g->keep) != g->kept) {
+    fprintf(stderr,"*error* can't read back %zd kept lazy positions\n", g->kept);
+    exit(1);
+  }
+  fclose(g->keep);
+  g->keep = NULL;
+
+  pc->positions = p;
+  pc->sz += g->kept;
+}
@@ -0,0 +1,62 @@
+#ifndef _LAZYPOSITIONS_H
+#define _LAZYPOSITIONS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "positions.h"
+#include "positionSkew.h"
+
+// positions generated a window at a time while the I/O runs, so a job's memory and start up
+// time don't depend on the size of the device. Random order is a keyed permutation of the
+// block indices, not a shuffled array
+
+typedef struct {
+  size_t minbdSize, slot, count; // the range is count slots of slot bytes from minbdSize
+  int sf; // 0 random, 1 sequential, N interleaved streams, negative is from the end
+  probType rw;
+  const lengthsType *len;
+  unsigned short seed; // the data seed
+  unsigned short deviceid;
+  const skewType *skew; // NULL for a permutation, else each position is a sampled rank
+  skewCountType skewCount; // the ranks drawn, at -VVV
+
+  // the permutation: a Feistel network on 2 x halfBits, values >= count are walked again
+  int halfBits;
+  uint64_t halfMask;
+  uint64_t keys[4];
+
+  size_t next; // index in the sequence, it wraps at count
+  unsigned int lenseed;
+  unsigned short xsubi[3];
+
+  size_t window; // positions in the window, two halves
+  int fresh[2]; // this half hasn't been used since it was generated
+  size_t generated, stalls;
+
+  FILE *keep; // NULL, or the completed positions of each half from before it was regenerated
+  size_t kept;
+} lazyPositionsType;
+
+size_t lazyPositionsWindow(const size_t QD);
+
+void lazyPositionsInit(lazyPositionsType *g, positionContainer *pc, const unsigned short deviceid, const int sf, const probType rw,
+		       const lengthsType *len, const size_t minbdSize, const size_t maxbdSize, const unsigned short seed);
+void lazyPositionsSeed(lazyPositionsType *g, const size_t seed);
+
+uint64_t lazyPositionsIndex(const lazyPositionsType *g, const size_t k);
+
+// fill the whole window, both halves are marked fresh
+void lazyPositionsFill(lazyPositionsType *g, positionType *positions);
+
+// the cursor is entering the half that starts at positions[start]. Returns 0 if it can't be
+// generated yet because I/O from the last lap is still in flight
+int lazyPositionsEnter(lazyPositionsType *g, positionType *positions, const size_t start);
+
+// for -v and -P to a file: keep every completed position in a temporary file, not just the window
+void lazyPositionsKeep(lazyPositionsType *g);
+
+// after the run, the kept positions are added to the window so the container has them all
+void lazyPositionsRestore(lazyPositionsType *g, positionContainer *pc);
+
+#endif
@@ -1,8 +1,11 @@
 #define _XOPEN_SOURCE
-#define _POSIX_C_SOURCE 199506L
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
 #include <sys/types.h>
 
 
@@ -18,6 +21,8 @@ void lengthsInit(lengthsType *l)
   l->sum = 0;
   l->min = (size_t)-1;
   l->max = 0;
+  l->aliasProb = NULL;
+  l->alias = NULL;
 }
 
 void lengthsFree(lengthsType *l)
@@ -26,9 +31,50 @@ void lengthsFree(lengthsType *l)
   l->len = NULL;
   if (l->freq) free(l->freq);
   l->freq = NULL;
+  free(l->aliasProb);
+  l->aliasProb = NULL;
+  free(l->alias);
+  l->alias = NULL;
 }
 
-void lengthsAdd(lengthsType *l, const size_t len, size_t freq)
+// Vose's alias method, so lengthsGet() is O(1) however many sizes there are
+static void lengthsBuild(lengthsType *l)
+{
+  l->aliasProb = realloc(l->aliasProb, l->size * sizeof(unsigned int));
+  l->alias = realloc(l->alias, l->size * sizeof(size_t));
+  double *scaled = malloc(l->size * sizeof(double));
+  size_t *small = malloc(l->size * sizeof(size_t)), *large = malloc(l->size * sizeof(size_t));
+  if (!l->aliasProb || !l->alias || !scaled || !small || !large) {
+    fprintf(stderr,"*error* not enough RAM for %zd block lengths\n", l->size);
+    exit(1);
+  }
+
+  size_t ns = 0, nl = 0;
+  for (size_t i = 0; i < l->size; i++) {
+    scaled[i] = (double) l->freq[i] * l->size / l->sum;
+    l->alias[i] = i;
+    if (scaled[i] < 1) small[ns++] = i;
+    else large[nl++] = i;
+  }
+  const double one = RAND_MAX + 1.0;
+  while (ns && nl) {
+    const size_t a = small[--ns], b = large[--nl];
+    l->aliasProb[a] = (unsigned int) (scaled[a] * one);
+    l->alias[a] = b;
+    scaled[b] = (scaled[b] + scaled[a]) - 1;
+    if (scaled[b] < 1) small[ns++] = b;
+    else large[nl++] = b;
+  }
+  // what's left is 1 up to rounding
+  while (nl) l->aliasProb[large[--nl]] = (unsigned int) one;
+  while (ns) l->aliasProb[small[--ns]] = (unsigned int) one;
+
+  free(large);
+  free(small);
+  free(scaled);
+}
+
+static void lengthsAppend(lengthsType *l, const size_t len, size_t freq)
 {
   if (len > (1L << 32) -1) {
     fprintf(stderr,"*error* block length is too large (%zd)\n", len);
@@ -36,8 +82,8 @@ void lengthsAdd(lengthsType *l, const size_t len, size_t freq)
   }
   if (freq < 1) freq = 1;
   l->size++;
-  l->len = realloc(l->len, (l->size) * sizeof(lengthsType));
-  l->freq = realloc(l->freq, (l->size) * sizeof(lengthsType));
+  l->len = realloc(l->len, (l->size) * sizeof(size_t));
+  l->freq = realloc(l->freq, (l->size) * sizeof(size_t));
   l->len[l->size - 1] = len;
   l->freq[l->size - 1] = freq;
   if (len > l->max) l->max = len;
@@ -46,6 +92,12 @@ void lengthsAdd(lengthsType *l, const size_t len, size_t freq)
   //  fprintf(stderr,"add %zd freq %zd sum %zd\n", len, freq, l->sum);
 }
 
+void lengthsAdd(lengthsType *l, const size_t len, size_t freq)
+{
+  lengthsAppend(l, len, freq);
+  lengthsBuild(l);
+}
+
 size_t lengthsSize(const lengthsType *l)
 {
   return l->size;
@@ -58,18 +110,12 @@ size_t lengthsGet(const lengthsType *l, unsigned int *seed)
   } else if (l->size == 1) {
     return l->len[0];
   }
-  size_t pos = rand_r(seed) % l->sum;
-  size_t inc = 0;
-  for (size_t i = 0; i < l->size; i++) {
-    inc += l->freq[i];
-    //    fprintf(stderr,"*llooking for %zd sum %zd, i = %zd inc %zd\n", pos, l->sum, i, inc);
-    if (pos < inc) {
-      return l->len[i];
-    }
+  // a column, then a biased coin between it and its alias
+  const size_t i = (size_t) (((unsigned long long) rand_r(seed) * l->size) / (RAND_MAX + 1ULL));
+  if ((unsigned int) rand_r(seed) < l->aliasProb[i]) {
+    return l->len[i];
   }
-  abort();
-  return 0;
-  //  return l->len[pos];
+  return l->len[l->alias[i]];
 }
 
 size_t lengthsMin(const lengthsType *l)
@@ -86,16 +132,164 @@ size_t lengthsMax(const lengthsType *l)
 void lengthsSetupLowHighAlignSeq(lengthsType *l, size_t min, size_t max, size_t align)
 {
   for (size_t i = min; i <= max; i += align) {
-    lengthsAdd(l, alignedNumber(i, align), 1);
+    lengthsAppend(l, alignedNumber(i, align), 1);
   }
+  if (l->size) lengthsBuild(l);
 }
 
 void lengthsSetupLowHighAlignPower(lengthsType *l, size_t min, size_t max, size_t align)
 {
   if (align) {}
   for (size_t i = min; i <= max; i = i*2) {
-    lengthsAdd(l, i, 1);
+    lengthsAppend(l, i, 1);
+  }
+  if (l->size) lengthsBuild(l);
+}
+
+void lengthsCopy(lengthsType *dst, const lengthsType *src)
+{
+  for (size_t i = 0; i < src->size; i++) {
+    lengthsAppend(dst, src->len[i], src->freq[i]);
+  }
+  if (dst->size) lengthsBuild(dst);
+}
+
+
+// bytes, with an optional K, M or G suffix
+static size_t parseSize(const char *str, char **endp)
+{
+  double v = strtod(str, endp);
+  switch (toupper(**endp)) {
+  case 'K': v *= 1024; (*endp)++; break;
+  case 'M': v *= 1024 * 1024; (*endp)++; break;
+  case 'G': v *= 1024 * 1024 * 1024; (*endp)++; break;
+  default: break;
+  }
+  if ((toupper(**endp) == 'B') || (toupper(**endp) == 'I')) (*endp)++; // KB, KiB
+  if (toupper(**endp) == 'B') (*endp)++;
+  return (v > 0) ? (size_t) v : 0;
+}
+
+static int lenCompare(const void *a, const void *b)
+{
+  const size_t *x = (const size_t*)a, *y = (const size_t*)b;
+  return (x[0] < y[0]) ? -1 : (x[0] > y[0]);
+}
+
+// sizes rounded up to 4 KiB and merged, then added in size order
+static size_t lengthsAddMerged(lengthsType *l, size_t *pairs, const size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    pairs[2 * i] = (MAX(pairs[2 * i], 1) + 4095) / 4096 * 4096;
+  }
+  qsort(pairs, n, 2 * sizeof(size_t), lenCompare);
+  size_t added = 0;
+  for (size_t i = 0; i < n; ) {
+    size_t freq = 0, j = i;
+    for (; (j < n) && (pairs[2 * j] == pairs[2 * i]); j++) freq += pairs[2 * j + 1];
+    if (freq) {
+      lengthsAppend(l, pairs[2 * i], freq);
+      added++;
+    }
+    i = j;
+  }
+  if (l->size) lengthsBuild(l);
+  return added;
+}
+
+static void pairsAdd(size_t **pairs, size_t *n, size_t *alloc, const size_t len, const size_t freq)
+{
+  if (len == 0) return;
+  if (*n >= *alloc) {
+    *alloc = *alloc * 2 + 64;
+    *pairs = realloc(*pairs, *alloc * 2 * sizeof(size_t));
+    if (!*pairs) {
+      fprintf(stderr,"*error* not enough RAM for the size distribution\n");
+      exit(1);
+    }
+  }
+  (*pairs)[2 * *n] = len;
+  (*pairs)[2 * *n + 1] = freq;
+  (*n)++;
+}
+
+size_t lengthsParse(lengthsType *l, const char *str)
+{
+  size_t *pairs = NULL, n = 0, alloc = 0;
+  const char *p = str;
+  while (*p) {
+    char *endp = NULL;
+    const size_t len = parseSize(p, &endp);
+    if (endp == p) break;
+    size_t freq = 1;
+    if (*endp == ':') freq = strtoul(endp + 1, &endp, 10);
+    pairsAdd(&pairs, &n, &alloc, len, freq);
+    p = endp;
+    while (*p == ',' || isspace(*p)) p++;
+  }
+  const size_t added = lengthsAddMerged(l, pairs, n);
+  free(pairs);
+  return added;
+}
+
+size_t lengthsLoad(lengthsType *l, const char *filename)
+{
+  FILE *fp = fopen(filename, "rt");
+  if (!fp) {
+    perror(filename);
+    exit(1);
+  }
+  size_t *pairs = NULL, n = 0, alloc = 0, lines = 0;
+  char *line = NULL;
+  size_t linelen = 0;
+  while (getline(&line, &linelen, fp) != -1) {
+    lines++;
+    char *p = line;
+    while (isspace(*p)) p++;
+    if ((*p == 0) || (*p == '#') || (*p == '@')) continue;
+
+    char *endp = NULL;
+    if (*p == '[') {
+      // bpftrace hist(): [4K, 8K)  count |@@@@ |, sizes in bytes
+      const size_t lo = parseSize(p + 1, &endp);
+      char *close = strchr(endp, ')');
+      if (!close) close = strchr(endp, ']');
+      if (close) pairsAdd(&pairs, &n, &alloc, lo, strtoul(close + 1, NULL, 10));
+    } else if (strstr(p, "->")) {
+      // bcc bitesize: lo -> hi : count |*** |, in KiB
+      const size_t lo = strtoul(p, NULL, 10);
+      char *colon = strchr(p, ':');
+      if (colon) pairsAdd(&pairs, &n, &alloc, MAX(lo, 1) * 1024, strtoul(colon + 1, NULL, 10));
+    } else {
+      unsigned int major, minor;
+      char name[100];
+      size_t f[8];
+      if (sscanf(p, "%u %u %99s %zu %zu %zu %zu %zu %zu %zu %zu", &major, &minor, name, &f[0], &f[1], &f[2], &f[3], &f[4], &f[5], &f[6], &f[7]) == 11) {
+        // /proc/diskstats: reads, merged, sectors read, ms, writes, merged, sectors written
+        if (f[0]) pairsAdd(&pairs, &n, &alloc, f[2] * 512 / f[0], f[0]);
+        if (f[4]) pairsAdd(&pairs, &n, &alloc, f[6] * 512 / f[4], f[4]);
+      } else {
+        // size [count], e.g. blkparse -f "%N\n"
+        const size_t len = parseSize(p, &endp);
+        if (endp == p) continue;
+        while (isspace(*endp) || (*endp == ':') || (*endp == ',')) endp++;
+        size_t freq = 1;
+        if (isdigit(*endp)) freq = strtoul(endp, NULL, 10);
+        pairsAdd(&pairs, &n, &alloc, len, freq);
+      }
+    }
+  }
+  free(line);
+  fclose(fp);
+
+  const size_t added = lengthsAddMerged(l, pairs, n);
+  free(pairs);
+  if (added == 0) {
+    fprintf(stderr,"*error* no block sizes found in '%s'\n", filename);
+    exit(1);
   }
+  fprintf(stderr,"*info* loaded %zd block sizes from '%s' (%zd lines), [%zd, %zd] bytes\n", added, filename, lines, lengthsMin(l), lengthsMax(l));
+  return added;
 }
 
 void lengthsDump(const lengthsType *l)
@@ -106,6 +300,55 @@ void lengthsDump(const lengthsType *l)
   }
 }
 
+#define LENGTHS_CHECKDRAWS 1000000
+
+void lengthsCheck(const lengthsType *l, const char *prefix)
+{
+  if (l->size == 0) return;
+
+  // the same size can be in the table more than once, its share is the sum
+  size_t *pairs, *counts, n = 0;
+  CALLOC(pairs, 2 * l->size, sizeof(size_t));
+  for (size_t i = 0; i < l->size; i++) {
+    pairs[2 * i] = l->len[i];
+    pairs[2 * i + 1] = l->freq[i];
+  }
+  qsort(pairs, l->size, 2 * sizeof(size_t), lenCompare);
+  for (size_t i = 0; i < l->size; i++) {
+    if (n && (pairs[2 * (n - 1)] == pairs[2 * i])) {
+      pairs[2 * (n - 1) + 1] += pairs[2 * i + 1];
+    } else {
+      pairs[2 * n] = pairs[2 * i];
+      pairs[2 * n + 1] = pairs[2 * i + 1];
+      n++;
+    }
+  }
+  CALLOC(counts, n, sizeof(size_t));
+
+  unsigned int seed = 42;
+  size_t strays = 0, wrong = 0;
+  for (size_t d = 0; d < LENGTHS_CHECKDRAWS; d++) {
+    const size_t key[2] = {lengthsGet(l, &seed), 0};
+    const size_t *found = bsearch(key, pairs, n, 2 * sizeof(size_t), lenCompare);
+    if (found) counts[(found - pairs) / 2]++;
+    else if (strays++ < 5) fprintf(stderr,"*error* %s drew %zd, which isn't one of the block sizes\n", prefix, key[0]);
+  }
+  for (size_t j = 0; j < n; j++) {
+    const double want = pairs[2 * j + 1] * 1.0 / l->sum, got = counts[j] * 1.0 / LENGTHS_CHECKDRAWS;
+    if ((fabs(got - want) > 5 * sqrt(want * (1 - want) / LENGTHS_CHECKDRAWS) + 1e-6) && (wrong++ < 5)) {
+      fprintf(stderr,"*error* %s block size %zd drawn %.5lf of the time, its weight is %.5lf\n", prefix, pairs[2 * j], got, want);
+    }
+  }
+  free(counts);
+  free(pairs);
+
+  if (strays || wrong) {
+    fprintf(stderr,"*error* %s %zd block sizes aren't drawn by their weights\n", prefix, wrong + (strays > 0));
+    exit(1);
+  }
+  fprintf(stderr,"*info* %s %zd block sizes in [%zd, %zd], %d draws match their weights\n", prefix, n, lengthsMin(l), lengthsMax(l), LENGTHS_CHECKDRAWS);
+}
+
 /*int main() {
   lengthsType l;
   unsigned int seed = 0;
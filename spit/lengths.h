@@ -9,6 +9,8 @@ typedef struct {
   size_t sum;
   size_t min;
   size_t max;
+  unsigned int *aliasProb; // Vose's alias table, out of RAND_MAX + 1
+  size_t *alias;
 } lengthsType;
 
 void lengthsInit(lengthsType *l);
@@ -20,12 +22,23 @@ size_t lengthsGet(const lengthsType *l, unsigned int *seed);
 size_t lengthsMin(const lengthsType *l);
 size_t lengthsMax(const lengthsType *l);
 
+// "4096:10,8K:5,1M" sizes in bytes with an optional K/M/G suffix and a weight
 size_t lengthsParse(lengthsType *l, const char *str);
 
+// a size distribution from a file: "size count" lines (e.g. from blkparse), [lo, hi) count
+// histograms from bpftrace, lo -> hi : count KiB histograms from bcc, or /proc/diskstats lines,
+// which only give the mean read and write size. Sizes are rounded up to 4 KiB
+size_t lengthsLoad(lengthsType *l, const char *filename);
+
+void lengthsCopy(lengthsType *dst, const lengthsType *src);
+
 
 void lengthsSetupLowHighAlignSeq(lengthsType *l, size_t min, size_t max, size_t align);
 void lengthsSetupLowHighAlignPower(lengthsType *l, size_t min, size_t max, size_t align);
 
 void lengthsDump(const lengthsType *l);
 
+// at -VVV: draws from the alias table and exits unless each size comes up its share of the time
+void lengthsCheck(const lengthsType *l, const char *prefix);
+
 #endif
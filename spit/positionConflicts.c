@@ -0,0 +1,380 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "positionConflicts.h"
+
+extern int verbose;
+
+/*
+ * For every write x the overlapping write with the latest finish time decides: if that is after
+ * x was submitted, x is a conflict. The overlapping writes are found in two sweeps over the
+ * positions of each device, instead of a forward scan from every write:
+ *  - those starting at or before x (earlier in the order), forwards with a max-heap of the
+ *    writes whose end is past the current position
+ *  - those starting inside x (later in the order), backwards with a Fenwick tree of prefix
+ *    maxima, as they are the index range (x, first position >= x's end)
+ * Rewrites of the same data don't count, so each keeps the best two from different groups.
+ * When there are few overlapping pairs they are simply visited, which is quicker.
+ */
+
+#define NONE UINT32_MAX
+
+typedef struct {
+  double f1, f2; // finish times
+  uint32_t i1, i2; // i2 is in a different group from i1
+} bestType;
+
+static inline int isWrite(const positionType *p)
+{
+  const char a = toupper(p->action);
+  return (a != 'R') && (a != 'F') && (p->latency > 0); // a replayed flush has a range but no data
+}
+
+static inline void bestClear(bestType *b)
+{
+  b->f1 = b->f2 = -1;
+  b->i1 = b->i2 = NONE;
+}
+
+static inline void bestAdd(bestType *b, const double f, const uint32_t i, const uint32_t *group)
+{
+  if (b->i1 == NONE) {
+    b->f1 = f; b->i1 = i;
+  } else if (group[i] == group[b->i1]) {
+    if (f > b->f1) {
+      b->f1 = f; b->i1 = i;
+    }
+  } else if (f > b->f1) {
+    b->f2 = b->f1; b->i2 = b->i1;
+    b->f1 = f; b->i1 = i;
+  } else if (f > b->f2) {
+    b->f2 = f; b->i2 = i;
+  }
+}
+
+// the best not in group g
+static inline uint32_t bestOther(const bestType *b, const uint32_t g, const uint32_t *group)
+{
+  if ((b->i1 != NONE) && (group[b->i1] != g)) return b->i1;
+  return b->i2;
+}
+
+
+// the heap of earlier writes, by finish time
+typedef struct {
+  double f;
+  uint32_t i;
+} heapItem;
+
+static void heapPush(heapItem *h, size_t *n, const heapItem v)
+{
+  size_t c = (*n)++;
+  while (c > 0) {
+    const size_t parent = (c - 1) / 2;
+    if (h[parent].f >= v.f) break;
+    h[c] = h[parent];
+    c = parent;
+  }
+  h[c] = v;
+}
+
+static void heapPop(heapItem *h, size_t *n)
+{
+  const heapItem v = h[--(*n)];
+  size_t c = 0;
+  while (1) {
+    size_t child = 2 * c + 1;
+    if (child >= *n) break;
+    if ((child + 1 < *n) && (h[child + 1].f > h[child].f)) child++;
+    if (v.f >= h[child].f) break;
+    h[c] = h[child];
+    c = child;
+  }
+  if (*n) h[c] = v;
+}
+
+
+static int seedIndexCompare(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+// group ids: the first index with the same pos, len and seed. Those are adjacent in pos, len order
+static void blockGroups(const positionType *p, const size_t m, uint32_t *group)
+{
+  uint64_t *tmp = NULL;
+  size_t tmpSize = 0;
+  for (size_t run = 0; run < m; ) {
+    size_t end = run + 1;
+    while ((end < m) && (p[end].pos == p[run].pos) && (p[end].len == p[run].len)) end++;
+    if (end - run <= 8) {
+      for (size_t i = run; i < end; i++) {
+        group[i] = i;
+        for (size_t k = run; k < i; k++) {
+          if (p[k].seed == p[i].seed) {
+            group[i] = group[k];
+            break;
+          }
+        }
+      }
+    } else {
+      // long runs, e.g. P1, sort by (seed, index)
+      if (end - run > tmpSize) {
+        tmpSize = end - run;
+        tmp = realloc(tmp, tmpSize * sizeof(uint64_t));
+        assert(tmp);
+      }
+      for (size_t i = run; i < end; i++) {
+        tmp[i - run] = ((uint64_t)p[i].seed << 32) | (i - run);
+      }
+      qsort(tmp, end - run, sizeof(uint64_t), seedIndexCompare);
+      for (size_t k = 0; k < end - run; k++) {
+        const size_t i = run + (tmp[k] & 0xffffffff);
+        if ((k > 0) && ((tmp[k] >> 32) == (tmp[k - 1] >> 32))) {
+          group[i] = group[run + (tmp[k - 1] & 0xffffffff)];
+        } else {
+          group[i] = i;
+        }
+      }
+    }
+    run = end;
+  }
+  free(tmp);
+}
+
+
+// first index past r that starts at or beyond the end of r, galloping as it's usually close
+static inline size_t overlapEnd(const positionType *p, const size_t m, const size_t r)
+{
+  const size_t end = p[r].pos + p[r].len;
+  size_t lo = r + 1, step = 1;
+  while ((lo + step < m) && (p[lo + step].pos < end)) {
+    lo += step;
+    step *= 2;
+  }
+  size_t hi = MIN(m, lo + step);
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (p[mid].pos < end) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static inline void keepLatest(const positionType *p, uint32_t *best, const uint32_t i)
+{
+  if ((*best == NONE) || (positionFinishTime(&p[i]) > positionFinishTime(&p[*best]))) *best = i;
+}
+
+static size_t markBlock(positionType *p, const size_t m)
+{
+  uint32_t *group, *overlap, *otherA, *otherB;
+  CALLOC(group, m, sizeof(uint32_t));
+  CALLOC(overlap, m, sizeof(uint32_t));
+  CALLOC(otherA, m, sizeof(uint32_t));
+  CALLOC(otherB, m, sizeof(uint32_t));
+  blockGroups(p, m, group);
+
+  size_t pairs = 0;
+  for (size_t r = 0; r < m; r++) {
+    otherA[r] = NONE;
+    otherB[r] = NONE;
+    overlap[r] = isWrite(&p[r]) ? overlapEnd(p, m, r) : r + 1;
+    pairs += overlap[r] - r - 1;
+  }
+
+  if (verbose >= 3) {
+    fprintf(stderr,"*info* device %d: %zd positions, %zd overlapping pairs, %s\n", p[0].deviceid, m, pairs, (pairs <= CONFLICT_DIRECT * m) ? "visiting each pair" : "sweeping");
+  }
+  if (pairs <= CONFLICT_DIRECT * m) {
+    // little overlap, visiting each pair is quicker than the sweeps
+    for (size_t r = 0; r < m; r++) {
+      for (size_t j = r + 1; j < overlap[r]; j++) {
+        if (isWrite(&p[j]) && (group[j] != group[r])) {
+          keepLatest(p, &otherA[r], j);
+          keepLatest(p, &otherB[j], r);
+        }
+      }
+    }
+  } else {
+    // later overlapping writes, a reverse sweep with prefix maxima over the index
+    bestType *bit;
+    CALLOC(bit, m + 1, sizeof(bestType));
+    for (size_t i = 0; i <= m; i++) bestClear(&bit[i]);
+    for (size_t r = m; r-- > 0; ) {
+      if (!isWrite(&p[r])) continue;
+      bestType b;
+      bestClear(&b);
+      for (size_t k = overlap[r]; k > 0; k -= k & (-k)) {
+        if (bit[k].i1 != NONE) bestAdd(&b, bit[k].f1, bit[k].i1, group);
+        if (bit[k].i2 != NONE) bestAdd(&b, bit[k].f2, bit[k].i2, group);
+      }
+      otherA[r] = bestOther(&b, group[r], group);
+      const double f = positionFinishTime(&p[r]);
+      for (size_t k = r + 1; k <= m; k += k & (-k)) {
+        bestAdd(&bit[k], f, r, group);
+      }
+    }
+    free(bit);
+
+    // earlier overlapping writes, a forward sweep. Only the latest finishing write of each group
+    // is kept, the others in the heap are dropped when they reach the top
+    uint32_t *groupBest = overlap; // no longer needed
+    heapItem *heap;
+    CALLOC(heap, m, sizeof(heapItem));
+    size_t n = 0;
+    for (size_t i = 0; i < m; i++) groupBest[i] = NONE;
+    for (size_t j = 0; j < m; j++) {
+      if (!isWrite(&p[j])) continue;
+      const size_t pos = p[j].pos;
+      heapItem stash;
+      int stashed = 0;
+      while (n > 0) {
+        const heapItem *top = &heap[0];
+        if ((p[top->i].pos + p[top->i].len <= pos) || (groupBest[group[top->i]] != top->i)) {
+          heapPop(heap, &n); // past its end, or not the latest of its group
+        } else if (!stashed && (group[top->i] == group[j])) {
+          stash = *top;
+          stashed = 1;
+          heapPop(heap, &n);
+        } else {
+          otherB[j] = top->i;
+          break;
+        }
+      }
+      if (stashed) heapPush(heap, &n, stash);
+
+      const double f = positionFinishTime(&p[j]);
+      const uint32_t gb = groupBest[group[j]];
+      if ((gb == NONE) || (f > positionFinishTime(&p[gb]))) {
+        groupBest[group[j]] = j;
+        heapPush(heap, &n, (heapItem){f, j});
+      }
+    }
+    free(heap);
+  }
+
+  size_t conflicts = 0;
+  char *codes;
+  CALLOC(codes, m, 1);
+  for (size_t x = 0; x < m; x++) {
+    const uint32_t a = otherA[x], b = otherB[x];
+    if ((a == NONE) && (b == NONE)) continue;
+    uint32_t y = a;
+    if ((a == NONE) || ((b != NONE) && (positionFinishTime(&p[b]) > positionFinishTime(&p[a])))) y = b;
+    if (positionFinishTime(&p[y]) <= p[x].submitTime) continue; // it finished before x started
+
+    const size_t i = MIN(x, y), j = MAX(x, y); // the order the pair was scanned in
+    if (p[y].submitTime >= positionFinishTime(&p[x])) {
+      codes[x] = (x == i) ? '1' : '2';
+    } else {
+      codes[x] = (p[i].submitTime >= p[j].submitTime) ? '3' : '4';
+    }
+    conflicts++;
+  }
+  for (size_t x = 0; x < m; x++) {
+    if (codes[x]) p[x].action = codes[x];
+  }
+
+  free(codes);
+  free(otherB);
+  free(otherA);
+  free(overlap);
+  free(group);
+  return conflicts;
+}
+
+
+// the forward scan from every write that the sweeps replaced, each pair that overlaps is
+// visited. The codes can differ, the scan keeps whichever pair it saw last
+static void forwardScan(const positionType *p, const size_t m, char *marked)
+{
+  for (size_t i = 0; i < m; i++) {
+    if (!isWrite(&p[i])) continue;
+    size_t j = i;
+    while ((++j < m) && (p[j].pos < p[i].pos + p[i].len)) {
+      if (!isWrite(&p[j])) continue;
+      if ((p[i].pos == p[j].pos) && (p[i].len == p[j].len) && (p[i].seed == p[j].seed)) continue;
+
+      if (positionFinishTime(&p[i]) <= p[j].submitTime) {
+	marked[i] = 1;
+      } else if (p[i].submitTime >= positionFinishTime(&p[j])) {
+	marked[j] = 1;
+      } else {
+	marked[i] = 1;
+	marked[j] = 1;
+      }
+    }
+  }
+}
+
+static void checkBlock(const positionType *p, const size_t m, const char *marked)
+{
+  size_t expected = 0, wrong = 0;
+  for (size_t i = 0; i < m; i++) {
+    const int got = (p[i].action >= '1') && (p[i].action <= '4');
+    expected += marked[i];
+    if ((got != marked[i]) && (wrong++ < 5)) {
+      fprintf(stderr,"*error* device %d: [%zd] pos %zd len %d is %s, the forward scan %s it\n", p[i].deviceid, i, p[i].pos, p[i].len, got ? "a conflict" : "not a conflict", marked[i] ? "marks" : "doesn't mark");
+    }
+  }
+  if (wrong) {
+    fprintf(stderr,"*error* device %d: %zd writes are marked differently from the forward scan\n", p[0].deviceid, wrong);
+    exit(1);
+  }
+  fprintf(stderr,"*info* device %d: the forward scan marks the same %zd writes\n", p[0].deviceid, expected);
+}
+
+
+size_t positionConflictsMark(positionType *positions, const size_t count)
+{
+  size_t conflicts = 0;
+  for (size_t start = 0; start < count; ) {
+    size_t end = start + 1;
+    while ((end < count) && (positions[end].deviceid == positions[start].deviceid)) end++;
+    assert(end - start < NONE);
+    char *marked = NULL;
+    if (verbose >= 3) {
+      CALLOC(marked, end - start, 1);
+      forwardScan(positions + start, end - start, marked);
+    }
+    conflicts += markBlock(positions + start, end - start);
+    if (marked) {
+      checkBlock(positions + start, end - start, marked);
+      free(marked);
+    }
+    start = end;
+  }
+  return conflicts;
+}
+
+
+void positionConflictsReport(const positionType *positions, const size_t count, const char *prefix)
+{
+  for (size_t start = 0; start < count; ) {
+    size_t end = start + 1;
+    while ((end < count) && (positions[end].deviceid == positions[start].deviceid)) end++;
+    size_t reads = 0, writes = 0, trims = 0, codes[4] = {0, 0, 0, 0}, other = 0;
+    for (size_t i = start; i < end; i++) {
+      const char a = positions[i].action;
+      if (a == 'R') reads++;
+      else if (a == 'W') writes++;
+      else if (a == 'T') trims++;
+      else if ((a >= '1') && (a <= '4')) codes[a - '1']++;
+      else other++;
+    }
+    fprintf(stderr,"*info* %s device %d: reads %zd, writes %zd, trims %zd, conflicts: overwritten %zd, concurrent %zd", prefix, positions[start].deviceid, reads, writes, trims, codes[0] + codes[1], codes[2] + codes[3]);
+    if (other) fprintf(stderr,", other %zd", other);
+    fprintf(stderr,"\n");
+    start = end;
+  }
+}
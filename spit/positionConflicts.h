@@ -0,0 +1,21 @@
+#ifndef _POSITIONCONFLICTS_H
+#define _POSITIONCONFLICTS_H
+
+#include <stddef.h>
+
+#include "positions.h"
+
+#define CONFLICT_DIRECT 16 // average overlapping pairs per position below which they are visited
+
+// marks the writes that can't be verified because an overlapping write didn't finish before
+// they were submitted. The positions must be in poscompare() order. The action codes are
+//   '1'/'2' overwritten by a later write, starting after/before this one
+//   '3'/'4' concurrent with an overlapping write
+// Rewrites of the same pos, len and seed don't conflict. At -VVV the writes marked are checked
+// against a forward scan from every write, and spit exits if they differ.
+size_t positionConflictsMark(positionType *positions, const size_t count);
+
+// per device counts of reads, writes, trims and each conflict code
+void positionConflictsReport(const positionType *positions, const size_t count, const char *prefix);
+
+#endif
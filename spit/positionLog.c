@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "positionLog.h"
+
+_Static_assert(sizeof(positionLogHeader) == 48, "positionLogHeader is written as is");
+_Static_assert(sizeof(positionLogRecord) == 32, "positionLogRecord is written as is");
+
+extern int verbose;
+extern int keepRunning;
+
+// only spit -P sets this, before any threads start
+static FILE *binaryFp = NULL;
+static int binaryFlags = 0;
+
+void positionLogSetBinary(FILE *fp, const int flags)
+{
+  binaryFp = fp;
+  binaryFlags = flags;
+}
+
+int positionLogIsBinary(FILE *fp, int *flags)
+{
+  if (flags) *flags = binaryFlags;
+  return fp && (fp == binaryFp);
+}
+
+
+// LEB128 style varints, with zigzag for the signed deltas
+static inline size_t putVarint(unsigned char *b, uint64_t v)
+{
+  size_t n = 0;
+  while (v >= 0x80) {
+    b[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  b[n++] = v;
+  return n;
+}
+
+static inline int getVarint(const unsigned char **b, const unsigned char *end, uint64_t *v)
+{
+  uint64_t r = 0;
+  for (int shift = 0; shift < 64 && *b < end; shift += 7) {
+    const unsigned char c = *(*b)++;
+    r |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      *v = r;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static inline uint64_t zigzag(const int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(const uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// nanoseconds, split so the round trip gives back the same double
+static inline int64_t wallToNs(const double t)
+{
+  const double sec = floor(t);
+  return (int64_t)sec * 1000000000LL + llround((t - sec) * 1e9);
+}
+
+static inline double nsToWall(const int64_t ns)
+{
+  return (double)(ns / 1000000000LL) + (ns % 1000000000LL) / 1e9;
+}
+
+
+#define POSLOG_MAXDELTA 48 // the largest delta coded record
+#define POSLOG_BUFFER (1024*1024)
+
+// write the completed positions, the same ones the text format writes
+size_t positionLogSave(const positionContainer *pc, FILE *fp, const size_t maxbdSizeBytes, const jobType *job, const int flags)
+{
+  if (!fp) return 0;
+
+  const positionType *positions = pc->positions;
+  size_t count = 0;
+  for (size_t i = 0; i < pc->sz; i++) {
+    if (positions[i].latency > 0 && !positions[i].inFlight) count++;
+  }
+
+  positionLogHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, POSLOG_MAGIC, sizeof(h.magic));
+  h.version = POSLOG_VERSION;
+  h.flags = flags;
+  h.count = count;
+  h.maxbdSize = maxbdSizeBytes;
+  h.numDevices = job ? job->count : 1;
+  for (size_t d = 0; d < h.numDevices; d++) {
+    h.deviceBytes += strlen(job ? job->devices[d] : "") + 1;
+  }
+  h.deviceBytes = ((h.deviceBytes + 7) / 8) * 8;
+
+  char *table;
+  CALLOC(table, h.deviceBytes, 1);
+  size_t off = 0;
+  for (size_t d = 0; d < h.numDevices; d++) {
+    const char *name = job ? job->devices[d] : "";
+    strcpy(table + off, name);
+    off += strlen(name) + 1;
+  }
+
+  // the record length isn't known until the delta records have been written
+  const long start = ftell(fp);
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(table, h.deviceBytes, 1, fp);
+  free(table);
+
+  unsigned char *buf = malloc(POSLOG_BUFFER);
+  assert(buf);
+  size_t used = 0, written = 0;
+  uint64_t lastPos = 0;
+  int64_t lastSubmit = 0;
+
+  for (size_t i = 0; i < pc->sz; i++) {
+    const positionType *p = &positions[i];
+    if (!(p->latency > 0 && !p->inFlight)) continue;
+
+    if (flags & POSLOG_DELTA) {
+      const int64_t submit = wallToNs(timeStampToWall(p->submitTime));
+      uint32_t latency;
+      memcpy(&latency, &p->latency, sizeof(latency));
+      used += putVarint(buf + used, zigzag((int64_t)(p->pos - lastPos)));
+      used += putVarint(buf + used, p->len);
+      buf[used++] = p->action;
+      used += putVarint(buf + used, p->deviceid);
+      used += putVarint(buf + used, p->seed);
+      used += putVarint(buf + used, zigzag(submit - lastSubmit));
+      memcpy(buf + used, &latency, sizeof(latency)); // exact, it's already a float
+      used += sizeof(latency);
+      lastPos = p->pos;
+      lastSubmit = submit;
+    } else {
+      positionLogRecord r;
+      memset(&r, 0, sizeof(r));
+      r.pos = p->pos;
+      r.submitTime = timeStampToWall(p->submitTime);
+      r.latency = p->latency;
+      r.len = p->len;
+      r.deviceid = p->deviceid;
+      r.seed = p->seed;
+      r.action = p->action;
+      memcpy(buf + used, &r, sizeof(r));
+      used += sizeof(r);
+    }
+    if (used + POSLOG_MAXDELTA > POSLOG_BUFFER) {
+      fwrite(buf, used, 1, fp);
+      written += used;
+      used = 0;
+    }
+  }
+  fwrite(buf, used, 1, fp);
+  written += used;
+  free(buf);
+
+  // best effort, a pipe can't be rewound and the loader doesn't need it
+  h.recordBytes = written;
+  if ((start >= 0) && (fseek(fp, start, SEEK_SET) == 0)) {
+    fwrite(&h, sizeof(h), 1, fp);
+    fseek(fp, 0, SEEK_END);
+  }
+  fflush(fp);
+
+  if (verbose) {
+    fprintf(stderr,"*info* saved %zd positions in %zd bytes (%s records)\n", count, sizeof(h) + h.deviceBytes + written, (flags & POSLOG_DELTA) ? "delta" : "fixed");
+  }
+  return count;
+}
+
+
+int positionLogIsLog(const char *filename)
+{
+  char magic[8];
+  int ret = 0;
+  int fd = open(filename, O_RDONLY);
+  if (fd >= 0) {
+    ret = (read(fd, magic, sizeof(magic)) == sizeof(magic)) && (memcmp(magic, POSLOG_MAGIC, sizeof(magic)) == 0);
+    close(fd);
+  }
+  return ret;
+}
+
+
+static void logCorrupt(const char *filename, const char *why)
+{
+  fprintf(stderr,"*error* position log '%s' is corrupt: %s\n", filename, why);
+  exit(1);
+}
+
+// mmap the log and fill the position container in one pass, no parsing
+jobType positionLogLoad(positionContainer *pc, const char *filename)
+{
+  positionContainerInit(pc, 0);
+  jobType job;
+  jobInit(&job);
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror(filename);
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror(filename);
+    exit(1);
+  }
+  const size_t fileSize = st.st_size;
+  if (fileSize < sizeof(positionLogHeader)) logCorrupt(filename, "too short");
+
+  const unsigned char *map = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror(filename);
+    exit(1);
+  }
+  close(fd);
+  madvise((void*)map, fileSize, MADV_SEQUENTIAL);
+
+  positionLogHeader h;
+  memcpy(&h, map, sizeof(h));
+  if (memcmp(h.magic, POSLOG_MAGIC, sizeof(h.magic)) != 0) logCorrupt(filename, "bad magic");
+  if (h.version != POSLOG_VERSION) {
+    fprintf(stderr,"*error* position log '%s' is version %u, expected %u\n", filename, h.version, POSLOG_VERSION);
+    exit(1);
+  }
+  if (sizeof(h) + h.deviceBytes > fileSize) logCorrupt(filename, "device table");
+
+  // the table may repeat a device once per job, map them to unique devices
+  unsigned short *devmap;
+  CALLOC(devmap, h.numDevices ? h.numDevices : 1, sizeof(unsigned short));
+  const char *name = (const char*)map + sizeof(h), *tableEnd = name + h.deviceBytes;
+  for (size_t d = 0; d < h.numDevices; d++) {
+    if (memchr(name, 0, tableEnd - name) == NULL) logCorrupt(filename, "device name");
+    int seen = -1;
+    for (int k = 0; k < job.count; k++) {
+      if (strcmp(name, job.devices[k]) == 0) seen = k;
+    }
+    if (seen == -1) {
+      jobAddBoth(&job, (char*)name, "w", -1);
+      seen = job.count - 1;
+    }
+    devmap[d] = seen;
+    name += strlen(name) + 1;
+  }
+
+  const unsigned char *b = map + sizeof(h) + h.deviceBytes, *end = map + fileSize;
+  if ((h.flags & POSLOG_DELTA) == 0) {
+    if ((size_t)(end - b) < h.count * sizeof(positionLogRecord)) logCorrupt(filename, "truncated records");
+  }
+
+  positionType *p;
+  CALLOC(p, h.count ? h.count : 1, sizeof(positionType));
+  size_t minbs = (size_t)-1, maxbs = 0;
+  uint64_t lastPos = 0;
+  int64_t lastSubmit = 0;
+
+  for (size_t i = 0; i < h.count && keepRunning; i++) {
+    uint64_t pos, len, dev, seed;
+    double submit, latency;
+    char action;
+    if (h.flags & POSLOG_DELTA) {
+      uint64_t dpos, dsubmit;
+      float lat;
+      if (!getVarint(&b, end, &dpos) || !getVarint(&b, end, &len) || (b >= end)) logCorrupt(filename, "truncated records");
+      action = *b++;
+      if (!getVarint(&b, end, &dev) || !getVarint(&b, end, &seed) || !getVarint(&b, end, &dsubmit) || (end - b < (long)sizeof(lat))) logCorrupt(filename, "truncated records");
+      memcpy(&lat, b, sizeof(lat));
+      b += sizeof(lat);
+      pos = lastPos + (uint64_t)unzigzag(dpos);
+      lastPos = pos;
+      lastSubmit += unzigzag(dsubmit);
+      submit = nsToWall(lastSubmit);
+      latency = lat;
+    } else {
+      positionLogRecord r;
+      memcpy(&r, b, sizeof(r));
+      b += sizeof(r);
+      pos = r.pos; len = r.len; dev = r.deviceid; seed = r.seed; action = r.action;
+      submit = r.submitTime;
+      latency = r.latency;
+    }
+    if (dev >= h.numDevices) logCorrupt(filename, "device id");
+
+    p[i].pos = pos;
+    p[i].len = len;
+    p[i].action = action;
+    p[i].deviceid = devmap[dev];
+    p[i].seed = seed;
+    p[i].submitTime = submit;
+    p[i].latency = (latency > 0) ? latency : 1e-9;
+    p[i].success = 1;
+    if (len < minbs) minbs = len;
+    if (len > maxbs) maxbs = len;
+  }
+
+  munmap((void*)map, fileSize);
+  free(devmap);
+
+  pc->positions = p;
+  pc->sz = h.count;
+  pc->maxbdSize = h.maxbdSize;
+  pc->minbs = minbs;
+  pc->maxbs = maxbs;
+  return job;
+}
@@ -0,0 +1,49 @@
+#ifndef _POSITIONLOG_H
+#define _POSITIONLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "positions.h"
+
+// the binary -P position log: a header, the device table, then one record per completed I/O.
+// Fixed records can be used straight from an mmap, delta records are varint coded and smaller.
+
+#define POSLOG_MAGIC "SPITPLOG"
+#define POSLOG_VERSION 1
+
+#define POSLOG_FIXED 0
+#define POSLOG_DELTA 1 // flags
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t count;
+  uint64_t maxbdSize;
+  uint32_t numDevices;
+  uint32_t deviceBytes;          // NUL terminated names, padded to 8 bytes
+  uint64_t recordBytes;
+} positionLogHeader;
+
+typedef struct {
+  uint64_t pos;
+  double submitTime;             // wall clock, as in the text format
+  float latency;
+  uint32_t len;
+  uint16_t deviceid;
+  uint16_t seed;
+  char action;
+  char pad[3];
+} positionLogRecord;
+
+// mark a -P FILE as wanting the binary format
+void positionLogSetBinary(FILE *fp, const int flags);
+int positionLogIsBinary(FILE *fp, int *flags);
+
+size_t positionLogSave(const positionContainer *pc, FILE *fp, const size_t maxbdSizeBytes, const jobType *job, const int flags);
+
+int positionLogIsLog(const char *filename);
+jobType positionLogLoad(positionContainer *pc, const char *filename);
+
+#endif
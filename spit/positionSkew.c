@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "positionSkew.h"
+
+extern int verbose;
+
+
+// log1p(x)/x and expm1(x)/x, accurate near 0
+static double helper1(const double x)
+{
+  if (fabs(x) > 1e-8) return log1p(x) / x;
+  return 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double helper2(const double x)
+{
+  if (fabs(x) > 1e-8) return expm1(x) / x;
+  return 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+// h(x) = x^-theta and its integral, for Hörmann and Derflinger's rejection-inversion
+static double zipfH(const double theta, const double x)
+{
+  return exp(-theta * log(x));
+}
+
+static double zipfHIntegral(const double theta, const double x)
+{
+  const double logX = log(x);
+  return helper2((1 - theta) * logX) * logX;
+}
+
+static double zipfHIntegralInverse(const double theta, const double x)
+{
+  double t = x * (1 - theta);
+  if (t < -1) t = -1; // rounding
+  return exp(helper1(t) * x);
+}
+
+
+int skewParse(skewType *s, const char *jobstring)
+{
+  memset(s, 0, sizeof(skewType));
+  const char *charE = strchr(jobstring, 'e');
+  const char *charH = strchr(jobstring, 'H');
+  const char *charV = strchr(jobstring, 'V');
+  if ((charE != NULL) + (charH != NULL) + (charV != NULL) > 1) {
+    fprintf(stderr,"*error* only one of e (zipf), H (hot set) and V (pareto) per job\n");
+    exit(1);
+  }
+
+  if (charE) {
+    s->type = SKEW_ZIPF;
+    s->theta = atof(charE + 1);
+    if (s->theta <= 0) s->theta = 0.99;
+  } else if (charH) {
+    s->type = SKEW_HOT;
+    char *endp = NULL;
+    double io = strtod(charH + 1, &endp), lba = 0;
+    if (io <= 0) io = 80;
+    if (*endp == ':') lba = atof(endp + 1);
+    if (lba <= 0) lba = 100 - io;
+    if ((io >= 100) || (lba >= 100) || (lba <= 0)) {
+      fprintf(stderr,"*error* the hot set H%g:%g needs percentages below 100\n", io, lba);
+      exit(1);
+    }
+    s->hotIO = io / 100.0;
+    s->hotLBA = lba / 100.0;
+  } else if (charV) {
+    s->type = SKEW_PARETO;
+    double h = atof(charV + 1);
+    if (h <= 0) h = 20; // the 80/20 rule
+    if (h >= 50) {
+      fprintf(stderr,"*error* the pareto V%g needs a hot percentage below 50\n", h);
+      exit(1);
+    }
+    s->paretoH = h / 100.0;
+  }
+  return s->type;
+}
+
+
+void skewSetup(skewType *s, const size_t n)
+{
+  assert(n > 0);
+  s->n = n;
+  switch (s->type) {
+  case SKEW_ZIPF:
+    s->hIntegralX1 = zipfHIntegral(s->theta, 1.5) - 1;
+    s->hIntegralN = zipfHIntegral(s->theta, n + 0.5);
+    s->s = 2 - zipfHIntegralInverse(s->theta, zipfHIntegral(s->theta, 2.5) - zipfH(s->theta, 2));
+    break;
+  case SKEW_HOT:
+    s->hotN = MIN(n, MAX(1, (size_t) (n * s->hotLBA + 0.5)));
+    break;
+  case SKEW_PARETO:
+    s->paretoPow = log(s->paretoH) / log(1 - s->paretoH);
+    break;
+  default:
+    break;
+  }
+}
+
+
+size_t skewRank(const skewType *s, unsigned short xsubi[3])
+{
+  switch (s->type) {
+  case SKEW_ZIPF:
+    while (1) {
+      const double u = s->hIntegralN + erand48(xsubi) * (s->hIntegralX1 - s->hIntegralN);
+      const double x = zipfHIntegralInverse(s->theta, u);
+      size_t k = (size_t) (x + 0.5);
+      if (k < 1) k = 1;
+      else if (k > s->n) k = s->n;
+      if ((k - x <= s->s) || (u >= zipfHIntegral(s->theta, k + 0.5) - zipfH(s->theta, k))) {
+        return k - 1;
+      }
+    }
+  case SKEW_HOT:
+    if ((s->hotN == s->n) || (erand48(xsubi) < s->hotIO)) {
+      return MIN(s->hotN - 1, (size_t) (erand48(xsubi) * s->hotN));
+    }
+    return MIN(s->n - 1, s->hotN + (size_t) (erand48(xsubi) * (s->n - s->hotN)));
+  case SKEW_PARETO:
+    // the fraction of the range is u^pow, so P(rank < h n) = 1 - h
+    return MIN(s->n - 1, (size_t) (pow(erand48(xsubi), s->paretoPow) * s->n));
+  default:
+    return (size_t) (erand48(xsubi) * s->n) % s->n;
+  }
+}
+
+
+size_t skewWorkingSet(const skewType *s, const double fraction)
+{
+  size_t k = s->n;
+  switch (s->type) {
+  case SKEW_ZIPF: {
+    // the sum of i^-theta to k, as 1 plus the integral from 1.5 to k + 0.5
+    const double base = zipfHIntegral(s->theta, 1.5);
+    const double total = 1 + zipfHIntegral(s->theta, s->n + 0.5) - base;
+    size_t lo = 1, hi = s->n;
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (1 + zipfHIntegral(s->theta, mid + 0.5) - base >= fraction * total) hi = mid;
+      else lo = mid + 1;
+    }
+    k = lo;
+    break;
+  }
+  case SKEW_HOT:
+    if ((fraction <= s->hotIO) || (s->hotN == s->n)) {
+      k = ceil(fraction / s->hotIO * s->hotN);
+    } else {
+      k = s->hotN + ceil((fraction - s->hotIO) / (1 - s->hotIO) * (s->n - s->hotN));
+    }
+    break;
+  case SKEW_PARETO:
+    k = ceil(pow(fraction, s->paretoPow) * s->n);
+    break;
+  default:
+    k = ceil(fraction * s->n);
+    break;
+  }
+  return MIN(s->n, MAX(1, k));
+}
+
+
+static const double workingSets[3] = {0.5, 0.9, 0.99};
+
+void skewReport(const skewType *s, const size_t blockBytes, const char *prefix)
+{
+  char name[40];
+  switch (s->type) {
+  case SKEW_ZIPF: snprintf(name, sizeof(name), "zipf theta %g", s->theta); break;
+  case SKEW_HOT: snprintf(name, sizeof(name), "hot set %g%% to %g%%", s->hotIO * 100, s->hotLBA * 100); break;
+  case SKEW_PARETO: snprintf(name, sizeof(name), "pareto %g%% to %g%%", (1 - s->paretoH) * 100, s->paretoH * 100); break;
+  default: snprintf(name, sizeof(name), "uniform"); break;
+  }
+  fprintf(stderr,"*info* %s %s over %zd blocks, working set:", prefix, name, s->n);
+  for (int i = 0; i < 3; i++) {
+    const size_t k = skewWorkingSet(s, workingSets[i]);
+    fprintf(stderr,"%s %.0lf%% of the I/O to %zd blocks (%.1lf MiB, %.2lf%%)", i ? "," : "", workingSets[i] * 100, k, TOMiB(k * blockBytes), k * 100.0 / s->n);
+  }
+  fprintf(stderr,"\n");
+}
+
+
+void skewCountSetup(skewCountType *c, const skewType *s)
+{
+  memset(c, 0, sizeof(skewCountType));
+  for (int i = 0; i < 3; i++) {
+    c->k[i] = skewWorkingSet(s, workingSets[i]);
+  }
+}
+
+
+void skewCountAdd(skewCountType *c, const size_t rank)
+{
+  c->draws++;
+  for (int i = 0; i < 3; i++) {
+    if (rank < c->k[i]) c->with[i]++;
+    if (rank + 1 < c->k[i]) c->without[i]++;
+  }
+}
+
+
+void skewCountCheck(const skewCountType *c, const char *prefix)
+{
+  if (c->draws == 0) return;
+  int bad = 0;
+  for (int i = 0; i < 3; i++) {
+    const double f = workingSets[i];
+    // the working sets are whole ranks, and zipf's is from an integral rather than the sum
+    const double slack = 0.01 + 5 * sqrt(f * (1 - f) / c->draws);
+    const double with = c->with[i] * 1.0 / c->draws, without = c->without[i] * 1.0 / c->draws;
+    const int wrong = (with < f - slack) || (without > f + slack);
+    fprintf(stderr,"*%s* %s %.0lf%% working set of %zd blocks got %.4lf of %zd draws, %zd blocks got %.4lf\n", wrong ? "error" : "info", prefix, f * 100, c->k[i], with, c->draws, c->k[i] - 1, without);
+    bad += wrong;
+  }
+  if (bad) {
+    fprintf(stderr,"*error* %s the draws don't match the working sets\n", prefix);
+    exit(1);
+  }
+}
+
+
+void positionContainerSkew(positionContainer *pc, skewType *s, const unsigned short seed, const int report)
+{
+  const size_t n = pc->sz;
+  if (n == 0) return;
+  skewSetup(s, n);
+
+  positionType *ranked;
+  CALLOC(ranked, n, sizeof(positionType));
+  memcpy(ranked, pc->positions, n * sizeof(positionType));
+  unsigned char *touched;
+  CALLOC(touched, (n + 7) / 8, 1);
+
+  skewCountType count;
+  skewCountSetup(&count, s);
+
+  unsigned short xsubi[3] = {seed, seed ^ 0x5eed, seed};
+  size_t distinct = 0, distinctBytes = 0, sumBytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    const size_t r = skewRank(s, xsubi);
+    assert(r < n);
+    skewCountAdd(&count, r);
+    pc->positions[i].pos = ranked[r].pos;
+    pc->positions[i].len = ranked[r].len;
+    sumBytes += ranked[r].len;
+    if (!(touched[r / 8] & (1 << (r % 8)))) {
+      touched[r / 8] |= (1 << (r % 8));
+      distinct++;
+      distinctBytes += ranked[r].len;
+    }
+  }
+
+  if (report) {
+    skewReport(s, sumBytes / n, "skew");
+    fprintf(stderr,"*info* skew: a pass of %zd positions touches %zd distinct blocks (%.1lf MiB, %.1lf%%)\n", n, distinct, TOMiB(distinctBytes), distinct * 100.0 / n);
+  }
+  if (verbose >= 3) {
+    skewCountCheck(&count, "skew:");
+  }
+
+  free(touched);
+  free(ranked);
+}
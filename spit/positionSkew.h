@@ -0,0 +1,58 @@
+#ifndef _POSITIONSKEW_H
+#define _POSITIONSKEW_H
+
+#include <stddef.h>
+
+#include "positions.h"
+
+// skewed access: instead of visiting every position once per pass, each I/O picks a rank from
+// a distribution, rank 0 being the hottest. Ranks map onto the job's positions in their order,
+// so with s0 the hot blocks are scattered and with s1 they are at the start of the range
+
+#define SKEW_NONE 0
+#define SKEW_ZIPF 1   // 'e' theta
+#define SKEW_HOT 2    // 'H' io%:lba%
+#define SKEW_PARETO 3 // 'V' h%
+
+typedef struct {
+  int type;
+  double theta; // zipf exponent
+  double hotIO, hotLBA; // fraction of the I/O that goes to the fraction of the blocks
+  double paretoH; // 1-h of the I/O goes to the hottest h of the blocks, and so on recursively
+
+  size_t n; // ranks are [0, n)
+  size_t hotN;
+  double hIntegralX1, hIntegralN, s; // zipf rejection-inversion
+  double paretoPow; // log(h) / log(1-h)
+} skewType;
+
+// from the e, H and V job string commands. Returns 0 if the string has no skew
+int skewParse(skewType *s, const char *jobstring);
+
+void skewSetup(skewType *s, const size_t n);
+
+// O(1), one or two erand48() calls
+size_t skewRank(const skewType *s, unsigned short xsubi[3]);
+
+// the number of hottest ranks that get the fraction of the I/O
+size_t skewWorkingSet(const skewType *s, const double fraction);
+
+void skewReport(const skewType *s, const size_t blockBytes, const char *prefix);
+
+// at -VVV the ranks drawn are counted and checked against skewWorkingSet(): the fewest hottest
+// ranks that get each fraction of the I/O must get it, and one rank fewer mustn't
+typedef struct {
+  size_t k[3]; // the working sets for 50%, 90% and 99%
+  size_t with[3], without[3]; // draws below k and below k - 1
+  size_t draws;
+} skewCountType;
+
+void skewCountSetup(skewCountType *c, const skewType *s);
+void skewCountAdd(skewCountType *c, const size_t rank);
+// exits if a share is further off than the number of draws allows
+void skewCountCheck(const skewCountType *c, const char *prefix);
+
+// replaces the positions with samples from themselves, keeping each one's action
+void positionContainerSkew(positionContainer *pc, skewType *s, const unsigned short seed, const int report);
+
+#endif
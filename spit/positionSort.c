@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "positionSort.h"
+
+extern int verbose;
+
+#define SORT_BYPOS 0
+#define SORT_BYSUBMIT 1
+
+#define SORT_MAXTHREADS 64
+#define SORT_PARALLEL_MIN 65536 // below this one thread does it
+#define SORT_KEYBYTES 10 // 8 bytes of pos or submit time, then 2 of deviceid
+#define SORT_RUN_INSERTION 16 // same slot runs up to this long are insertion sorted, longer ones qsorted
+
+typedef struct {
+  positionType *a, *tmp;
+  size_t count;
+  int order;
+  size_t threads;
+  pthread_barrier_t barrier;
+  size_t counts[SORT_MAXTHREADS][256];
+  uint64_t diffMinor[SORT_MAXTHREADS], diffMajor[SORT_MAXTHREADS];
+  int passes[SORT_KEYBYTES], numPasses;
+} sortSharedType;
+
+typedef struct {
+  sortSharedType *s;
+  size_t id;
+} sortThreadType;
+
+
+// positive and negative doubles as an unsigned key in the same order
+static inline uint64_t sortableDouble(const double d)
+{
+  uint64_t u;
+  memcpy(&u, &d, sizeof(u));
+  return (u >> 63) ? ~u : (u | (1ULL << 63));
+}
+
+static inline uint64_t keyMinor(const positionType *p, const int order)
+{
+  return (order == SORT_BYPOS) ? p->pos : sortableDouble(p->submitTime);
+}
+
+static inline unsigned int keyDigit(const positionType *p, const int order, const int byte)
+{
+  if (byte < 8) return (keyMinor(p, order) >> (8 * byte)) & 0xff;
+  return (p->deviceid >> (8 * (byte - 8))) & 0xff;
+}
+
+
+static void *sortThread(void *arg)
+{
+  sortThreadType *t = (sortThreadType*)arg;
+  sortSharedType *s = t->s;
+  const size_t from = t->id * s->count / s->threads, to = (t->id + 1) * s->count / s->threads;
+
+  // only the key bytes that differ somewhere need a pass
+  const uint64_t minor0 = keyMinor(&s->a[0], s->order);
+  const unsigned short major0 = s->a[0].deviceid;
+  uint64_t diffMinor = 0, diffMajor = 0;
+  for (size_t i = from; i < to; i++) {
+    diffMinor |= keyMinor(&s->a[i], s->order) ^ minor0;
+    diffMajor |= s->a[i].deviceid ^ major0;
+  }
+  s->diffMinor[t->id] = diffMinor;
+  s->diffMajor[t->id] = diffMajor;
+  pthread_barrier_wait(&s->barrier);
+  if (t->id == 0) {
+    diffMinor = 0; diffMajor = 0;
+    for (size_t i = 0; i < s->threads; i++) {
+      diffMinor |= s->diffMinor[i];
+      diffMajor |= s->diffMajor[i];
+    }
+    s->numPasses = 0;
+    for (int b = 0; b < SORT_KEYBYTES; b++) {
+      const uint64_t diff = (b < 8) ? (diffMinor >> (8 * b)) : (diffMajor >> (8 * (b - 8)));
+      if (diff & 0xff) s->passes[s->numPasses++] = b;
+    }
+  }
+  pthread_barrier_wait(&s->barrier);
+
+  positionType *src = s->a, *dst = s->tmp;
+  for (int pass = 0; pass < s->numPasses; pass++) {
+    const int byte = s->passes[pass];
+    size_t *counts = s->counts[t->id];
+    memset(counts, 0, 256 * sizeof(size_t));
+    for (size_t i = from; i < to; i++) {
+      counts[keyDigit(&src[i], s->order, byte)]++;
+    }
+    pthread_barrier_wait(&s->barrier);
+    if (t->id == 0) {
+      // digit major, thread minor, so each pass is stable
+      size_t running = 0;
+      for (int d = 0; d < 256; d++) {
+        for (size_t j = 0; j < s->threads; j++) {
+          const size_t c = s->counts[j][d];
+          s->counts[j][d] = running;
+          running += c;
+        }
+      }
+      assert(running == s->count);
+    }
+    pthread_barrier_wait(&s->barrier);
+    for (size_t i = from; i < to; i++) {
+      dst[counts[keyDigit(&src[i], s->order, byte)]++] = src[i];
+    }
+    pthread_barrier_wait(&s->barrier);
+    positionType *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != s->a) {
+    memcpy(s->a + from, src + from, (to - from) * sizeof(positionType));
+  }
+  return NULL;
+}
+
+
+static int radixSort(positionType *a, const size_t count, const int order)
+{
+  positionType *tmp = malloc(count * sizeof(positionType));
+  if (!tmp) return 0;
+
+  sortSharedType *s;
+  CALLOC(s, 1, sizeof(sortSharedType));
+  s->a = a;
+  s->tmp = tmp;
+  s->count = count;
+  s->order = order;
+  s->threads = (count < SORT_PARALLEL_MIN) ? 1 : MAX(1, MIN(SORT_MAXTHREADS, numThreads()));
+  pthread_barrier_init(&s->barrier, NULL, s->threads);
+
+  sortThreadType *t;
+  CALLOC(t, s->threads, sizeof(sortThreadType));
+  pthread_t *pt;
+  CALLOC(pt, s->threads, sizeof(pthread_t));
+  for (size_t i = 0; i < s->threads; i++) {
+    t[i].s = s;
+    t[i].id = i;
+    if (i > 0) pthread_create(&pt[i], NULL, sortThread, &t[i]);
+  }
+  sortThread(&t[0]);
+  for (size_t i = 1; i < s->threads; i++) {
+    pthread_join(pt[i], NULL);
+  }
+
+  pthread_barrier_destroy(&s->barrier);
+  free(pt);
+  free(t);
+  free(s);
+  free(tmp);
+  return 1;
+}
+
+
+static inline int sameSlot(const positionType *a, const positionType *b)
+{
+  return (a->deviceid == b->deviceid) && (a->pos == b->pos);
+}
+
+void positionSortByPos(positionType *positions, const size_t count)
+{
+  if (count < 2) return;
+
+  size_t i = 1;
+  while ((i < count) && (poscompare(&positions[i - 1], &positions[i]) <= 0)) i++;
+  if (i == count) return; // already in order, e.g. collapsed twice
+
+  const double start = timedouble();
+  if (!radixSort(positions, count, SORT_BYPOS)) {
+    fprintf(stderr,"*warning* not enough RAM for a radix sort, using qsort\n");
+    qsort(positions, count, sizeof(positionType), poscompare);
+    return;
+  }
+
+  // the radix key is (deviceid, pos), order the runs with the same slot by len and finish time
+  for (size_t run = 0; run < count; ) {
+    size_t end = run + 1;
+    while ((end < count) && sameSlot(&positions[run], &positions[end])) end++;
+    if (end - run > SORT_RUN_INSERTION) {
+      // e.g. many passes over a small range
+      qsort(positions + run, end - run, sizeof(positionType), poscompare);
+      run = end;
+      continue;
+    }
+    for (size_t j = run + 1; j < end; j++) {
+      const positionType p = positions[j];
+      size_t k = j;
+      while ((k > run) && (poscompare(&positions[k - 1], &p) > 0)) {
+        positions[k] = positions[k - 1];
+        k--;
+      }
+      positions[k] = p;
+    }
+    run = end;
+  }
+  if (verbose >= 2) {
+    fprintf(stderr,"*info* radix sorted %zd positions by position in %.3lf s\n", count, timedouble() - start);
+  }
+}
+
+
+void positionSortBySubmit(positionType *positions, const size_t count)
+{
+  if (count < 2) return;
+
+  const double start = timedouble();
+  if (!radixSort(positions, count, SORT_BYSUBMIT)) {
+    fprintf(stderr,"*error* not enough RAM to sort %zd positions\n", count);
+    exit(-1);
+  }
+  if (verbose >= 2) {
+    fprintf(stderr,"*info* radix sorted %zd positions by submit time in %.3lf s\n", count, timedouble() - start);
+  }
+}
+
+
+// a binary heap of the next position from each input
+void positionMergeSorted(positionType *out, positionType **in, const size_t *counts, const size_t k)
+{
+  size_t *heap, *next;
+  CALLOC(heap, k + 1, sizeof(size_t));
+  CALLOC(next, k + 1, sizeof(size_t));
+
+  size_t n = 0;
+  for (size_t i = 0; i < k; i++) {
+    if (counts[i] == 0) continue;
+    // sift up
+    size_t c = n++;
+    while (c > 0) {
+      const size_t parent = (c - 1) / 2;
+      if (poscompare(&in[heap[parent]][0], &in[i][0]) <= 0) break;
+      heap[c] = heap[parent];
+      c = parent;
+    }
+    heap[c] = i;
+  }
+
+  size_t o = 0;
+  while (n > 0) {
+    const size_t top = heap[0];
+    out[o++] = in[top][next[top]++];
+    size_t move;
+    if (next[top] < counts[top]) {
+      move = top;
+    } else {
+      move = heap[--n];
+      if (n == 0) break;
+    }
+    // sift down from the root
+    const positionType *mp = &in[move][next[move]];
+    size_t c = 0;
+    while (1) {
+      size_t child = 2 * c + 1;
+      if (child >= n) break;
+      if ((child + 1 < n) && (poscompare(&in[heap[child + 1]][next[heap[child + 1]]], &in[heap[child]][next[heap[child]]]) < 0)) child++;
+      if (poscompare(mp, &in[heap[child]][next[heap[child]]]) <= 0) break;
+      heap[c] = heap[child];
+      c = child;
+    }
+    heap[c] = move;
+  }
+
+  free(next);
+  free(heap);
+}
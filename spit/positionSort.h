@@ -0,0 +1,19 @@
+#ifndef _POSITIONSORT_H
+#define _POSITIONSORT_H
+
+#include <stddef.h>
+
+#include "positions.h"
+
+// parallel LSD radix sorts of position arrays, replacing qsort() for the post-run processing
+
+// the poscompare() order: deviceid, pos, len, then the most recent finish time first
+void positionSortByPos(positionType *positions, const size_t count);
+
+// deviceid, then submit time
+void positionSortBySubmit(positionType *positions, const size_t count);
+
+// k-way merge of arrays that are each already in poscompare() order
+void positionMergeSorted(positionType *out, positionType **in, const size_t *counts, const size_t k);
+
+#endif
@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <math.h>
+#include <limits.h>
+
+#include "utils.h"
+#include "positionStream.h"
+
+extern int verbose;
+
+typedef struct {
+  size_t pos;
+  double submitTime;
+  float latency;
+  unsigned int len;
+  unsigned short seed;
+  char action;
+  const char *name;
+  size_t maxbdSize;
+} streamRecordType;
+
+// single producer (the I/O thread), single consumer (the writer)
+typedef struct streamRingType {
+  streamRecordType *r;
+  size_t head; // writer
+  size_t tail; // producer
+  size_t stalls, highWater;
+  double stallTime;
+  struct streamRingType *next;
+} streamRingType;
+
+static streamRingType *rings = NULL; // pushed on the front, only freed by positionStreamStop()
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static int running = 0, stop = 0;
+static unsigned int generation = 0;
+static pthread_t writer;
+static int streamFd = -1;
+
+static __thread streamRingType *myRing = NULL;
+static __thread unsigned int myGeneration = 0;
+
+// writer side
+static char *buffer = NULL;
+static size_t used = 0, lines = 0, bytes = 0, writes = 0, writeErrors = 0;
+
+
+// the writer formats every completion, so avoid printf. Produces the same text as positionDumpOne()
+static inline char *putUnsigned(char *b, size_t v, const int width)
+{
+  char tmp[24];
+  int n = 0;
+  do {
+    tmp[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+  for (int i = n; i < width; i++) *b++ = ' ';
+  while (n) *b++ = tmp[--n];
+  return b;
+}
+
+// %.Nlf for non-negative values, the fraction is rounded on its own to keep the precision
+static inline char *putFixed(char *b, const double x, const int decimals)
+{
+  static const size_t scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+  size_t whole = (size_t)x;
+  size_t frac = (size_t)llround((x - whole) * scale[decimals]);
+  if (frac >= scale[decimals]) {
+    whole++;
+    frac -= scale[decimals];
+  }
+  b = putUnsigned(b, whole, 0);
+  *b++ = '.';
+  for (int i = decimals - 1; i >= 0; i--) {
+    b[i] = '0' + (frac % 10);
+    frac /= 10;
+  }
+  return b + decimals;
+}
+
+static inline char *putString(char *b, const char *s)
+{
+  while (*s) *b++ = *s++;
+  return b;
+}
+
+static size_t formatRecord(char *b, const streamRecordType *s)
+{
+  char *start = b;
+  b = putString(b, s->name); *b++ = '\t';
+  b = putUnsigned(b, s->pos, 10); *b++ = '\t';
+  b = putFixed(b, TOGiB(s->pos), 2); b = putString(b, " GiB\t");
+  b = putFixed(b, s->pos * 100.0 / s->maxbdSize, 1); b = putString(b, "%\t");
+  *b++ = s->action; *b++ = '\t';
+  b = putUnsigned(b, s->len, 0); *b++ = '\t';
+  b = putUnsigned(b, s->maxbdSize, 0); *b++ = '\t';
+  b = putFixed(b, TOGiB(s->maxbdSize), 2); b = putString(b, " GiB\t");
+  b = putUnsigned(b, s->seed, 0); *b++ = '\t';
+  b = putFixed(b, timeStampToWall(s->submitTime), 8); *b++ = '\t';
+  b = putFixed(b, timeStampToWall(s->submitTime + s->latency), 8); *b++ = '\n';
+  return b - start;
+}
+
+
+static void streamFlush()
+{
+  size_t off = 0;
+  while ((off < used) && !writeErrors) {
+    ssize_t w = write(streamFd, buffer + off, used - off);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      perror("position stream");
+      writeErrors++;
+      break;
+    }
+    off += w;
+    writes++;
+  }
+  bytes += off;
+  used = 0;
+}
+
+
+static void *streamWriter(void *arg)
+{
+  if (arg) {}
+  double lastFlush = timeStamp();
+  while (1) {
+    const int stopping = __atomic_load_n(&stop, __ATOMIC_ACQUIRE);
+    size_t moved = 0;
+
+    for (streamRingType *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+      const size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      size_t head = ring->head;
+      while (head != tail) {
+        const streamRecordType *s = &ring->r[head & (POSSTREAM_RING - 1)];
+        used += formatRecord(buffer + used, s);
+        head++;
+        moved++;
+        if (used + 4096 + PATH_MAX > POSSTREAM_BUFFER) { // longer than any line
+          __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+          streamFlush();
+        }
+      }
+      __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+    lines += moved;
+
+    if (moved == 0) {
+      // when idle, write what there is every 10 ms so the reader stays close to live
+      if (used && (stopping || (used >= POSSTREAM_MINWRITE) || (timeStamp() - lastFlush > 0.01))) {
+        streamFlush();
+        lastFlush = timeStamp();
+      }
+      if (stopping) break; // the producers had finished before this empty pass
+      usleep(100);
+    }
+  }
+  return NULL;
+}
+
+
+void positionStreamStart(const int fd)
+{
+  assert(!running);
+  fflush(stdout);
+  streamFd = fd;
+  buffer = malloc(POSSTREAM_BUFFER);
+  assert(buffer);
+  used = 0; lines = 0; bytes = 0; writes = 0; writeErrors = 0;
+  rings = NULL;
+  stop = 0;
+  generation++;
+  __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+  pthread_create(&writer, NULL, streamWriter, NULL);
+}
+
+
+static streamRingType *streamRing()
+{
+  if (myRing && (myGeneration == generation)) return myRing;
+
+  streamRingType *ring;
+  CALLOC(ring, 1, sizeof(streamRingType));
+  CALLOC(ring->r, POSSTREAM_RING, sizeof(streamRecordType));
+  pthread_mutex_lock(&ringsLock);
+  ring->next = rings;
+  __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&ringsLock);
+
+  myRing = ring;
+  myGeneration = generation;
+  return ring;
+}
+
+
+void positionStreamPush(const positionType *p, const size_t maxbdSizeBytes, const char *name)
+{
+  if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+    positionDumpOne(stdout, p, maxbdSizeBytes, 0, name);
+    return;
+  }
+  if (!(p->latency > 0 && !p->inFlight)) return; // the same as positionDumpOne()
+
+  streamRingType *ring = streamRing();
+  const size_t tail = ring->tail;
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (tail - head >= POSSTREAM_RING) {
+    // backpressure, the consumer of the stream has fallen behind
+    ring->stalls++;
+    const double start = timeStamp();
+    do {
+      sched_yield();
+      head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    } while (tail - head >= POSSTREAM_RING);
+    ring->stallTime += timeStamp() - start;
+  }
+
+  streamRecordType *s = &ring->r[tail & (POSSTREAM_RING - 1)];
+  s->pos = p->pos;
+  s->submitTime = p->submitTime;
+  s->latency = p->latency;
+  s->len = p->len;
+  s->seed = p->seed;
+  s->action = p->action;
+  s->name = name;
+  s->maxbdSize = maxbdSizeBytes;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+  if (tail + 1 - head > ring->highWater) ring->highWater = tail + 1 - head;
+}
+
+
+void positionStreamStop()
+{
+  if (!running) return;
+  __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+  pthread_join(writer, NULL);
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+
+  size_t n = 0, stalls = 0, highWater = 0;
+  double stallTime = 0;
+  for (streamRingType *ring = rings; ring; ) {
+    streamRingType *next = ring->next;
+    n++;
+    stalls += ring->stalls;
+    stallTime += ring->stallTime;
+    highWater = MAX(highWater, ring->highWater);
+    free(ring->r);
+    free(ring);
+    ring = next;
+  }
+  rings = NULL;
+  free(buffer);
+  buffer = NULL;
+
+  if (verbose || stalls) {
+    fprintf(stderr,"*info* position stream: %zd lines, %.1lf MiB in %zd writes from %zd threads, ring high water %zd of %d\n", lines, TOMiB(bytes), writes, n, highWater, POSSTREAM_RING);
+  }
+  if (stalls) {
+    fprintf(stderr,"*warning* position stream consumer fell behind, I/O threads stalled %zd times for %.3lf s\n", stalls, stallTime);
+  }
+}
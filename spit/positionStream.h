@@ -0,0 +1,24 @@
+#ifndef _POSITIONSTREAM_H
+#define _POSITIONSTREAM_H
+
+#include <stddef.h>
+
+#include "positions.h"
+
+// -P - streaming: each I/O thread pushes its completions into its own lock-free ring and one
+// writer thread formats them and writes to the fd in large write() calls
+
+#define POSSTREAM_RING 65536 // records per producer thread, a power of 2
+#define POSSTREAM_BUFFER (4L*1024*1024)
+#define POSSTREAM_MINWRITE (64*1024)
+#define POSSTREAM_PIPE (1024*1024) // the default pipe-max-size
+
+void positionStreamStart(const int fd);
+
+// called from the completion loops, falls back to positionDumpOne() if there is no writer
+void positionStreamPush(const positionType *p, const size_t maxbdSizeBytes, const char *name);
+
+// drains every ring, then stops the writer
+void positionStreamStop();
+
+#endif
@@ -7,12 +7,16 @@
 #include <math.h>
 #include <ctype.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 
 #include "devices.h"
 #include "utils.h"
 #include "positions.h"
 #include "lengths.h"
+#include "positionSort.h"
+#include "positionConflicts.h"
 
 extern int verbose;
 extern int keepRunning;
@@ -24,7 +28,7 @@ int poscompare(const void *p1, const void *p2)
   const positionType *pos1 = (positionType*)p1;
   const positionType *pos2 = (positionType*)p2;
 
-  //  assert(pos1->submitTime); assert(pos2->submitTime); assert(pos1->finishTime); assert(pos2->finishTime);
+  //  assert(pos1->submitTime); assert(pos2->submitTime); assert(pos1->latency); assert(pos2->latency);
   if (pos1->deviceid < pos2->deviceid) return -1;
   else if (pos1->deviceid > pos2->deviceid) return 1;
   else { // same deviceid
@@ -34,8 +38,8 @@ int poscompare(const void *p1, const void *p2)
       if (pos1->len < pos2->len) return -1;
       else if (pos1->len > pos2->len) return 1;
       else { // same len
-        if (pos1->finishTime > pos2->finishTime) return -1;
-        else if (pos1->finishTime < pos2->finishTime) return 1;
+        if (positionFinishTime(pos1) > positionFinishTime(pos2)) return -1;
+        else if (positionFinishTime(pos1) < positionFinishTime(pos2)) return 1;
         else return 0;
       }
     }
@@ -133,7 +137,7 @@ int positionContainerCheck(const positionContainer *pc, const size_t minmaxbdSiz
   // duplicate, sort the array. Count unique positions
   CALLOC(copy, num, sizeof(positionType));
   memcpy(copy, positions, num * sizeof(positionType));
-  qsort(copy, num, sizeof(positionType), poscompare);
+  positionSortByPos(copy, num);
   // check order
   size_t unique = 0, same = 0;
   for (size_t i = 0; i <num; i++) {
@@ -177,7 +181,7 @@ void positionContainerCheckOverlap(const positionContainer *merged)
     size_t readcount = 0, writecount = 0, notcompletedcount = 0, conflict = 0, trimcount = 0;
     positionType *pp = merged->positions;
     for (size_t i = 0; i < merged->sz; i++,pp++) {
-      if (pp->finishTime == 0 || pp->submitTime == 0) {
+      if (pp->latency == 0 || pp->submitTime == 0) {
         notcompletedcount++;
       } else {
         if (pp->action == 'W') writecount++;
@@ -211,8 +215,8 @@ void positionContainerCheckOverlap(const positionContainer *merged)
 
         if (merged->positions[i].seed != merged->positions[i+1].seed) {
           if (merged->positions[i].pos + merged->positions[i].len > merged->positions[i+1].pos) {
-            if (merged->positions[i].finishTime > 0 && merged->positions[i+1].finishTime > 0) {
-              if (merged->positions[i].finishTime < merged->positions[i+1].finishTime) {
+            if (merged->positions[i].latency > 0 && merged->positions[i+1].latency > 0) {
+              if (positionFinishTime(&merged->positions[i]) < positionFinishTime(&merged->positions[i+1])) {
                 printed++;
                 if (printed < 10)
                   fprintf(stderr,"[%zd] *warning* problem at position %zd (len %d) %c, next %zd (len %d) %c\n", i, merged->positions[i].pos, merged->positions[i].len,  merged->positions[i].action, merged->positions[i+1].pos, merged->positions[i+1].len, merged->positions[i+1].action);
@@ -233,7 +237,7 @@ void positionContainerCollapse(positionContainer *merged)
   fprintf(stderr,"*info* remove action conflicts (%zd raw positions)\n", merged->sz);
   size_t  newstart = 0;
   for (size_t i =0 ; i < merged->sz; i++) {
-    if (merged->positions[i].finishTime != 0) {
+    if (merged->positions[i].latency != 0) {
       if (newstart != i) {
         merged->positions[newstart] = merged->positions[i];
       }
@@ -243,7 +247,9 @@ void positionContainerCollapse(positionContainer *merged)
   merged->sz = newstart;
 
   fprintf(stderr,"*info* sorting %zd actions that have completed\n", merged->sz);
-  qsort(merged->positions, merged->sz, sizeof(positionType), poscompare);
+  const double sortStart = timedouble();
+  positionSortByPos(merged->positions, merged->sz);
+  const double sortEnd = timedouble();
 
   /*  fprintf(stderr,"*info* checking pre-conditions for collapse()\n");
   positionType *pi = merged->positions;
@@ -252,8 +258,8 @@ void positionContainerCollapse(positionContainer *merged)
     assert(pi->pos <= pj->pos);
     if (pi->pos + pi->len < pj->pos) { // if this overlaps with the next
       // most recent time first
-      if (pi->finishTime && pj->finishTime)
-  assert(pi->finishTime <= pj->finishTime);
+      if (pi->latency && pj->latency)
+  assert(positionFinishTime(pi) <= positionFinishTime(pj));
     }
     }*/
 
@@ -261,69 +267,9 @@ void positionContainerCollapse(positionContainer *merged)
   //    fprintf(stderr,"[%zd] pos %zd, len %d, action '%c'\n", i, merged->positions[i].pos, merged->positions[i].len, merged->positions[i].action);
   //  }
 
-#ifdef DEBUG
-  size_t maxbs = merged->maxbs;
-  assert(maxbs > 0);
-#endif
+  // overlapping writes that weren't ordered by completion can't be verified
+  const size_t marked = positionConflictsMark(merged->positions, merged->sz);
 
-  for (size_t i = 0; i < merged->sz; i++) {
-    if ((toupper(merged->positions[i].action) != 'R') && (merged->positions[i].finishTime > 0)) {
-      size_t j = i;
-      // iterate upwards
-      // if j pos is past i + len then exit
-      while ((++j < merged->sz) && (merged->positions[j].pos < merged->positions[i].pos + merged->positions[i].len) && (merged->positions[i].deviceid == merged->positions[j].deviceid)) {
-
-        if ((merged->positions[j].action == 'R') || (merged->positions[j].finishTime == 0)) {
-          // if it's a not a write, move to the next one
-          continue;
-        }
-
-        assert(j > i);
-        assert(merged->positions[i].deviceid == merged->positions[j].deviceid);
-        assert(merged->positions[i].pos <= merged->positions[j].pos);
-        if (merged->positions[i].pos == merged->positions[j].pos) {
-          assert(merged->positions[i].len <= merged->positions[j].len);
-        }
-
-
-        int seedsame = merged->positions[i].seed == merged->positions[j].seed;
-        // if the same thread wrote to the same location with the same seed, they are OK
-        if (merged->positions[i].pos == merged->positions[j].pos) {
-          if (merged->positions[i].len == merged->positions[j].len) {
-            if (seedsame) {
-              continue;
-            }
-          }
-        }
-
-
-        if (merged->positions[j].pos < merged->positions[i].pos + merged->positions[i].len) { // should always be true
-
-          // there is some conflict to check
-          size_t overlap = 0;
-          if (merged->positions[i].finishTime <= merged->positions[j].submitTime) {
-            overlap = '1';
-            merged->positions[i].action = overlap;
-          } else if (merged->positions[i].submitTime >= merged->positions[j].finishTime) {
-            overlap = '2';
-            merged->positions[j].action = overlap;
-          } else if (merged->positions[i].submitTime >= merged->positions[j].submitTime) {
-            overlap = '3';
-            merged->positions[i].action = overlap;
-            merged->positions[j].action = overlap;
-          } else if (merged->positions[i].submitTime <= merged->positions[j].submitTime) {
-            overlap = '4';
-            merged->positions[i].action = overlap;
-            merged->positions[j].action = overlap;
-          }
-          //	fprintf(stderr,"*maybe2* %zd/%d/%d and %zd/%d/%d\n", merged->positions[i].pos, merged->positions[i].seed, merged->positions[i].deviceid, merged->positions[j].pos, merged->positions[j].seed, merged->positions[j].deviceid);
-
-        } else {
-          abort();
-        }
-      }
-    }
-  }
   size_t actionsr = 0, actionsw = 0, conflicts = 0, actionst = 0;
   positionType *pp = merged->positions;
   for (size_t i = 0; i < merged->sz; i++,pp++) {
@@ -334,6 +280,10 @@ void positionContainerCollapse(positionContainer *merged)
     else conflicts++;
   }
   fprintf(stderr,"*info* unique actions: reads %zd, writes %zd, trims %zd, conflicts %zd\n", actionsr, actionsw, actionst, conflicts);
+  if (verbose) {
+    fprintf(stderr,"*info* collapse: sort %.3lf s, conflict scan %.3lf s (%zd marked)\n", sortEnd - sortStart, timedouble() - sortEnd, marked);
+    if (verbose >= 2) positionConflictsReport(merged->positions, merged->sz, "collapse");
+  }
 
   //    for (size_t i = 0; i < merged->sz; i++) {
   //    fprintf(stderr,"[%zd] pos %zd, len %d, action '%c'\n", i, merged->positions[i].pos, merged->positions[i].len, merged->positions[i].action);
@@ -404,22 +354,48 @@ positionContainer positionContainerMerge(positionContainer *p, const size_t numF
   merged.positions = createPositions(total);
   merged.maxbdSize = maxbd;
 
-  size_t startpos = 0;
+  // only the completed actions are kept. Sort each input, then a k-way merge, rather than
+  // sorting the whole concatenation
+  const double start = timedouble();
+  positionType **inputs;
+  size_t *counts;
+  CALLOC(inputs, numFiles, sizeof(positionType*));
+  CALLOC(counts, numFiles, sizeof(size_t));
+  size_t startpos = 0, maxbs = 0, minbs = (size_t)-1;
   for (size_t i = 0; i < numFiles; i++) {
-    memcpy(merged.positions + startpos, p[i].positions, p[i].sz * sizeof(positionType));
-    startpos += p[i].sz;
+    inputs[i] = merged.positions + startpos;
+    for (size_t j = 0; j < p[i].sz; j++) {
+      const positionType *pp = &p[i].positions[j];
+      if (pp->len > maxbs) maxbs = pp->len;
+      if (pp->len < minbs) minbs = pp->len;
+      if (pp->latency != 0) {
+        merged.positions[startpos++] = *pp;
+      }
+    }
+    counts[i] = merged.positions + startpos - inputs[i];
   }
-  assert(startpos == total);
+  assert(startpos <= total);
+  merged.sz = startpos;
+  merged.maxbs = maxbs;
+  merged.minbs = (total > 0) ? minbs : 0;
+  const double copied = timedouble();
 
-  size_t maxbs = 0;
-  size_t minbs = 0;
-  if (total > 0) minbs = merged.positions[0].len;
-  for (size_t i = 0; i < total; i++) {
-    if (merged.positions[i].len > maxbs) maxbs = merged.positions[i].len;
-    if (merged.positions[i].len < minbs) minbs = merged.positions[i].len;
+  for (size_t i = 0; i < numFiles; i++) {
+    positionSortByPos(inputs[i], counts[i]);
+  }
+  const double sorted = timedouble();
+
+  if ((numFiles > 1) && (merged.sz > 0)) {
+    positionType *out = createPositions(merged.sz);
+    positionMergeSorted(out, inputs, counts, numFiles);
+    free(merged.positions);
+    merged.positions = out;
+  }
+  free(counts);
+  free(inputs);
+  if (verbose) {
+    fprintf(stderr,"*info* containerMerge %zd of %zd positions completed: copy %.3lf s, sort %.3lf s, %zd-way merge %.3lf s\n", merged.sz, total, copied - start, sorted - copied, numFiles, timedouble() - sorted);
   }
-  merged.maxbs = maxbs;
-  merged.minbs = minbs;
 
   positionContainerCollapse(&merged);
 
@@ -432,9 +408,9 @@ void positionDumpOne(FILE *fp, const positionType *p, const size_t maxbdSizeByte
   //  ioctl(fileno(fp), FIONREAD, &nbytes);
   //  fprintf(stderr,"%d\n", nbytes);
   
-  if (0 || (p->finishTime > 0 && !p->inFlight)) {
+  if (0 || (p->latency > 0 && !p->inFlight)) {
     const char action = p->action;
-    fprintf(fp, "%s\t%10zd\t%.2lf GiB\t%.1lf%%\t%c\t%u\t%zd\t%.2lf GiB\t%u\t%.8lf\t%.8lf\n", name, p->pos, TOGiB(p->pos), p->pos * 100.0 / maxbdSizeBytes, action, p->len, maxbdSizeBytes, TOGiB(maxbdSizeBytes), p->seed, p->submitTime, p->finishTime);
+    fprintf(fp, "%s\t%10zd\t%.2lf GiB\t%.1lf%%\t%c\t%u\t%zd\t%.2lf GiB\t%u\t%.8lf\t%.8lf\n", name, p->pos, TOGiB(p->pos), p->pos * 100.0 / maxbdSizeBytes, action, p->len, maxbdSizeBytes, TOGiB(maxbdSizeBytes), p->seed, timeStampToWall(p->submitTime), timeStampToWall(positionFinishTime(p)));
     if (doflush) {
       fprintf(fp, "%s\t%10zd\t%.2lf GiB\t%.1lf%%\t%c\t%zd\t%zd\t%.2lf GiB\t%u\n", name, (size_t)0, 0.0, 0.0, 'F', (size_t)0, maxbdSizeBytes, 0.0, p->seed);
     }
@@ -785,7 +761,7 @@ size_t positionContainerCreatePositions(positionContainer *pc,
         }
 
         poss[count].submitTime = 0;
-        poss[count].finishTime = 0;
+        poss[count].latency = 0;
         poss[count].len = thislen;
 	assert(poss[count].len == thislen); // check the datastructure has enough bits to store the value
         poss[count].seed = seedin;
@@ -970,26 +946,168 @@ void insertFourkEveryMiB(positionContainer *pc, const size_t minbdSize, const si
 
 
 
+// a fast 64-bit generator for shuffling, splitmix64
+static inline uint64_t shuffleNext(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+__extension__ typedef unsigned __int128 shuffleWideType;
+
+// uniform in [0, n) without modulo bias (Lemire's multiply and reject)
+static inline uint64_t shuffleBounded(uint64_t *state, const uint64_t n)
+{
+  shuffleWideType m = (shuffleWideType)shuffleNext(state) * n;
+  uint64_t low = (uint64_t)m;
+  if (low < n) {
+    const uint64_t threshold = -n % n;
+    while (low < threshold) {
+      m = (shuffleWideType)shuffleNext(state) * n;
+      low = (uint64_t)m;
+    }
+  }
+  return (uint64_t)(m >> 64);
+}
+
+static inline uint64_t shuffleSeed(const unsigned int seed, const uint64_t stream)
+{
+  uint64_t s = ((uint64_t)seed << 32) ^ stream;
+  return shuffleNext(&s);
+}
+
+static void fisherYates(positionType *positions, const size_t count, uint64_t state)
+{
+  for (size_t i = count; i > 1 && keepRunning; i--) {
+    const size_t j = shuffleBounded(&state, i);
+    positionType p = positions[i - 1];
+    positions[i - 1] = positions[j];
+    positions[j] = p;
+  }
+}
+
+
+// large arrays are shuffled in parallel: every element is sent to a uniformly random bucket,
+// then each bucket is Fisher-Yates shuffled. The block count is fixed, not the CPU count, so
+// the order only depends on the seed.
+#define SHUFFLE_PARALLEL_MIN (1024*1024)
+#define SHUFFLE_BLOCKS 64
+
+typedef struct {
+  positionType *positions, *tmp;
+  size_t count;
+  unsigned int seed;
+  size_t (*counts)[SHUFFLE_BLOCKS]; // [chunk][bucket]
+  size_t (*dest)[SHUFFLE_BLOCKS];
+  size_t bucketStart[SHUFFLE_BLOCKS + 1];
+  int phase;
+  size_t id, threads;
+} shuffleThreadType;
+
+static void *shuffleThread(void *arg)
+{
+  shuffleThreadType *t = (shuffleThreadType*)arg;
+  for (size_t c = t->id; c < SHUFFLE_BLOCKS; c += t->threads) {
+    if (t->phase < 2) {
+      // the bucket labels are drawn twice from the same stream rather than stored
+      const size_t from = c * t->count / SHUFFLE_BLOCKS, to = (c + 1) * t->count / SHUFFLE_BLOCKS;
+      uint64_t state = shuffleSeed(t->seed, c);
+      for (size_t i = from; i < to; i++) {
+        const size_t b = shuffleNext(&state) >> 58; // 64 buckets
+        if (t->phase == 0) {
+          t->counts[c][b]++;
+        } else {
+          t->tmp[t->dest[c][b]++] = t->positions[i];
+        }
+      }
+    } else {
+      const size_t from = t->bucketStart[c], to = t->bucketStart[c + 1];
+      fisherYates(t->tmp + from, to - from, shuffleSeed(t->seed, SHUFFLE_BLOCKS + c));
+      memcpy(t->positions + from, t->tmp + from, (to - from) * sizeof(positionType));
+    }
+  }
+  return NULL;
+}
+
+static int shuffleParallel(positionType *positions, const size_t count, const unsigned int seed)
+{
+  positionType *tmp = malloc(count * sizeof(positionType));
+  size_t (*counts)[SHUFFLE_BLOCKS] = calloc(SHUFFLE_BLOCKS, sizeof(*counts));
+  size_t (*dest)[SHUFFLE_BLOCKS] = calloc(SHUFFLE_BLOCKS, sizeof(*dest));
+  if (!tmp || !counts || !dest) {
+    free(tmp); free(counts); free(dest);
+    return 0;
+  }
+
+  const size_t threads = MAX(1, MIN(SHUFFLE_BLOCKS, numThreads()));
+  shuffleThreadType *t = calloc(threads, sizeof(shuffleThreadType));
+  pthread_t *pt = calloc(threads, sizeof(pthread_t));
+  assert(t && pt);
+
+  size_t bucketStart[SHUFFLE_BLOCKS + 1];
+  for (int phase = 0; phase < 3; phase++) {
+    if (phase == 1) {
+      // buckets are laid out in order, each filled by the chunks in order
+      size_t off = 0;
+      for (size_t b = 0; b < SHUFFLE_BLOCKS; b++) {
+        bucketStart[b] = off;
+        for (size_t c = 0; c < SHUFFLE_BLOCKS; c++) {
+          dest[c][b] = off;
+          off += counts[c][b];
+        }
+      }
+      bucketStart[SHUFFLE_BLOCKS] = off;
+      assert(off == count);
+    }
+    for (size_t i = 0; i < threads; i++) {
+      t[i].positions = positions;
+      t[i].tmp = tmp;
+      t[i].count = count;
+      t[i].seed = seed;
+      t[i].counts = counts;
+      t[i].dest = dest;
+      memcpy(t[i].bucketStart, bucketStart, sizeof(bucketStart));
+      t[i].phase = phase;
+      t[i].id = i;
+      t[i].threads = threads;
+      pthread_create(&pt[i], NULL, shuffleThread, &t[i]);
+    }
+    for (size_t i = 0; i < threads; i++) {
+      pthread_join(pt[i], NULL);
+    }
+  }
+
+  free(pt);
+  free(t);
+  free(dest);
+  free(counts);
+  free(tmp);
+  return 1;
+}
+
+
 void positionContainerRandomize(positionContainer *pc, unsigned int seed)
 {
   const size_t count = pc->sz;
   positionType *positions = pc->positions;
 
   if (verbose)  fprintf(stderr,"*info* shuffling/randomizing the array of %zd values, seed %u\n", count, seed);
-  for (size_t shuffle = 0; shuffle < 1; shuffle++) {
-    for (size_t i = 0; i < count && keepRunning; i++) {
-      size_t j = i;
-      if (count > 1) {
-        while ((j = rand_r(&seed) % count) == i) {
-          ;
-        }
-      }
-      // swap i and j
-      positionType p = positions[i];
-      positions[i] = positions[j];
-      positions[j] = p;
+  const double start = timedouble();
+  int parallel = 0;
+  if (count >= SHUFFLE_PARALLEL_MIN) {
+    parallel = shuffleParallel(positions, count, seed);
+    if (!parallel) {
+      fprintf(stderr,"*warning* not enough RAM for a parallel shuffle, shuffling %zd positions on one thread\n", count);
     }
   }
+  if (!parallel) {
+    fisherYates(positions, count, shuffleSeed(seed, 0));
+  }
+  if (verbose) {
+    fprintf(stderr,"*info* shuffled %zd positions in %.3lf s (%s)\n", count, timedouble() - start, parallel ? "parallel" : "serial");
+  }
 }
 
 
@@ -1004,7 +1122,7 @@ void positionAddBlockSize(positionType *positions, const size_t count, const siz
   for (size_t i = 0; i < count; i++) {
     p->pos += addSize;
     p->submitTime = 0;
-    p->finishTime = 0;
+    p->latency = 0;
     p->inFlight = 0;
     p->success = 0;
     if (p->pos + p->len > maxbdSize) {
@@ -1097,7 +1215,7 @@ void positionContainerDump(positionContainer *pc, const size_t countToShow)
     else if (positions[i].action == 'T') tcount++;
 
     if (i < countToShow) {
-      buf += sprintf(buf,"\t[%02zd] action %c\tpos %12zd\tlen %7u\tdevice %d\tverify %d\tseed %6d\toffset %lf\n", i, positions[i].action, positions[i].pos, positions[i].len, positions[i].deviceid,positions[i].verify, positions[i].seed, positions[i].usoffset);
+      buf += sprintf(buf,"\t[%02zd] action %c\tpos %12zd\tlen %7u\tdevice %d\tverify %d\tseed %6d\tdelay %lf\n", i, positions[i].action, positions[i].pos, positions[i].len, positions[i].deviceid,positions[i].verify, positions[i].seed, positionDelay(&positions[i]));
     }
   }
   buf += sprintf(buf,"\tSummary[%d]: reads %zd, writes %zd, trims %zd, hash %lx\n", positions[0].seed, rcount, wcount, tcount, hash);
@@ -1137,6 +1255,8 @@ void positionContainerSetupFromPC(positionContainer *pc, const positionContainer
   pc->UUID = oldpc->UUID+1;
   pc->elapsedTime = oldpc->elapsedTime;
   pc->diskStats = oldpc->diskStats;
+  pc->pattern = oldpc->pattern;
+  pc->sectorSize = oldpc->sectorSize;
 }
 
 
@@ -1169,7 +1289,7 @@ void positionContainerAddMetadataChecks(positionContainer *pc, const size_t meta
       p[newpos] = pc->positions[i + j];
       p[newpos].action = 'R';
       if (p[newpos - gap - 1].action == 'W') {
-	p[newpos].verify = newpos - gap - 1; // min 1 for the 'P'
+	p[newpos].verify = newpos - gap; // the write's index + 1, the first one is at 0
       }
       newpos++;
     }
@@ -1190,12 +1310,12 @@ void positionContainerAddMetadataChecks(positionContainer *pc, const size_t meta
       assert(pc->positions[i+1].action != pc->positions[i].action); 
       continue;
     } else {
-      size_t vpos = pc->positions[i].verify;
-      if (vpos > 0) {  
-	assert(pc->positions[i].pos == pc->positions[vpos].pos);
-	assert(pc->positions[i].len == pc->positions[vpos].len);
-	//	assert(pc->positions[i].action != pc->positions[vpos].action);
-	assert(pc->positions[vpos].action != 'P');
+      const positionType *written = positionVerifies(pc->positions, &pc->positions[i]);
+      if (written) {
+	assert(pc->positions[i].pos == written->pos);
+	assert(pc->positions[i].len == written->len);
+	//	assert(pc->positions[i].action != written->action);
+	assert(written->action != 'P');
       }
     }
   }
@@ -1209,12 +1329,16 @@ void positionContainerAddDelay(positionContainer *pc, double iops, size_t thread
   double reducetime = redsec;
   size_t origsz = pc->sz;
   double globaloff = 0;
+  size_t lastus = 0;
   if (threadid == 0) fprintf(stderr,"*info* [t%zd] target %.1lf IOPS per thread (n=%zd)\n", threadid, iops, pc->sz);
 
   for (size_t i = 0; i < origsz; i++) {
     double offset = (1.0 / iops);
     globaloff += offset;
-    pc->positions[i].usoffset = globaloff;
+    // each delay is rounded to a microsecond but from the running total, so the error doesn't add up
+    const size_t us = globaloff * 1000000 + 0.5;
+    pc->positions[i].usdelta = MIN(us - lastus, UINT_MAX);
+    lastus = us;
     if (redsec) {
       if (globaloff > reducetime) {
 	if (iops > 10) {
@@ -1264,8 +1388,8 @@ void positionContainerUniqueSeeds(positionContainer *pc, unsigned short seed, co
       pc->positions[j] = origs[i];
       if (pc->positions[j].action == 'W') {
         pc->positions[j].action = 'R';
-        pc->positions[j].verify = j-1;
-        assert(pc->positions[j].verify == j-1);
+        pc->positions[j].verify = j; // the write at j-1, plus one
+        assert(positionVerifies(pc->positions, &pc->positions[j]) == &pc->positions[j-1]);
       }
       j++;
     }
@@ -1279,6 +1403,23 @@ void positionContainerFree(positionContainer *pc)
 {
   if (pc->positions) free(pc->positions);
   pc->positions = NULL;
+  free(pc->flushLatency);
+  pc->flushLatency = NULL;
+  pc->flushCount = 0;
+  pc->flushAlloc = 0;
+}
+
+void positionContainerAddFlushLatency(positionContainer *pc, const double secs)
+{
+  if (pc->flushCount >= pc->flushAlloc) {
+    pc->flushAlloc = pc->flushAlloc ? pc->flushAlloc * 2 : 1024;
+    pc->flushLatency = realloc(pc->flushLatency, pc->flushAlloc * sizeof(double));
+    if (!pc->flushLatency) {
+      fprintf(stderr,"*error* out of memory for flush latencies\n");
+      abort();
+    }
+  }
+  pc->flushLatency[pc->flushCount++] = secs;
 }
 
 
@@ -1289,7 +1430,7 @@ void positionLatencyStats(positionContainer *pc, const int threadid)
   size_t failed = 0;
 
   for (size_t i = 0; i < pc->sz; i++) {
-    if (pc->positions[i].success && pc->positions[i].finishTime) {
+    if (pc->positions[i].success && pc->positions[i].latency) {
       //
     } else {
       if (pc->positions[i].submitTime) {
@@ -1327,7 +1468,7 @@ jobType positionContainerLoadLines(positionContainer *pc, FILE *fd, size_t maxLi
   CALLOC(path, 1000, 1);
   //  char *origline = line; // store the original pointer, as getline changes it creating an unfreeable area
   positionType *p = NULL;
-  size_t pNum = 0;
+  size_t pNum = 0, pAlloc = 0;
   double starttime, fintime;
 
   while (keepRunning && (read = getline(&line, &maxline, fd) != -1)) {
@@ -1354,13 +1495,17 @@ jobType positionContainerLoadLines(positionContainer *pc, FILE *fd, size_t maxLi
       }
       //
       pNum++;
-      p = realloc(p, sizeof(positionType) * (pNum));
-      assert(p);
+      if (pNum > pAlloc) {
+        pAlloc = MAX(1024, pAlloc * 2);
+        p = realloc(p, sizeof(positionType) * pAlloc);
+        assert(p);
+      }
+      memset(&p[pNum-1], 0, sizeof(positionType));
       //      fprintf(stderr,"loaded %s deviceid %d\n", path, seenpathbefore);
       p[pNum-1].deviceid = seenpathbefore;
       assert(starttime);
       p[pNum-1].submitTime = starttime;
-      p[pNum-1].finishTime = fintime;
+      positionSetFinishTime(&p[pNum-1], fintime);
       //      fprintf(stderr,"%zd\n", pNum);
       //      p[pNum-1].fd = 0;
       p[pNum-1].pos = pos;
@@ -1389,7 +1534,7 @@ jobType positionContainerLoadLines(positionContainer *pc, FILE *fd, size_t maxLi
   pc->sz = pNum;
   for (size_t i = 0; i < pc->sz; i++) {
     assert(pc->positions[i].submitTime != 0);
-    assert(pc->positions[i].finishTime != 0);
+    assert(pc->positions[i].latency != 0);
   }
   //  pc->string = strdup("");
   //  pc->device = path;
@@ -7,21 +7,51 @@
 #include "diskStats.h"
 #include "jobType.h"
 #include "lengths.h"
+#include "dataPattern.h"
 
+// 40 bytes, the number of positions that fit in RAM is what limits the LBA coverage
+#define POSITION_OLDBYTES 48 // with double finish and offset times
 typedef struct {
   size_t pos;                    // 8
-  double submitTime, finishTime; // 16
+  double submitTime;             // 8
+  float latency;                 // 4: seconds, 0 until it has completed. See positionFinishTime()
   unsigned int len;              // 4;
-  unsigned int verify;                // pointer to the value to verify
+  unsigned int verify;           // 4: a read that checks a write has the write's index + 1, 0 for none
+  unsigned int usdelta;          // 4: microseconds after the position before it is due, see positionDelay()
   unsigned short deviceid;           // 2
   unsigned short seed;           // 2
   unsigned short q;              // 2
   char  action;                  // 1: 'R' or 'W'
   unsigned int  success:2;               // 0.5
   unsigned int inFlight:2;
-  double usoffset;
 } positionType;
 
+// the finish time is kept as a float latency from the submit time
+static inline double positionFinishTime(const positionType *p)
+{
+  return p->latency ? p->submitTime + p->latency : 0;
+}
+
+static inline void positionSetFinishTime(positionType *p, const double finishTime)
+{
+  const float lat = finishTime - p->submitTime;
+  p->latency = (lat > 0) ? lat : 1e-9; // it still counts as completed
+}
+
+// timed positions, a rate limit or a trace replay, are due usdelta after the one before and
+// the first after the round starts. Whole microseconds don't lose resolution however long
+// the round is, as a float offset from the start of the round did
+static inline double positionDelay(const positionType *p)
+{
+  return p->usdelta / 1000000.0;
+}
+
+// the write a verifying read checks, NULL if it doesn't check one
+static inline positionType *positionVerifies(positionType *positions, const positionType *p)
+{
+  return p->verify ? &positions[p->verify - 1] : NULL;
+}
+
 typedef struct {
   positionType *positions;
   size_t sz;
@@ -36,9 +66,20 @@ typedef struct {
   size_t writtenIOs;
   size_t readBytes;
   size_t readIOs;
+  size_t syscalls; // submit/reap/sync system calls made by the I/O loop
+  double reaperCPU; // user+sys seconds used by split reaper threads
+  size_t dependencyWaits; // times a verifying read waited for its write to complete
+  size_t pauseBarriers; // 'P' pauses reached with I/O in flight, each used to drain the queue
+  double *flushLatency; // seconds, one per completed async flush
+  size_t flushCount;
+  size_t flushAlloc;
   size_t UUID;
   double elapsedTime;
+  double passStart; // when the last pass over the positions started, timed positions are due from here
+  size_t passEnd; // and the positions before this one were queued in it
   diskStatType *diskStats;
+  const dataPatternType *pattern; // the write data, NULL for the seed's cyclic buffer
+  size_t sectorSize; // 'g', a header in every sector this size, 0 for the position stamp only
 } positionContainer;
 
 //positionType *createPositions(size_t num);
@@ -85,6 +126,7 @@ void positionContainerInit(positionContainer *pc, size_t UUID);
 void positionContainerSetup(positionContainer *pc, size_t sz);
 void positionContainerSetupFromPC(positionContainer *pc, const positionContainer *oldpc);
 void positionContainerFree(positionContainer *pc);
+void positionContainerAddFlushLatency(positionContainer *pc, const double secs);
 
 jobType positionContainerLoad(positionContainer *pc, FILE *fd);
 
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "bufferKernels.h"
+#include "sectorHeader.h"
+
+_Static_assert(sizeof(sectorHeaderType) == 32, "bufferStampSectors() takes a 32 byte header");
+
+static _Atomic uint32_t nextGeneration = 1;
+
+
+size_t sectorHeaderParse(const char *jobstring)
+{
+  const char *charG = strchr(jobstring, 'g');
+  if (!charG) return 0;
+
+  const size_t size = atoi(charG + 1);
+  if (size == 0) return 4096;
+  if ((size != 512) && (size != 4096)) {
+    fprintf(stderr,"*error* sector headers are every 512 bytes (g512) or 4 KiB (g or g4096), not %zd\n", size);
+    exit(1);
+  }
+  return size;
+}
+
+
+uint32_t sectorHeaderGeneration(void)
+{
+  return nextGeneration++;
+}
+
+
+void sectorHeaderStamp(char *buf, const size_t len, const size_t sectorSize, const size_t pos, const size_t uuid, const uint32_t generation, const unsigned short seed)
+{
+  const sectorHeaderType h = {SECTORHEADER_MAGIC, 0, pos / 512, uuid, generation, seed, sectorSize / 512};
+  bufferStampSectors(buf, len / sectorSize, sectorSize, (const char*)&h);
+}
+
+
+size_t sectorHeaderDetect(const char *buf, const size_t len)
+{
+  sectorHeaderType h;
+  if (len < sizeof(h)) return 0;
+  memcpy(&h, buf, sizeof(h));
+  if ((h.magic != SECTORHEADER_MAGIC) || ((h.sectorSize != 1) && (h.sectorSize != 8))) return 0;
+  const size_t sectorSize = h.sectorSize * 512;
+  return (len >= sectorSize) ? sectorSize : 0;
+}
+
+
+size_t sectorHeaderCheck(char *buf, const char *expected, const size_t len, const size_t sectorSize, const size_t pos, const unsigned short seed, sectorCheckType *r)
+{
+  memset(r, 0, sizeof(sectorCheckType));
+  r->sectors = len / sectorSize;
+  r->firstBad = r->sectors;
+
+  // the write is the first sector with a good header, any other write's sectors are torn
+  int haveWrite = 0;
+  uint64_t uuid = 0;
+  for (size_t s = 0; s < r->sectors; s++) {
+    char *sector = buf + s * sectorSize;
+    sectorHeaderType h;
+    memcpy(&h, sector, sizeof(h));
+
+    const uint32_t zero = 0;
+    memcpy(sector + 4, &zero, 4);
+    const uint32_t crc = bufferCrc32c(sector, sectorSize);
+    memcpy(sector + 4, &h.crc, 4);
+
+    int bad = 1;
+    if ((h.magic != SECTORHEADER_MAGIC) || (crc != h.crc)) {
+      r->crc++;
+    } else if ((h.lba != (pos + s * sectorSize) / 512) || (h.sectorSize != sectorSize / 512)) {
+      r->misplaced++;
+    } else if ((h.seed != seed) || (haveWrite && ((h.uuid != uuid) || (h.generation != r->generation)))) {
+      if (r->torn == 0) r->otherGeneration = h.generation;
+      r->torn++;
+    } else {
+      if (!haveWrite) {
+	haveWrite = 1;
+	uuid = h.uuid;
+	r->generation = h.generation;
+      }
+      const size_t hl = sizeof(sectorHeaderType);
+      if (bufferMismatch(sector + hl, expected + s * sectorSize + hl, sectorSize - hl) != sectorSize - hl) {
+	r->data++;
+      } else {
+	bad = 0;
+      }
+    }
+    if (bad) {
+      if (r->bad == 0) r->firstBad = s;
+      r->bad++;
+    }
+  }
+
+  // a part sector at the end isn't stamped
+  const size_t tail = r->sectors * sectorSize;
+  if ((tail < len) && (bufferMismatch(buf + tail, expected + tail, len - tail) != len - tail)) {
+    if (r->bad == 0) r->firstBad = r->sectors;
+    r->data++;
+    r->bad++;
+  }
+  return r->bad;
+}
@@ -0,0 +1,50 @@
+#ifndef _SECTORHEADER_H
+#define _SECTORHEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the g command stamps a header into every sector of a write, not just the position at the
+// start, so a torn write, with only some of its sectors on the media, is found sector by sector
+
+#define SECTORHEADER_MAGIC 0x31545053 // "SPT1"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t crc; // CRC32C of the whole sector, taken with this field zero
+  uint64_t lba; // the sector's device offset in 512 byte units
+  uint64_t uuid; // the run
+  uint32_t generation; // the write, the same in every sector it wrote
+  uint16_t seed;
+  uint16_t sectorSize; // in 512 byte units
+} sectorHeaderType;
+
+typedef struct {
+  size_t sectors;
+  size_t bad; // sectors with any problem
+  size_t torn; // a good header from another write
+  size_t crc; // no header or the CRC doesn't match, not written or corrupt
+  size_t misplaced; // a good header for another offset
+  size_t data; // a good header but not the seed's data
+  size_t firstBad; // sector number, sectors if none
+  uint32_t generation, otherGeneration; // the write's, and the first one from another write
+} sectorCheckType;
+
+// g is 4 KiB sectors, g512 512 byte ones. Returns the sector size, 0 if the string has no g
+size_t sectorHeaderParse(const char *jobstring);
+
+// a new write generation, unique over all the threads
+uint32_t sectorHeaderGeneration(void);
+
+// stamp the whole sectors of len bytes written at device offset pos
+void sectorHeaderStamp(char *buf, const size_t len, const size_t sectorSize, const size_t pos, const size_t uuid, const uint32_t generation, const unsigned short seed);
+
+// the sector size from the header at the start of buf, 0 if it hasn't got one. For spitchecker,
+// which only has the positions and not the job's g
+size_t sectorHeaderDetect(const char *buf, const size_t len);
+
+// each sector of buf against its header, and the data after the headers against expected.
+// Returns the number of bad sectors
+size_t sectorHeaderCheck(char *buf, const char *expected, const size_t len, const size_t sectorSize, const size_t pos, const unsigned short seed, sectorCheckType *r);
+
+#endif
@@ -3,6 +3,7 @@
 #define _GNU_SOURCE
 
 #include "jobType.h"
+#include "traceReplay.h"
 #include <signal.h>
 
 #ifndef VERSION
@@ -25,6 +26,8 @@
 #include <fcntl.h>
 
 #include "positions.h"
+#include "positionLog.h"
+#include "positionStream.h"
 #include "utils.h"
 #include "diskStats.h"
 #include "spitfuzz.h"
@@ -35,6 +38,8 @@ int verbose = 0;
 int keepRunning = 1;
 char *benchmarkName = NULL;
 FILE *savePositions = NULL;
+lengthsType *blockSizes = NULL; // -k
+traceType *trace = NULL; // -W
 char *device = NULL;
 
 int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
@@ -66,7 +71,7 @@ int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
   optind = 0;
   size_t jglobalcount = 1;
 
-  const char *getoptstring = "j:b:c:f:F:G:t:d:VB:I:q:XR:p:O:s:i:vP:M:N:e:uU:TrC:1L:";
+  const char *getoptstring = "j:b:c:f:F:G:t:d:VB:I:q:XR:p:O:s:i:vP:M:N:e:uU:TrC:1L:k:W:";
 
   while ((opt = getopt(argc, argv, getoptstring )) != -1) {
     switch (opt) {
@@ -205,6 +210,18 @@ int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
       exit(1);
     }
     break;
+    case 'k':
+      if (blockSizes == NULL) {
+        CALLOC(blockSizes, 1, sizeof(lengthsType));
+        lengthsInit(blockSizes);
+      }
+      lengthsLoad(blockSizes, optarg);
+      if (verbose) lengthsDump(blockSizes);
+      break;
+    case 'W':
+      if (trace) traceFree(trace);
+      trace = traceLoad(optarg);
+      break;
     case 'L':
       *ramBytesForPositions = 1024L * 1024L * 1024L * atof(optarg);
       fprintf(stderr,"*info* limit RAM use to %.2lf GiB\n", TOGiB(*ramBytesForPositions));
@@ -228,7 +245,7 @@ int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
 	struct stat bf;
 	fstat(fileno(savePositions),  &bf);
 	if (S_ISFIFO(bf.st_mode)) {
-	  fcntl(fileno(savePositions), F_SETPIPE_SZ, 0);
+	  fcntl(fileno(savePositions), F_SETPIPE_SZ, POSSTREAM_PIPE); // room for the writer's large writes
 	  int ld = fcntl(fileno(savePositions), F_GETPIPE_SZ);
 	  fprintf(stderr,"*info* positions streamed to FIFO/pipe (buffer %d)\n", ld);
 	} else {
@@ -236,9 +253,13 @@ int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
 	  setlinebuf(savePositions);
 	}
       } else {
-	savePositions = fopen(optarg, "wt");
+	// binary unless asked for text, spitlog converts between them
+	const size_t plen = strlen(optarg);
+	const int text = (plen >= 4) && (strcmp(optarg + plen - 4, ".txt") == 0);
+	savePositions = fopen(optarg, text ? "wt" : "wb");
 	if (!savePositions) {perror(optarg); exit(-1);}
-	fprintf(stderr,"*info* savePositions set to '%s'\n", optarg);
+	if (!text) positionLogSetBinary(savePositions, POSLOG_FIXED);
+	fprintf(stderr,"*info* savePositions set to '%s' (%s)\n", optarg, text ? "text" : "binary");
       }
       break;
     case 'q':
@@ -329,6 +350,8 @@ int handle_args(int argc, char *argv[], jobType *preconditions, jobType *j,
     jobMultiply(j, &jtemp, deviceList, deviceCount);
     jobMultiply(preconditions, &pretemp, deviceList, deviceCount);
   }
+  j->lengths = blockSizes;
+  j->trace = trace;
 
   if (deviceCount > 0) {
     device = strdup(deviceList[0].devicename);
@@ -470,7 +493,7 @@ void usage()
   fprintf(stdout,"  spit -f device -c r -G 1-2    # Only perform actions in the 1-2 GiB range\n");
   fprintf(stdout,"  spit -c ws1G1-2 -c rs0G2-3    # Seq w in the 1-2 GiB region, rand r in the 2-3 GiB region\n");
   fprintf(stdout,"  spit -f ... -t 50             # run for 50 seconds (-t -1 is forever)\n");
-  fprintf(stdout,"  spit -f -c ..j32              # duplicate all the commands 32 times. Pin threads to each NUMA node.\n");
+  fprintf(stdout,"  spit -f -c ..j32              # duplicate all the commands 32 times. Pin threads to each NUMA node, with node local 2 MiB page I/O buffers.\n");
   fprintf(stdout,"  spit -f -c ..j32 -u           # j32, but do not pin the threads to specific NUMA nodes\n");
   fprintf(stdout,"  spit -f -c ..j32 -U 0         # j32, pin all threads to  NUMA node 0\n");
   fprintf(stdout,"  spit -f -c ..j32 -U 0,1       # j32, split threads evenly between NUMA node 0 and 1\n");
@@ -480,6 +503,7 @@ void usage()
   fprintf(stdout,"  spit -f ... -c rD0            # 'D' turns off O_DIRECT\n");
   fprintf(stdout,"  spit -f ... -c wR42           # set the per command seed with R\n");
   fprintf(stdout,"  spit -f ... -c wF             # (F)lush after every write of FF for 10, FFF for 100 ...\n");
+  fprintf(stdout,"  spit -f ... -c wFFY           # flush every 10 writes, as a barrier (Y) instead of overlapping\n");
   fprintf(stdout,"  spit -f ... -c rrrrw          # do 4 reads for every write\n");
   fprintf(stdout,"  spit -f ... -c rw             # mix 50/50 reads/writes\n");
   fprintf(stdout,"  spit -f ... -c n              # shuffles the positions every pass\n");
@@ -519,7 +543,7 @@ void usage()
   fprintf(stdout,"  spit -f meta -O devices.txt   # specify the raw devices for amplification statistics\n");
   fprintf(stdout,"  spit -s 0.1 -i 5              # and ignore first 5 GiB of performance\n");
   fprintf(stdout,"  spit -v                       # verify the writes after a run\n");
-  fprintf(stdout,"  spit -P filename              # dump positions to filename\n");
+  fprintf(stdout,"  spit -P filename              # dump positions to filename, binary unless it ends in .txt (see spitlog)\n");
   fprintf(stdout,"  spit -P -                     # dump positions to (stdout) and stream raw IOs without collapsing\n");
   fprintf(stdout,"  spit -c wG_j4                 # The _ represents to divide the G value evenly between threads\n");
   fprintf(stdout,"  spit -B bench -M ... -N ...   # See the man page for benchmarking tips\n");
@@ -535,8 +559,23 @@ void usage()
   fprintf(stdout,"  spit -c wk1024za3A8           # 'A' means to add 8 KiB after every position after 3 MiB\n");
   fprintf(stdout,"  spit -c ws1G5_10j16           # specify a low and high GiB range, to be evenly split by 16 threads (_)\n");
   fprintf(stdout,"  spit -c wx3 -G4 -T            # perform pre-DISCARD/TRIM operations before each round\n");
-  fprintf(stdout,"  spit -c ts0                   # Use a sync DISCARD/TRIM I/O type\n");
+  fprintf(stdout,"  spit -c ts0                   # Use a DISCARD/TRIM I/O type, performed by a discard worker thread\n");
   fprintf(stdout,"  spit -c rrwts0                # 50%% read, 25%% writes and 25%% trim I/O random operations\n");
+  fprintf(stdout,"  spit -c rrwts0E8              # as above, with up to 8 trims in flight on the discard workers\n");
+  fprintf(stdout,"  spit -c rs0i                  # use the io_uring engine, registered file and buffers\n");
+  fprintf(stdout,"  spit -c rs0i2                 # io_uring with a kernel SQPOLL submission thread\n");
+  fprintf(stdout,"  spit -c rs0q1c                # poll the completion ring in userspace, reports CPU cost\n");
+  fprintf(stdout,"  spit -c rs0q1h                # polled completions (io_uring IOPOLL), needs queue/io_poll=1\n");
+  fprintf(stdout,"  spit -c rs0q256d              # separate submitter and reaper threads, on SMT siblings if possible\n");
+  fprintf(stdout,"  spit -c rs0q32l               # lazy positions, generated as the I/O runs, for devices too big for RAM\n");
+  fprintf(stdout,"  spit -k sizes.txt -c rs0      # block sizes from a distribution: size count lines, bpftrace/bcc histograms or diskstats\n");
+  fprintf(stdout,"  spit -W trace.txt -c q32       # replay a blkparse text dump or fio iolog with its timing, v2 twice as fast, v0 flat out\n");
+  fprintf(stdout,"  spit -c wC2:3:8               # write 2:1 compressible data with a 3:1 dedupe ratio over 8 KiB blocks\n");
+  fprintf(stdout,"  spit -c wk16g512 -v           # a header in every 512 byte sector, verify finds torn writes sector by sector\n");
+  fprintf(stdout,"  spit -c rs0e0.99              # zipf skewed access with theta 0.99, reports the working set\n");
+  fprintf(stdout,"  spit -c rs0H90:10             # hot set, 90%% of the I/O to 10%% of the blocks\n");
+  fprintf(stdout,"  spit -c rs0V20                # pareto skew, 80%% of the I/O to 20%% of the blocks, recursively\n");
+  fprintf(stdout,"  spit -c rs0q4o -c rs0q4o1      # 'o' or 'oN' has event loop thread N drive the job, one thread for many devices\n");
   fprintf(stdout,"  spit -c wx1G0-64k4zs1         # Write from [0,64) GiB, in 4KiB steps, sequentially \n");
   fprintf(stdout,"  spit -c wx1G0-64k4zs1K20      # Write from [0,64) GiB, in 4KiB steps, writing 1 in 20. \n");
   fprintf(stdout,"  spit -p f5 -f device -c ...   # Precondition/max-fragmentation with 5%% GC overhead, becomes K20.\n");
@@ -1005,6 +1044,7 @@ int main(int argc, char *argv[])
   } while (fuzz);
 
   if (benchmarkName) free(benchmarkName);
+  if (trace) traceFree(trace);
   //  if (device) free(device);
 
   fprintf(stderr,"*info* exiting.\n");
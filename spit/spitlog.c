@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
+/**
+ * spitlog.c
+ *
+ * converts spit -P position logs between the binary and the text format
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "utils.h"
+#include "positions.h"
+#include "positionLog.h"
+
+int keepRunning = 1;
+int verbose = 0;
+
+
+static void usage()
+{
+  fprintf(stdout,"Usage:\n   spitlog [-d] input output\n");
+  fprintf(stdout,"\nA binary log is written out as text, a text file (or - for stdin) as a binary log.\n");
+  fprintf(stdout,"The output can be - for stdout.\n");
+  fprintf(stdout,"\nOptions:\n");
+  fprintf(stdout,"   -d    delta encode the binary records\n");
+  fprintf(stdout,"   -V    verbose\n");
+  fprintf(stdout,"\nExamples:\n");
+  fprintf(stdout,"   spitlog pos.spl - | awk '{print $2}'\n");
+  fprintf(stdout,"   spitlog -d pos.txt pos.spl\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  int opt, flags = POSLOG_FIXED;
+
+  while ((opt = getopt(argc, argv, "dV")) != -1) {
+    switch (opt) {
+    case 'd':
+      flags |= POSLOG_DELTA;
+      break;
+    case 'V':
+      verbose++;
+      break;
+    default:
+      usage();
+      exit(1);
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    exit(1);
+  }
+  const char *in = argv[optind], *out = argv[optind + 1];
+
+  positionContainer pc;
+  jobType job;
+  const int binaryIn = (strcmp(in, "-") != 0) && positionLogIsLog(in);
+
+  if (binaryIn) {
+    job = positionLogLoad(&pc, in);
+  } else {
+    FILE *fp = (strcmp(in, "-") == 0) ? stdin : fopen(in, "rt");
+    if (!fp) {perror(in); exit(1);}
+    job = positionContainerLoad(&pc, fp);
+    if (fp != stdin) fclose(fp);
+  }
+
+  FILE *fp = (strcmp(out, "-") == 0) ? stdout : fopen(out, binaryIn ? "wt" : "wb");
+  if (!fp) {perror(out); exit(1);}
+
+  // clockSetup() is never called here, so the loaded wall clock times are written back unchanged
+  if (binaryIn) {
+    positionContainerSave(&pc, fp, pc.maxbdSize, 0, &job);
+  } else {
+    positionLogSave(&pc, fp, pc.maxbdSize, &job, flags);
+  }
+  if (verbose) {
+    fprintf(stderr,"*info* converted %zd positions from %s to %s\n", pc.sz, binaryIn ? "binary" : "text", binaryIn ? "text" : "binary");
+  }
+
+  if (fp != stdout) fclose(fp);
+  positionContainerFree(&pc);
+  jobFree(&job);
+  return 0;
+}
@@ -47,7 +47,7 @@ int main()
   positionContainerDump(&pc3, 10);
 
   for (size_t i = 0; i < pc3.sz; i++) {
-    pc3.positions[i].finishTime = 1;
+    positionSetFinishTime(&pc3.positions[i], 1);
   }
 
   char *tmp = malloc(100);
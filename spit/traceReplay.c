@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "utils.h"
+#include "traceReplay.h"
+
+extern int verbose;
+
+#define TRACE_ALIGN 4096
+
+
+static void traceAdd(traceType *t, size_t *alloc, const double time, const size_t offset, const size_t len, const char action)
+{
+  if (t->count >= *alloc) {
+    *alloc = *alloc * 2 + 1024;
+    t->records = realloc(t->records, *alloc * sizeof(traceRecord));
+    if (!t->records) {
+      fprintf(stderr,"*error* not enough RAM for the trace\n");
+      exit(1);
+    }
+  }
+  traceRecord *r = &t->records[t->count++];
+  r->time = time;
+  r->offset = offset;
+  r->len = len;
+  r->action = action;
+}
+
+
+// 8,0  3  1  0.000000000  697  Q  WS 1234567 + 8 [kworker]
+static int blkparseLine(const char *line, double *time, char *event, char *rwbs, size_t *sector, size_t *sectors)
+{
+  unsigned int major, minor, cpu, seq, pid;
+  char ev[4];
+  const int got = sscanf(line, "%u,%u %u %u %lf %u %3s %7s %zu + %zu", &major, &minor, &cpu, &seq, time, &pid, ev, rwbs, sector, sectors);
+  if (got < 8) return 0;
+  if (got < 10) *sector = *sectors = 0;
+  *event = (ev[1] == 0) ? ev[0] : 0; // Q, D, C... not the two letter ones
+  return 1;
+}
+
+static char blkparseAction(const char *rwbs, const size_t sectors)
+{
+  if (strchr(rwbs, 'D')) return sectors ? 'T' : 0;
+  if (strchr(rwbs, 'W')) return sectors ? 'W' : 'F';
+  if (strchr(rwbs, 'R')) return sectors ? 'R' : 0;
+  if (strchr(rwbs, 'F')) return 'F';
+  return 0;
+}
+
+static char fioAction(const char *a)
+{
+  if (strcmp(a, "read") == 0) return 'R';
+  if (strcmp(a, "write") == 0) return 'W';
+  if (strcmp(a, "trim") == 0) return 'T';
+  if ((strcmp(a, "sync") == 0) || (strcmp(a, "datasync") == 0)) return 'F';
+  return 0;
+}
+
+
+static int recordCompare(const void *a, const void *b)
+{
+  const traceRecord *x = (const traceRecord*)a, *y = (const traceRecord*)b;
+  if (x->time < y->time) return -1;
+  if (x->time > y->time) return 1;
+  return (x->offset < y->offset) ? -1 : (x->offset > y->offset);
+}
+
+
+traceType *traceLoad(const char *filename)
+{
+  FILE *fp = fopen(filename, "rt");
+  if (!fp) {
+    perror(filename);
+    exit(1);
+  }
+  traceType *t;
+  CALLOC(t, 1, sizeof(traceType));
+  t->filename = strdup(filename);
+  t->timed = 1;
+
+  char *line = NULL;
+  size_t linelen = 0, alloc = 0, lines = 0, skipped = 0;
+  int fioVersion = 0;
+  double fioWait = 0;
+  // blkparse has a line per event, keep the queue (Q) events, or the issues (D) if there aren't any
+  traceType issued;
+  memset(&issued, 0, sizeof(traceType));
+  size_t issuedAlloc = 0;
+
+  while (getline(&line, &linelen, fp) != -1) {
+    lines++;
+    if ((lines == 1) && (sscanf(line, "fio version %d iolog", &fioVersion) == 1)) {
+      if ((fioVersion != 2) && (fioVersion != 3)) {
+	fprintf(stderr,"*error* fio iolog version %d isn't supported\n", fioVersion);
+	exit(1);
+      }
+      continue;
+    }
+
+    if (fioVersion) {
+      char name[1024], action[20];
+      size_t offset = 0, len = 0;
+      unsigned long ms = 0;
+      int got;
+      if (fioVersion == 3) {
+	got = sscanf(line, "%lu %1023s %19s %zu %zu", &ms, name, action, &offset, &len) - 1;
+      } else {
+	got = sscanf(line, "%1023s %19s %zu %zu", name, action, &offset, &len);
+      }
+      if ((got >= 3) && (strcmp(action, "wait") == 0)) {
+	fioWait += offset / 1000000.0; // v2, microseconds
+	continue;
+      }
+      const char a = (got >= 2) ? fioAction(action) : 0;
+      if (!a || ((a != 'F') && ((got < 4) || (len == 0)))) {
+	if (got >= 2 && !a) skipped++; // add, open, close
+	continue;
+      }
+      traceAdd(t, &alloc, (fioVersion == 3) ? ms / 1000.0 : fioWait, offset, len, a);
+    } else {
+      double time;
+      char event, rwbs[8];
+      size_t sector, sectors;
+      if (!blkparseLine(line, &time, &event, rwbs, &sector, &sectors)) continue;
+      if ((event != 'Q') && (event != 'D')) continue;
+      const char a = blkparseAction(rwbs, sectors);
+      if (!a) {
+	skipped++;
+	continue;
+      }
+      if (event == 'Q') {
+	traceAdd(t, &alloc, time, sector * 512, sectors * 512, a);
+      } else {
+	traceAdd(&issued, &issuedAlloc, time, sector * 512, sectors * 512, a);
+      }
+    }
+  }
+  free(line);
+  fclose(fp);
+  if (fioVersion == 2) t->timed = (fioWait > 0); // only the wait lines give v2 any timing
+
+  if (t->count == 0) {
+    free(t->records);
+    t->records = issued.records;
+    t->count = issued.count;
+  } else {
+    free(issued.records);
+  }
+  if (t->count == 0) {
+    fprintf(stderr,"*error* no I/O found in the trace '%s', expecting blkparse output or a fio iolog\n", filename);
+    exit(1);
+  }
+
+  // blkparse merges the per CPU streams, so it's nearly in order already
+  int sorted = 1;
+  for (size_t i = 1; i < t->count; i++) {
+    if (t->records[i].time < t->records[i - 1].time) {
+      sorted = 0;
+      break;
+    }
+  }
+  if (!sorted) qsort(t->records, t->count, sizeof(traceRecord), recordCompare);
+
+  const double first = t->records[0].time;
+  for (size_t i = 0; i < t->count; i++) {
+    traceRecord *r = &t->records[i];
+    r->time -= first;
+    switch (r->action) {
+    case 'R': t->reads++; break;
+    case 'W': t->writes++; break;
+    case 'T': t->trims++; break;
+    default: t->flushes++; break;
+    }
+    if (r->len > t->maxLen) t->maxLen = r->len;
+  }
+  t->maxLen = MAX(TRACE_ALIGN, (t->maxLen + TRACE_ALIGN - 1) / TRACE_ALIGN * TRACE_ALIGN);
+  t->duration = t->records[t->count - 1].time;
+
+  fprintf(stderr,"*info* trace '%s': %zd I/Os (reads %zd, writes %zd, trims %zd, flushes %zd) over %.3lf s, max %.0lf KiB, %s\n", filename, t->count, t->reads, t->writes, t->trims, t->flushes, t->duration, TOKiB(t->maxLen), fioVersion ? "fio iolog" : "blkparse");
+  if (skipped && verbose) {
+    fprintf(stderr,"*info* trace '%s': %zd lines with other actions skipped\n", filename, skipped);
+  }
+  return t;
+}
+
+
+void traceFree(traceType *t)
+{
+  if (t) {
+    free(t->records);
+    free(t->filename);
+    free(t);
+  }
+}
+
+
+void tracePositions(const traceType *t, positionContainer *pc, const unsigned short deviceid, const size_t minbdSize, const size_t maxbdSize,
+		    const unsigned short seed, const double speed, const char *prefix)
+{
+  assert(pc->sz == t->count);
+  const size_t range = (maxbdSize - minbdSize) / TRACE_ALIGN * TRACE_ALIGN;
+  if (range < TRACE_ALIGN) {
+    fprintf(stderr, "*error* device size [%zd, %zd) is too small for a trace\n", minbdSize, maxbdSize);
+    exit(1);
+  }
+
+  size_t wrapped = 0, realigned = 0, minbs = (size_t)-1, maxbs = 0, lastus = 0;
+  for (size_t i = 0; i < t->count; i++) {
+    const traceRecord *r = &t->records[i];
+    positionType *p = &pc->positions[i];
+    memset(p, 0, sizeof(positionType));
+
+    size_t len = (MAX(r->len, 1) + TRACE_ALIGN - 1) / TRACE_ALIGN * TRACE_ALIGN;
+    if (len > range) len = range;
+    size_t off = r->offset;
+    if ((off % TRACE_ALIGN) || (len != r->len)) {
+      if (r->action != 'F') realigned++;
+      off = off / TRACE_ALIGN * TRACE_ALIGN;
+    }
+    if (off + len > range) {
+      wrapped++;
+      off = (off % range) / TRACE_ALIGN * TRACE_ALIGN;
+      if (off + len > range) off = range - len;
+    }
+    if (r->action == 'F') off = 0; // a flush has no range, it keeps the checks happy
+
+    p->pos = minbdSize + off;
+    p->len = len;
+    p->action = r->action;
+    p->seed = seed;
+    p->deviceid = deviceid;
+    if (speed > 0) {
+      // rounded from the arrival time, not the gap, so the error doesn't add up over the trace
+      size_t us = r->time / speed * 1000000 + 0.5;
+      if (us < lastus) us = lastus; // out of order, it goes straight after
+      p->usdelta = MIN(us - lastus, UINT_MAX);
+      lastus = us;
+    }
+    if (len < minbs) minbs = len;
+    if (len > maxbs) maxbs = len;
+  }
+  pc->minbs = minbs;
+  pc->maxbs = maxbs;
+  pc->minbdSize = minbdSize;
+  pc->maxbdSize = maxbdSize;
+
+  if (prefix) {
+    if (speed > 0) {
+      fprintf(stderr,"*info* %s replaying %zd I/Os at %gx speed, %.3lf s a pass", prefix, t->count, speed, t->duration / speed);
+    } else {
+      fprintf(stderr,"*info* %s replaying %zd I/Os as fast as possible", prefix, t->count);
+    }
+    fprintf(stderr,", %zd realigned to 4 KiB, %zd wrapped into the %.2lf GiB range\n", realigned, wrapped, TOGiB(range));
+  }
+}
+
+
+void traceCheckPositions(const traceType *t, const positionContainer *pc, const double speed, const char *prefix)
+{
+  assert(pc->sz == t->count);
+  size_t us = 0, wrong = 0, early = 0, checked = 0;
+  double late = 0;
+  for (size_t i = 0; i < t->count; i++) {
+    const positionType *p = &pc->positions[i];
+    us += p->usdelta;
+    if (speed > 0) {
+      // the records are in time order, so the gaps add up to each arrival time
+      const size_t want = t->records[i].time / speed * 1000000 + 0.5;
+      if ((us != want) && (wrong++ < 5)) {
+	fprintf(stderr,"*error* %s position %zd is due at %zd us, it arrived at %zd us\n", prefix, i, us, want);
+      }
+    }
+    // the end of the pass before can be submitted with the start of this one, so it's by index
+    if ((i < pc->passEnd) && p->latency && (p->submitTime >= pc->passStart)) {
+      const double due = pc->passStart + us / 1000000.0;
+      if (p->submitTime < due - 1e-6) {
+	if (early++ < 5) fprintf(stderr,"*error* %s position %zd was submitted %.6lf s before it was due\n", prefix, i, due - p->submitTime);
+      } else {
+	late += p->submitTime - due;
+      }
+      checked++;
+    }
+  }
+  if (wrong || early) {
+    fprintf(stderr,"*error* %s %zd positions are due at the wrong time, %zd were submitted early\n", prefix, wrong, early);
+    exit(1);
+  }
+  fprintf(stderr,"*info* %s %zd positions due at their arrival times, %zd from the last pass submitted %.3lf ms after they were due on average\n", prefix, t->count, checked, checked ? late * 1000 / checked : 0);
+}
@@ -0,0 +1,41 @@
+#ifndef _TRACEREPLAY_H
+#define _TRACEREPLAY_H
+
+#include <stddef.h>
+
+#include "positions.h"
+
+// block traces replayed as positions, with the gaps between arrival times in usdelta so the
+// I/O loop submits each one when it's due
+
+typedef struct {
+  double time; // seconds from the first I/O
+  size_t offset;
+  unsigned int len;
+  char action; // R, W, T or F
+} traceRecord;
+
+typedef struct traceType {
+  char *filename;
+  traceRecord *records;
+  size_t count;
+  size_t reads, writes, trims, flushes;
+  size_t maxLen;
+  double duration;
+  int timed; // fio v2 iologs only have times if they have wait lines
+} traceType;
+
+// a blkparse text dump (the Q events, or D if there are none) or a fio v2/v3 iolog
+traceType *traceLoad(const char *filename);
+void traceFree(traceType *t);
+
+// the container already has t->count positions. Offsets wrap into [minbdSize, maxbdSize) and
+// are aligned to 4 KiB. The times are divided by speed, 0 is as fast as possible
+void tracePositions(const traceType *t, positionContainer *pc, const unsigned short deviceid, const size_t minbdSize, const size_t maxbdSize,
+		    const unsigned short seed, const double speed, const char *prefix);
+
+// at -VVV after the run: the usdeltas add up to the arrival times, and none of the last pass's
+// I/O was submitted before it was due. Exits if not
+void traceCheckPositions(const traceType *t, const positionContainer *pc, const double speed, const char *prefix);
+
+#endif
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <time.h>
+
+#include "uringRequests.h"
+
+/*
+ * A minimal io_uring driver using the raw syscalls, so there's no dependency on liburing.
+ * The submission side takes the same iocbs that libaio would have been given and the
+ * completion side returns io_events, so aioMultiplePositions() keeps a single code path
+ * for the timestamps, verification and accounting.
+ */
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+  return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+  return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+int uringSetup(uringType *u, const size_t QD, const int sqpoll, const int iopoll)
+{
+  memset(u, 0, sizeof(uringType));
+  u->ringfd = -1;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  if (sqpoll) {
+    p.flags |= IORING_SETUP_SQPOLL;
+    p.sq_thread_idle = 1000; // ms
+  }
+  if (iopoll) {
+    p.flags |= IORING_SETUP_IOPOLL;
+  }
+
+  int fd = uring_setup(QD, &p);
+  if (fd < 0) {
+    fprintf(stderr,"*error* io_uring_setup failed with %zd (sqpoll=%d, iopoll=%d)\n", QD, sqpoll, iopoll);
+    perror("io_uring_setup");
+    return -1;
+  }
+  u->ringfd = fd;
+  u->sqpoll = sqpoll;
+  u->iopoll = iopoll;
+  u->entries = p.sq_entries;
+  u->features = p.features;
+
+  u->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cqRingSize > u->sqRingSize) u->sqRingSize = u->cqRingSize;
+    u->cqRingSize = u->sqRingSize;
+  }
+
+  u->sqRing = mmap(NULL, u->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (u->sqRing == MAP_FAILED) {
+    perror("mmap sq ring");
+    close(fd);
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cqRing = u->sqRing;
+  } else {
+    u->cqRing = mmap(NULL, u->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (u->cqRing == MAP_FAILED) {
+      perror("mmap cq ring");
+      munmap(u->sqRing, u->sqRingSize);
+      close(fd);
+      return -1;
+    }
+  }
+
+  u->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    perror("mmap sqes");
+    if (u->cqRing != u->sqRing) munmap(u->cqRing, u->cqRingSize);
+    munmap(u->sqRing, u->sqRingSize);
+    close(fd);
+    return -1;
+  }
+
+  u->sqHead = (unsigned*)((char*)u->sqRing + p.sq_off.head);
+  u->sqTail = (unsigned*)((char*)u->sqRing + p.sq_off.tail);
+  u->sqMask = (unsigned*)((char*)u->sqRing + p.sq_off.ring_mask);
+  u->sqFlags = (unsigned*)((char*)u->sqRing + p.sq_off.flags);
+  u->sqArray = (unsigned*)((char*)u->sqRing + p.sq_off.array);
+
+  u->cqHead = (unsigned*)((char*)u->cqRing + p.cq_off.head);
+  u->cqTail = (unsigned*)((char*)u->cqRing + p.cq_off.tail);
+  u->cqMask = (unsigned*)((char*)u->cqRing + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe*)((char*)u->cqRing + p.cq_off.cqes);
+
+  return 0;
+}
+
+
+int uringRegisterFile(uringType *u, const int fd)
+{
+  int fds[1] = {fd};
+  if (uring_register(u->ringfd, IORING_REGISTER_FILES, fds, 1) < 0) {
+    perror("io_uring_register files");
+    return -1;
+  }
+  u->fixedFile = 1;
+  return 0;
+}
+
+
+int uringRegisterBuffers(uringType *u, char *data, char *readdata, const size_t len)
+{
+  u->bufs[0].iov_base = data;
+  u->bufs[0].iov_len = len;
+  u->bufs[1].iov_base = readdata;
+  u->bufs[1].iov_len = len;
+  if (uring_register(u->ringfd, IORING_REGISTER_BUFFERS, u->bufs, 2) < 0) {
+    perror("io_uring_register buffers");
+    u->numBufs = 0;
+    return -1;
+  }
+  u->numBufs = 2;
+  return 0;
+}
+
+
+// find which registered buffer covers [buf, buf+len)
+static int uringBufIndex(const uringType *u, const void *buf, const size_t len)
+{
+  for (size_t i = 0; i < u->numBufs; i++) {
+    const char *b = u->bufs[i].iov_base;
+    if ((const char*)buf >= b && (const char*)buf + len <= b + u->bufs[i].iov_len) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+static void uringPrep(uringType *u, struct io_uring_sqe *sqe, struct iocb *cb)
+{
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  if (u->fixedFile) {
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+  } else {
+    sqe->fd = cb->aio_fildes;
+  }
+  sqe->user_data = (unsigned long)cb;
+
+  const int write = (cb->aio_lio_opcode == IO_CMD_PWRITE);
+  switch (cb->aio_lio_opcode) {
+  case IO_CMD_PREAD:
+  case IO_CMD_PWRITE: {
+    const int bi = uringBufIndex(u, cb->u.c.buf, cb->u.c.nbytes);
+    if (bi >= 0) {
+      sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = bi;
+    } else {
+      sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->addr = (unsigned long)cb->u.c.buf;
+    sqe->len = cb->u.c.nbytes;
+    sqe->off = cb->u.c.offset;
+    break;
+  }
+  case IO_CMD_PREADV:
+  case IO_CMD_PWRITEV:
+    sqe->opcode = (cb->aio_lio_opcode == IO_CMD_PWRITEV) ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->addr = (unsigned long)cb->u.v.vec;
+    sqe->len = cb->u.v.nr;
+    sqe->off = cb->u.v.offset;
+    break;
+  case IO_CMD_FDSYNC:
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    // fall through
+  case IO_CMD_FSYNC:
+    sqe->opcode = IORING_OP_FSYNC;
+    break;
+  default:
+    fprintf(stderr,"*error* io_uring engine doesn't support iocb opcode %d\n", cb->aio_lio_opcode);
+    abort();
+  }
+}
+
+
+// same semantics as io_submit(), returns the number of iocbs taken or -errno
+int uringSubmit(uringType *u, const int n, struct iocb **cbs)
+{
+  const unsigned mask = *u->sqMask;
+  unsigned tail = *u->sqTail;
+  const unsigned head = __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE);
+  int queued = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (tail - head >= u->entries) break; // ring full
+    const unsigned idx = tail & mask;
+    uringPrep(u, &u->sqes[idx], cbs[i]);
+    u->sqArray[idx] = idx;
+    tail++;
+    queued++;
+  }
+  if (queued == 0) return -EAGAIN;
+  __atomic_store_n(u->sqTail, tail, __ATOMIC_RELEASE);
+
+  if (u->sqpoll) {
+    // the kernel thread picks them up, only kick it if it has gone to sleep
+    if (__atomic_load_n(u->sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+      __atomic_fetch_add(&u->enterCalls, 1, __ATOMIC_RELAXED); // a split reaper thread enters the same ring
+      uring_enter(u->ringfd, 0, 0, IORING_ENTER_SQ_WAKEUP, NULL, 0);
+    }
+    return queued;
+  }
+
+  __atomic_fetch_add(&u->enterCalls, 1, __ATOMIC_RELAXED);
+  int ret = uring_enter(u->ringfd, queued, 0, 0, NULL, 0);
+  if (ret < 0) ret = -errno;
+  const int taken = ret < 0 ? 0 : ret;
+  if (taken < queued) {
+    // pull back what the kernel didn't consume, so the caller can retry those slots
+    __atomic_store_n(u->sqTail, tail - (queued - taken), __ATOMIC_RELEASE);
+  }
+  return ret < 0 ? ret : taken;
+}
+
+
+static int uringReap(uringType *u, const long nr, struct io_event *events)
+{
+  unsigned head = *u->cqHead;
+  const unsigned tail = __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE);
+  const unsigned mask = *u->cqMask;
+  int got = 0;
+
+  while (head != tail && got < nr) {
+    struct io_uring_cqe *cqe = &u->cqes[head & mask];
+    events[got].obj = (struct iocb*)(unsigned long)cqe->user_data;
+    events[got].data = events[got].obj->data;
+    events[got].res = cqe->res; // -errno on failure, like libaio
+    events[got].res2 = 0;
+    got++;
+    head++;
+  }
+  __atomic_store_n(u->cqHead, head, __ATOMIC_RELEASE);
+  return got;
+}
+
+
+// kernels before 5.11 have no timed wait in io_uring_enter, so wait for the ring fd instead. It's
+// readable when there are completions. With IOPOLL nothing completes unless we poll, so spin on
+// non-blocking polling passes until the timeout
+static int uringWaitOld(uringType *u, int got, const long min_nr, const long nr, struct io_event *events, const struct timespec *timeout)
+{
+  struct timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout->tv_sec;
+  deadline.tv_nsec += timeout->tv_nsec;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec left = {deadline.tv_sec - now.tv_sec, deadline.tv_nsec - now.tv_nsec};
+    if (left.tv_nsec < 0) {
+      left.tv_sec--;
+      left.tv_nsec += 1000000000L;
+    }
+    if (left.tv_sec < 0) break;
+
+    __atomic_fetch_add(&u->enterCalls, 1, __ATOMIC_RELAXED);
+    if (u->iopoll && !u->sqpoll) {
+      if ((uring_enter(u->ringfd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR) && (errno != EAGAIN)) {
+	if (got == 0) return -errno;
+	break;
+      }
+    } else {
+      struct pollfd pfd = {u->ringfd, POLLIN, 0};
+      if ((ppoll(&pfd, 1, &left, NULL) < 0) && (errno != EINTR)) {
+	if (got == 0) return -errno;
+	break;
+      }
+    }
+    got += uringReap(u, nr - got, events + got);
+  } while (got < min_nr);
+  return got;
+}
+
+
+// same semantics as io_getevents()
+int uringGetEvents(uringType *u, const long min_nr, const long nr, struct io_event *events, struct timespec *timeout)
+{
+  if (nr <= 0 || min_nr > nr) return -EINVAL;
+
+  int got = uringReap(u, nr, events);
+  // with IOPOLL and no SQPOLL thread nothing completes unless we enter and poll, even for a peek
+  if ((got >= min_nr) && !(u->iopoll && !u->sqpoll && (got == 0))) return got;
+
+  if (timeout && !(u->features & IORING_FEAT_EXT_ARG)) {
+    return uringWaitOld(u, got, min_nr, nr, events, timeout);
+  }
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  unsigned flags = IORING_ENTER_GETEVENTS;
+  void *argp = NULL;
+  size_t argsz = 0;
+  if (timeout && (u->features & IORING_FEAT_EXT_ARG)) {
+    ts.tv_sec = timeout->tv_sec;
+    ts.tv_nsec = timeout->tv_nsec;
+    arg.ts = (unsigned long)&ts;
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+
+  __atomic_fetch_add(&u->enterCalls, 1, __ATOMIC_RELAXED);
+  int ret = uring_enter(u->ringfd, 0, min_nr - got, flags, argp, argsz);
+  if (ret < 0 && errno != ETIME && errno != EINTR) {
+    if (got == 0) return -errno;
+  }
+
+  return got + uringReap(u, nr - got, events + got);
+}
+
+
+void uringFree(uringType *u)
+{
+  if (u->ringfd < 0) return;
+  munmap(u->sqes, u->sqesSize);
+  if (u->cqRing != u->sqRing) munmap(u->cqRing, u->cqRingSize);
+  munmap(u->sqRing, u->sqRingSize);
+  close(u->ringfd);
+  u->ringfd = -1;
+}
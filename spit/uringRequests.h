@@ -0,0 +1,49 @@
+#ifndef _URINGREQUESTS_H
+#define _URINGREQUESTS_H
+
+#include <sys/uio.h>
+#include <libaio.h>
+#include <linux/io_uring.h>
+
+// the I/O engines aioMultiplePositions can drive
+#define ENGINE_LIBAIO 0
+#define ENGINE_URING 1
+#define ENGINE_URING_SQPOLL 2
+
+typedef struct {
+  int ringfd;
+  int sqpoll;
+  int iopoll; // completions are polled from the device, not interrupt driven
+  size_t entries;
+
+  // submission ring
+  void *sqRing;
+  size_t sqRingSize;
+  unsigned *sqHead, *sqTail, *sqMask, *sqFlags, *sqArray;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+
+  // completion ring
+  void *cqRing;
+  size_t cqRingSize;
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_cqe *cqes;
+
+  unsigned features;
+  int fixedFile; // fd registered at index 0
+  struct iovec bufs[2]; // registered write [0] and read [1] slabs
+  size_t numBufs;
+  size_t enterCalls;
+} uringType;
+
+int uringSetup(uringType *u, const size_t QD, const int sqpoll, const int iopoll);
+
+int uringRegisterFile(uringType *u, const int fd);
+int uringRegisterBuffers(uringType *u, char *data, char *readdata, const size_t len);
+
+int uringSubmit(uringType *u, const int n, struct iocb **cbs);
+int uringGetEvents(uringType *u, const long min_nr, const long nr, struct io_event *events, struct timespec *timeout);
+
+void uringFree(uringType *u);
+
+#endif
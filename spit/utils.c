@@ -22,8 +22,14 @@
 #include <linux/hdreg.h>
 #include <numa.h>
 #include <numaif.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #include "utils.h"
+#include "bufferKernels.h"
 
 extern int keepRunning;
 
@@ -42,6 +48,105 @@ inline double timedouble()
   return tm/1000000.0;
 }
 
+
+/*
+ * timeStamp() is the clock for I/O submit/finish stamps. It uses the invariant TSC when the
+ * CPU has one, calibrated against CLOCK_MONOTONIC_RAW, otherwise CLOCK_MONOTONIC_RAW directly.
+ * The values are seconds on a monotonic timebase, only convert with timeStampToWall() for output.
+ */
+static int clockUseTSC = 0;
+static volatile int clockIsSetup = 0;
+static double clockTSCSeconds = 0;     // seconds per tick
+static unsigned long long clockTSCBase = 0;
+static double clockMonoBase = 0;       // CLOCK_MONOTONIC_RAW at clockTSCBase
+static double clockWallOffset = 0;     // wall - monotonic
+
+static inline double monoRaw()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int invariantTSC()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+    return 0;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx >> 8) & 1;
+}
+#endif
+
+double timeStamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (clockUseTSC) {
+    return clockMonoBase + (__rdtsc() - clockTSCBase) * clockTSCSeconds;
+  }
+#endif
+  return monoRaw();
+}
+
+double timeStampToWall(const double t)
+{
+  return t + clockWallOffset;
+}
+
+void clockSetup(const int verbose)
+{
+  if (clockIsSetup) return;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if (invariantTSC()) {
+    // calibrate over 20ms
+    const double m0 = monoRaw();
+    const unsigned long long t0 = __rdtsc();
+    double m1;
+    do {
+      m1 = monoRaw();
+    } while (m1 - m0 < 0.02);
+    const unsigned long long t1 = __rdtsc();
+    if (t1 > t0) {
+      clockTSCSeconds = (m1 - m0) / (t1 - t0);
+      clockTSCBase = t1;
+      clockMonoBase = m1;
+      clockUseTSC = 1;
+    }
+  }
+#endif
+  clockWallOffset = timedouble() - timeStamp();
+  clockIsSetup = 1;
+
+  if (verbose) {
+    // self-test: the smallest step we can see and the cost of a call
+    const int N = 1000000;
+    double res = 9e99, prev = timeStamp();
+    const double start = prev;
+    for (int i = 0; i < N; i++) {
+      const double now = timeStamp();
+      if (now > prev && now - prev < res) res = now - prev;
+      prev = now;
+    }
+    const double percall = (timeStamp() - start) / N;
+
+    const double gstart = timeStamp();
+    for (int i = 0; i < N / 10; i++) {
+      timedouble();
+    }
+    const double gpercall = (timeStamp() - gstart) / (N / 10);
+
+    if (clockUseTSC) {
+      fprintf(stderr,"*info* clock: invariant TSC at %.3lf GHz", 1e-9 / clockTSCSeconds);
+    } else {
+      fprintf(stderr,"*info* clock: CLOCK_MONOTONIC_RAW");
+    }
+    fprintf(stderr,", resolution %.1lf ns, %.1lf ns per call (gettimeofday %.1lf ns per call)\n", res * 1e9, percall * 1e9, gpercall * 1e9);
+  }
+}
+
 size_t fileSize(int fd)
 {
   size_t sz = lseek(fd, 0L, SEEK_END);
@@ -366,6 +471,26 @@ int getNumRequests(const char *suf)
   return nr;
 }
 
+// queue/io_poll, -1 if it can't be read (e.g. not a block device)
+int getIOPoll(const char *suf)
+{
+  if (suf == NULL) {
+    return -1;
+  }
+
+  char s[200];
+  int ret = -1;
+  sprintf(s, "/sys/block/%s/queue/io_poll", suf);
+  FILE *fp = fopen(s, "rt");
+  if (fp) {
+    if (fscanf(fp, "%d", &ret) != 1) {
+      ret = -1;
+    }
+    fclose(fp);
+  }
+  return ret;
+}
+
 
 int getRotational(const char *suf)
 {
@@ -452,8 +577,10 @@ size_t generateRandomBufferCyclic(char *buffer, const size_t size, unsigned shor
   memcpy(buffer, s, topr);
   */
 
-  for (size_t j = cyclic; j < size; j += cyclic) {
-    memcpy(buffer + j, buffer, cyclic);
+  // doubling the copied part each time, out to the end of the last cycle as before
+  const size_t cycles = (size + cyclic - 1) / cyclic * cyclic;
+  for (size_t j = cyclic; j < cycles; j += j) {
+    memcpy(buffer + j, buffer, MIN(j, cycles - j));
     //    buffer[j] = buffer[j % cyclic];
   }
 
@@ -483,13 +610,7 @@ size_t generateRandomBuffer(char *buffer, const size_t size, const unsigned shor
 
 size_t checksumBuffer(const char *buffer, const size_t size)
 {
-  size_t checksum = 0;
-  char *p = (char*)buffer;
-  for (size_t i = 0; i < size; i++) {
-    checksum += (i ^ *p);
-    p++;
-  }
-  return checksum;
+  return bufferChecksum(buffer, size);
 }
 
 
@@ -1053,19 +1174,70 @@ int pinThread( pthread_t* thread, int* hw_tids, size_t n_hw_tid )
   return rc;
 }
 
+// the first other hardware thread on the same core, -1 if there isn't one
+int getSiblingCPU(const int cpu)
+{
+  char s[200];
+  sprintf(s, "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+  FILE *fp = fopen(s, "rt");
+  if (!fp) {
+    return -1;
+  }
+  int ret = -1;
+  char line[200];
+  if (fgets(line, sizeof(line), fp)) {
+    // e.g. "3,35" or "2-3"
+    char *p = line;
+    while (*p && (ret < 0)) {
+      char *end = NULL;
+      long a = strtol(p, &end, 10);
+      if (end == p) break;
+      long b = a;
+      if (*end == '-') {
+	p = end + 1;
+	b = strtol(p, &end, 10);
+      }
+      for (long c = a; c <= b; c++) {
+	if (c != cpu) {
+	  ret = c;
+	  break;
+	}
+      }
+      p = (*end == ',') ? end + 1 : end;
+      if (*p == '\n') break;
+    }
+  }
+  fclose(fp);
+  return ret;
+}
+
+int pinThreadAttr( pthread_attr_t* attr, int* hw_tids, size_t n_hw_tid )
+{
+  cpu_set_t cpuset;
+  CPU_ZERO( &cpuset );
+  for( size_t tid = 0; tid < n_hw_tid; tid++ ) {
+    CPU_SET( hw_tids[ tid ], &cpuset );
+  }
+  return pthread_attr_setaffinity_np( attr, sizeof( cpu_set_t ), &cpuset );
+}
+
 void getBaseBlockDevice(const char *block_device, char* base_block_device)
 {
     char cmd[128];
     FILE* fp;
     int ret = -1;
+    if (block_device == NULL) { // a relative file name has no suffix
+        base_block_device[0] = 0;
+        return;
+    }
     sprintf(cmd, "lsblk -ndo pkname /dev/%s", block_device);
     fp = popen(cmd, "r");
     if(fp){
         ret = fscanf(fp, "%s", base_block_device);
         pclose(fp);
     }
-    if( ret == -1 )
-        base_block_device = (char*)block_device;
+    if( ret != 1 )
+        strcpy(base_block_device, block_device); // a whole device has no parent
 }
 
 int getDiscardInfo(const char *suffix, size_t *alignment_offset, size_t *discard_max_bytes, size_t *discard_granularity, size_t *discard_zeroes_data)
@@ -37,6 +37,9 @@
 #define DIFF(x,y) ((x) > (y)) ? ((x)-(y)) : ((y) - (x))
 
 double timedouble();
+double timeStamp();
+double timeStampToWall(const double t);
+void clockSetup(const int verbose);
 
 void writeChunks(int fd, char *label, int *chunkSizes, int numChunks, size_t maxTime, size_t resetTime, logSpeedType *l, size_t maxBufSize, size_t outputEvery, int seq, int direct, float limitGBToProcess, int verifyWrites, float flushEverySecs);
 void readChunks(int fd, char *label, int *chunkSizes, int numChunks, size_t maxTime, size_t resetTime, logSpeedType *l, size_t maxBufSize, size_t outputEvery, int seq, int direct, float limitGBToProcess);
@@ -85,6 +88,7 @@ char *getScheduler(const char *path);
 size_t alignedNumber(size_t num, size_t alignment);
 size_t randomBlockSize(const size_t lowbsBytes, const size_t highbsBytes, const size_t alignmentbits, const size_t randomValue);
 int getNumRequests(const char *suf);
+int getIOPoll(const char *suf);
 
 
 
@@ -117,6 +121,8 @@ int getNumHardwareThreads();
 int cpuCountPerNuma( int numa );
 void getThreadIDs( int numa, int* numa_cpu_list );
 int pinThread( pthread_t* thread, int* hw_tids, size_t n_hw_tid );
+int getSiblingCPU(const int cpu);
+int pinThreadAttr( pthread_attr_t* attr, int* hw_tids, size_t n_hw_tid );
 
 void getBaseBlockDevice(const char *block_device, char* base_block_device);
 int getDiscardInfo(const char *suffix, size_t *alignment_offset, size_t *discard_max_bytes, size_t *discard_granularity, size_t *discard_zeroes_data);
@@ -17,6 +17,8 @@
 #include <string.h>
 
 #include "positions.h"
+#include "positionLog.h"
+#include "positionStream.h"
 #include "utils.h"
 #include "blockVerify.h"
 
@@ -46,6 +48,7 @@ int main(int argc, char *argv[])
 
   if (argc <= 1) {
     fprintf(stdout,"Usage:\n   ./spitchecker [ options] filename* or -\n");
+    fprintf(stdout,"\nThe files can be text or binary position logs from spit -P\n");
     fprintf(stdout,"\nOptions:\n");
     fprintf(stdout,"   -4    Limit block verifications to first 4 KiB\n");
     fprintf(stdout,"   -D    turn off O_DIRECT\n");
@@ -115,7 +118,7 @@ int main(int argc, char *argv[])
       struct stat bf;
       fstat(fileno(fp),  &bf);
       if (S_ISFIFO(bf.st_mode)) {
-	fcntl(fileno(fp), F_SETPIPE_SZ, 0);
+	fcntl(fileno(fp), F_SETPIPE_SZ, POSSTREAM_PIPE);
 	int ld = fcntl(fileno(fp), F_GETPIPE_SZ);
 	if (!quiet) fprintf(stderr,"*info* positions streamed from FIFO/pipe (buffer %d)\n", ld);
       } else {
@@ -123,6 +126,9 @@ int main(int argc, char *argv[])
 	setlinebuf(fp);
       }
 
+    } else if (positionLogIsLog(argv[i])) {
+      if (!quiet) fprintf(stderr,"*info* position log: %s\n", argv[i]);
+      job = positionLogLoad(&origpc[i - optind], argv[i]);
     } else {
       if (!quiet) fprintf(stderr,"*info* position file: %s\n", argv[i]);
       fp = fopen(argv[i], "rt");